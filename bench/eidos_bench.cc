@@ -0,0 +1,537 @@
+// Copyright 2021 SiLeader and Cerussite.
+//
+// Licensed under the Apache License, Version 2.0 (the “License”);
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an “AS IS” BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// eidos-bench: load generator for eidos (and other Redis protocol servers)
+
+// Boost.Asio 1.74 uses std::exchange in awaitable.hpp without including <utility>
+#include <utility>
+
+#include <boost/asio.hpp>
+#include <boost/program_options.hpp>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <deque>
+#include <eidos/histogram.hpp>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <optional>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+/// benchmark options
+struct Options {
+  std::string host;
+  std::uint16_t port;
+  std::size_t threads;
+  std::size_t connections;
+  std::size_t pipeline;
+  std::uint64_t keyspace;
+  std::size_t value_size;
+  bool zipf;
+  double zipf_theta;
+  double read_ratio;
+  double rate;
+  double duration;
+  double warmup;
+  bool populate;
+  std::string unixsocket;  // connect to a Unix domain socket instead of host:port if set
+};
+
+/// Zipfian distributed integer generator (Gray et al., "Quickly Generating Billion-Record Synthetic Databases")
+class ZipfGenerator {
+ private:
+  std::uint64_t n_;
+  double theta_;
+  double alpha_;
+  double zetan_;
+  double eta_;
+  std::uniform_real_distribution<double> uniform_;
+
+ public:
+  ZipfGenerator(std::uint64_t n, double theta) : n_(n), theta_(theta), alpha_(), zetan_(), eta_(), uniform_(0.0, 1.0) {
+    const auto zeta2 = zeta(2, theta);
+    zetan_ = zeta(n, theta);
+    alpha_ = 1.0 / (1.0 - theta);
+    eta_ = (1.0 - std::pow(2.0 / static_cast<double>(n), 1.0 - theta)) / (1.0 - zeta2 / zetan_);
+  }
+
+ private:
+  static double zeta(std::uint64_t n, double theta) {
+    double sum = 0;
+    for (std::uint64_t i = 1; i <= n; ++i) {
+      sum += 1.0 / std::pow(static_cast<double>(i), theta);
+    }
+    return sum;
+  }
+
+ public:
+  template <class Engine>
+  std::uint64_t operator()(Engine& engine) {
+    const auto u = uniform_(engine);
+    const auto uz = u * zetan_;
+    if (uz < 1.0) {
+      return 0;
+    }
+    if (uz < 1.0 + std::pow(0.5, theta_)) {
+      return 1;
+    }
+    const auto v = static_cast<std::uint64_t>(static_cast<double>(n_) * std::pow(eta_ * u - eta_ + 1.0, alpha_));
+    return std::min(v, n_ - 1);
+  }
+};
+
+/// length of the first complete reply in buffer
+/// \param data buffer
+/// \param size buffer size
+/// \return reply length or no value (incomplete)
+std::optional<std::size_t> ReplyLength(const char* data, std::size_t size) {
+  const auto line_end = [data, size](std::size_t from) -> std::optional<std::size_t> {
+    for (auto i = from; i + 1 < size; ++i) {
+      if (data[i] == '\r' && data[i + 1] == '\n') {
+        return i + 2;
+      }
+    }
+    return std::nullopt;
+  };
+
+  const auto header_end = line_end(0);
+  if (!header_end) {
+    return std::nullopt;
+  }
+  switch (data[0]) {
+    case '+':
+    case '-':
+    case ':':
+      return header_end;
+    case '$': {
+      const auto length = std::stol(std::string(data + 1, header_end.value() - 3));
+      if (length < 0) {
+        return header_end;
+      }
+      const auto total = header_end.value() + static_cast<std::size_t>(length) + 2;
+      return total <= size ? std::optional<std::size_t>(total) : std::nullopt;
+    }
+    case '*': {
+      const auto count = std::stol(std::string(data + 1, header_end.value() - 3));
+      auto offset = header_end.value();
+      for (long i = 0; i < count; ++i) {
+        const auto element = ReplyLength(data + offset, size - offset);
+        if (!element) {
+          return std::nullopt;
+        }
+        offset += element.value();
+      }
+      return offset;
+    }
+    default:
+      throw std::runtime_error("invalid reply: " + std::string(data, header_end.value()));
+  }
+}
+
+/// encode command in Redis protocol
+/// \param out output buffer
+/// \param args command and arguments
+void EncodeCommand(std::string& out, std::initializer_list<std::string_view> args) {
+  out += "*" + std::to_string(args.size()) + "\r\n";
+  for (const auto& arg : args) {
+    out += "$" + std::to_string(arg.size()) + "\r\n";
+    out += arg;
+    out += "\r\n";
+  }
+}
+
+/// server endpoints (TCP or Unix domain socket)
+/// \param ioc io_context
+/// \param options benchmark options
+/// \return endpoints
+std::vector<boost::asio::generic::stream_protocol::endpoint> ResolveEndpoints(boost::asio::io_context& ioc,
+                                                                              const Options& options) {
+  std::vector<boost::asio::generic::stream_protocol::endpoint> endpoints;
+  if (!options.unixsocket.empty()) {
+    endpoints.emplace_back(boost::asio::local::stream_protocol::endpoint(options.unixsocket));
+    return endpoints;
+  }
+  boost::asio::ip::tcp::resolver resolver(ioc);
+  for (const auto& entry : resolver.resolve(options.host, std::to_string(options.port))) {
+    endpoints.emplace_back(entry.endpoint());
+  }
+  return endpoints;
+}
+
+/// per thread load generator
+class Worker {
+ private:
+  /// connection to the server
+  struct Connection {
+    boost::asio::generic::stream_protocol::socket socket;
+    boost::asio::steady_timer timer;
+    std::string pending;
+    std::string writing;
+    std::vector<char> buffer;
+    std::size_t buffered;
+    /// intended send time of requests in flight
+    std::deque<Clock::time_point> in_flight;
+    /// intended send time of requests not sent yet (open loop)
+    std::deque<Clock::time_point> backlog;
+    Clock::time_point next_send;
+
+    explicit Connection(boost::asio::io_context& ioc)
+        : socket(ioc), timer(ioc), pending(), writing(), buffer(64 * 1024), buffered(0), in_flight(), backlog(),
+          next_send() {}
+  };
+
+ private:
+  const Options& options_;
+  boost::asio::io_context ioc_;
+  boost::asio::steady_timer stop_timer_;
+  std::vector<std::unique_ptr<Connection>> connections_;
+  std::mt19937_64 random_;
+  std::optional<ZipfGenerator> zipf_;
+  std::uniform_int_distribution<std::uint64_t> uniform_;
+  std::bernoulli_distribution read_;
+  std::string value_;
+  Clock::time_point measure_from_;
+  Clock::time_point stop_at_;
+  Clock::duration interval_;
+
+  eidos::histogram::Histogram histogram_;
+  std::uint64_t errors_;
+
+ public:
+  Worker(const Options& options, std::uint64_t seed)
+      : options_(options),
+        ioc_(1),
+        stop_timer_(ioc_),
+        connections_(),
+        random_(seed),
+        zipf_(),
+        uniform_(0, options.keyspace - 1),
+        read_(options.read_ratio),
+        value_(options.value_size, 'x'),
+        measure_from_(),
+        stop_at_(),
+        interval_(),
+        histogram_(),
+        errors_(0) {
+    if (options.zipf) {
+      zipf_.emplace(options.keyspace, options.zipf_theta);
+    }
+  }
+
+ private:
+  /// build the next request
+  /// \param out output buffer
+  void nextRequest(std::string& out) {
+    const auto index = zipf_ ? (*zipf_)(random_) : uniform_(random_);
+    char key[32];
+    std::snprintf(key, sizeof(key), "key:%012llu", static_cast<unsigned long long>(index));
+    if (read_(random_)) {
+      EncodeCommand(out, {"GET", key});
+    } else {
+      EncodeCommand(out, {"SET", key, value_});
+    }
+  }
+
+  /// send requests as long as the pipeline is not full
+  /// \param c connection
+  void fill(Connection& c) {
+    const auto now = Clock::now();
+    if (interval_ == Clock::duration::zero()) {
+      // closed loop: keep the pipeline full
+      while (now < stop_at_ && c.in_flight.size() < options_.pipeline) {
+        nextRequest(c.pending);
+        c.in_flight.emplace_back(now);
+      }
+    } else {
+      // open loop: requests are sent on schedule. if the pipeline is full, the requests wait in the backlog
+      // but their latency is measured from the intended send time (coordinated omission correction).
+      while (c.next_send <= now && c.next_send < stop_at_) {
+        c.backlog.emplace_back(c.next_send);
+        c.next_send += interval_;
+      }
+      while (!c.backlog.empty() && c.in_flight.size() < options_.pipeline) {
+        nextRequest(c.pending);
+        c.in_flight.emplace_back(c.backlog.front());
+        c.backlog.pop_front();
+      }
+    }
+    flush(c);
+  }
+
+  /// write pending requests
+  /// \param c connection
+  void flush(Connection& c) {
+    if (!c.writing.empty() || c.pending.empty()) {
+      return;
+    }
+    std::swap(c.writing, c.pending);
+    boost::asio::async_write(c.socket, boost::asio::buffer(c.writing),
+                             [this, &c](const boost::system::error_code& ec, std::size_t) {
+                               if (ec) {
+                                 std::cerr << "write error: " << ec.message() << std::endl;
+                                 return;
+                               }
+                               c.writing.clear();
+                               flush(c);
+                             });
+  }
+
+  /// schedule the next open loop send
+  /// \param c connection
+  void schedule(Connection& c) {
+    if (c.next_send >= stop_at_) {
+      return;
+    }
+    c.timer.expires_at(c.next_send);
+    c.timer.async_wait([this, &c](const boost::system::error_code& ec) {
+      if (ec) {
+        return;
+      }
+      fill(c);
+      schedule(c);
+    });
+  }
+
+  /// read replies
+  /// \param c connection
+  void read(Connection& c) {
+    if (c.buffered == c.buffer.size()) {
+      c.buffer.resize(c.buffer.size() * 2);
+    }
+    c.socket.async_read_some(
+        boost::asio::buffer(c.buffer.data() + c.buffered, c.buffer.size() - c.buffered),
+        [this, &c](const boost::system::error_code& ec, std::size_t length) {
+          if (ec) {
+            if (!c.in_flight.empty()) {
+              std::cerr << "read error: " << ec.message() << std::endl;
+            }
+            return;
+          }
+          c.buffered += length;
+
+          std::size_t offset = 0;
+          while (auto reply = ReplyLength(c.buffer.data() + offset, c.buffered - offset)) {
+            const auto now = Clock::now();
+            const auto intended = c.in_flight.front();
+            c.in_flight.pop_front();
+            if (c.buffer[offset] == '-') {
+              errors_++;
+            }
+            if (intended >= measure_from_) {
+              histogram_.record(static_cast<std::uint64_t>(
+                  std::chrono::duration_cast<std::chrono::nanoseconds>(now - intended).count()));
+            }
+            offset += reply.value();
+          }
+          std::copy(c.buffer.data() + offset, c.buffer.data() + c.buffered, c.buffer.data());
+          c.buffered -= offset;
+
+          fill(c);
+          if (Clock::now() < stop_at_ || !c.in_flight.empty() || !c.backlog.empty()) {
+            read(c);
+          } else {
+            c.timer.cancel();
+            c.socket.close();
+          }
+        });
+  }
+
+ public:
+  /// populate all keys
+  void populate() {
+    boost::asio::generic::stream_protocol::socket socket(ioc_);
+    boost::asio::connect(socket, ResolveEndpoints(ioc_, options_));
+
+    std::string out;
+    std::vector<char> buffer(64 * 1024);
+    constexpr std::uint64_t kBatch = 1024;
+    for (std::uint64_t first = 0; first < options_.keyspace; first += kBatch) {
+      const auto last = std::min(first + kBatch, options_.keyspace);
+      out.clear();
+      for (auto i = first; i < last; ++i) {
+        char key[32];
+        std::snprintf(key, sizeof(key), "key:%012llu", static_cast<unsigned long long>(i));
+        EncodeCommand(out, {"SET", key, value_});
+      }
+      boost::asio::write(socket, boost::asio::buffer(out));
+
+      std::size_t replies = 0;
+      std::size_t buffered = 0;
+      while (replies < last - first) {
+        buffered += socket.read_some(boost::asio::buffer(buffer.data() + buffered, buffer.size() - buffered));
+        std::size_t offset = 0;
+        while (auto reply = ReplyLength(buffer.data() + offset, buffered - offset)) {
+          offset += reply.value();
+          replies++;
+        }
+        std::copy(buffer.data() + offset, buffer.data() + buffered, buffer.data());
+        buffered -= offset;
+      }
+    }
+  }
+
+  /// run load
+  /// \param start start time
+  void run(Clock::time_point start) {
+    measure_from_ = start + std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(options_.warmup));
+    stop_at_ = measure_from_ +
+               std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(options_.duration));
+    if (options_.rate > 0) {
+      const auto per_connection = options_.rate / static_cast<double>(options_.threads * options_.connections);
+      interval_ = std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(1.0 / per_connection));
+    }
+
+    const auto endpoints = ResolveEndpoints(ioc_, options_);
+    for (std::size_t i = 0; i < options_.connections; ++i) {
+      auto c = std::make_unique<Connection>(ioc_);
+      boost::asio::connect(c->socket, endpoints);
+      if (options_.unixsocket.empty()) {
+        c->socket.set_option(boost::asio::ip::tcp::no_delay(true));
+      }
+      // spread the first send of each connection over one interval
+      c->next_send = start + interval_ * static_cast<long>(i) / static_cast<long>(options_.connections);
+      connections_.emplace_back(std::move(c));
+    }
+
+    // connections that have nothing in flight at the end are closed here, others are closed when drained
+    stop_timer_.expires_at(stop_at_);
+    stop_timer_.async_wait([this](const boost::system::error_code&) {
+      for (auto& c : connections_) {
+        if (c->in_flight.empty() && c->backlog.empty()) {
+          c->timer.cancel();
+          c->socket.close();
+        }
+      }
+    });
+
+    for (auto& c : connections_) {
+      read(*c);
+      if (interval_ == Clock::duration::zero()) {
+        fill(*c);
+      } else {
+        schedule(*c);
+      }
+    }
+    ioc_.run();
+  }
+
+ public:
+  [[nodiscard]] const eidos::histogram::Histogram& histogram() const { return histogram_; }
+  [[nodiscard]] std::uint64_t errors() const { return errors_; }
+};
+
+/// output report
+/// \param os output stream
+/// \param histogram latency histogram (ns)
+/// \param errors number of error replies
+/// \param elapsed measured duration (s)
+void StreamReport(std::ostream& os, const eidos::histogram::Histogram& histogram, std::uint64_t errors,
+                  double elapsed) {
+  const auto us = [](std::uint64_t ns) { return static_cast<double>(ns) / 1000.0; };
+  os << std::fixed << std::setprecision(2)                                                     //
+     << "requests   : " << histogram.count() << "\n"                                           //
+     << "errors     : " << errors << "\n"                                                      //
+     << "throughput : " << static_cast<double>(histogram.count()) / elapsed << " req/s\n"      //
+     << "latency (us, coordinated omission corrected in open loop)\n"                          //
+     << "  mean     : " << histogram.mean() / 1000.0 << "\n"                                   //
+     << "  p50      : " << us(histogram.percentile(50)) << "\n"                                //
+     << "  p90      : " << us(histogram.percentile(90)) << "\n"                                //
+     << "  p99      : " << us(histogram.percentile(99)) << "\n"                                //
+     << "  p99.9    : " << us(histogram.percentile(99.9)) << "\n"                              //
+     << "  p99.99   : " << us(histogram.percentile(99.99)) << "\n"                             //
+     << "  max      : " << us(histogram.max()) << std::endl;
+}
+
+}  // namespace
+
+int main(const int argc, const char* const* const argv) {
+  using boost::program_options::value;
+  boost::program_options::options_description description("eidos-bench");
+  description.add_options()                                                                          // options
+      ("help,h", "show help")                                                                        // help
+      ("host,s", value<std::string>()->default_value("127.0.0.1"), "server host")                    // host
+      ("port,p", value<std::uint16_t>()->default_value(6379), "server port")                         // port
+      ("unixsocket", value<std::string>()->default_value(""), "server Unix domain socket path")      // Unix socket
+      ("threads,t", value<std::size_t>()->default_value(1), "number of threads")                     // threads
+      ("connections,c", value<std::size_t>()->default_value(10), "connections per thread")           // connections
+      ("pipeline,P", value<std::size_t>()->default_value(1), "max requests in flight per connection")  // pipeline
+      ("keyspace,k", value<std::uint64_t>()->default_value(100000), "number of keys")                // keyspace
+      ("value-size,d", value<std::size_t>()->default_value(64), "value size (bytes)")                // value size
+      ("distribution", value<std::string>()->default_value("uniform"), "key distribution (uniform, zipf)")  //
+      ("zipf-theta", value<double>()->default_value(0.99), "Zipfian distribution parameter")         // zipf
+      ("read-ratio,r", value<double>()->default_value(0.9), "ratio of GET (0.0 - 1.0)")             // ratio
+      ("rate,R", value<double>()->default_value(0), "total requests per second (0: closed loop)")   // rate
+      ("duration,D", value<double>()->default_value(10), "measured duration (s)")                   // duration
+      ("warmup,W", value<double>()->default_value(1), "warmup duration (s)")                         // warmup
+      ("populate", "set all keys before the benchmark")                                              // populate
+      ;
+  boost::program_options::variables_map vm;
+  boost::program_options::store(boost::program_options::parse_command_line(argc, argv, description), vm);
+  boost::program_options::notify(vm);
+
+  if (vm.count("help")) {
+    std::cout << description << std::endl;
+    return EXIT_SUCCESS;
+  }
+
+  Options options{
+      vm["host"].as<std::string>(),      vm["port"].as<std::uint16_t>(),     vm["threads"].as<std::size_t>(),
+      vm["connections"].as<std::size_t>(), vm["pipeline"].as<std::size_t>(), vm["keyspace"].as<std::uint64_t>(),
+      vm["value-size"].as<std::size_t>(), vm["distribution"].as<std::string>() == "zipf",
+      vm["zipf-theta"].as<double>(),     vm["read-ratio"].as<double>(),      vm["rate"].as<double>(),
+      vm["duration"].as<double>(),       vm["warmup"].as<double>(),          vm.count("populate") != 0,
+      vm["unixsocket"].as<std::string>(),
+  };
+  if (options.threads == 0 || options.connections == 0 || options.pipeline == 0 || options.keyspace == 0) {
+    std::cerr << "threads, connections, pipeline and keyspace must be > 0" << std::endl;
+    return EXIT_FAILURE;
+  }
+
+  std::vector<std::unique_ptr<Worker>> workers;
+  std::random_device seed;
+  for (std::size_t i = 0; i < options.threads; ++i) {
+    workers.emplace_back(std::make_unique<Worker>(options, (static_cast<std::uint64_t>(seed()) << 32U) | seed()));
+  }
+  if (options.populate) {
+    std::cout << "populating " << options.keyspace << " keys" << std::endl;
+    workers.front()->populate();
+  }
+
+  const auto start = Clock::now();
+  std::vector<std::thread> threads;
+  for (auto& worker : workers) {
+    threads.emplace_back([&worker, start] { worker->run(start); });
+  }
+  for (auto& thread : threads) {
+    thread.join();
+  }
+
+  eidos::histogram::Histogram histogram;
+  std::uint64_t errors = 0;
+  for (const auto& worker : workers) {
+    histogram.merge(worker->histogram());
+    errors += worker->errors();
+  }
+  StreamReport(std::cout, histogram, errors, options.duration);
+  return EXIT_SUCCESS;
+}
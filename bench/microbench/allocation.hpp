@@ -0,0 +1,67 @@
+// Copyright 2021 SiLeader and Cerussite.
+//
+// Licensed under the Apache License, Version 2.0 (the “License”);
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an “AS IS” BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#pragma once
+
+#include <benchmark/benchmark.h>
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace eidos::bench {
+
+/// number of heap allocations (operator new) since process start
+/// \return number of allocations
+std::uint64_t AllocationCount();
+
+/// heap allocation counter of benchmark loop
+class AllocationCounter {
+ private:
+  std::uint64_t start_;
+
+ public:
+  AllocationCounter() : start_(AllocationCount()) {}
+
+ public:
+  /// report allocations per iteration as `allocs/op` counter
+  /// \param state benchmark state
+  void report(benchmark::State& state) const {
+    state.counters["allocs/op"] = benchmark::Counter(static_cast<double>(AllocationCount() - start_),
+                                                     benchmark::Counter::kAvgIterations);
+  }
+};
+
+/// create a string of [size] bytes that is unique for [index]
+/// \param index index
+/// \param size string size
+/// \return string
+inline std::string MakeString(std::int64_t index, std::int64_t size) {
+  auto s = std::to_string(index);
+  s.resize(static_cast<std::size_t>(size), '_');
+  return s;
+}
+
+/// convert string to bytes
+/// \param s string
+/// \return bytes
+inline std::vector<std::byte> ToBytes(const std::string& s) {
+  std::vector<std::byte> bytes(s.size());
+  std::transform(std::begin(s), std::end(s), std::begin(bytes), [](char c) { return static_cast<std::byte>(c); });
+  return bytes;
+}
+
+}  // namespace eidos::bench
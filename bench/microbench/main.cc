@@ -0,0 +1,151 @@
+// Copyright 2021 SiLeader and Cerussite.
+//
+// Licensed under the Apache License, Version 2.0 (the “License”);
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an “AS IS” BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <benchmark/benchmark.h>
+
+#include <atomic>
+#include <boost/log/core.hpp>
+#include <boost/log/expressions.hpp>
+#include <boost/log/trivial.hpp>
+#include <boost/property_tree/json_parser.hpp>
+#include <boost/property_tree/ptree.hpp>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <map>
+#include <new>
+#include <string>
+
+#include "allocation.hpp"
+
+namespace {
+
+std::atomic<std::uint64_t> allocation_count(0);
+
+/// console reporter that keeps the real time of each run for the baseline comparison
+class CollectingReporter : public benchmark::ConsoleReporter {
+ private:
+  std::map<std::string, double> real_times_;
+
+ public:
+  CollectingReporter() : benchmark::ConsoleReporter(), real_times_() {}
+
+ public:
+  void ReportRuns(const std::vector<Run>& reports) override {
+    for (const auto& run : reports) {
+      if (!run.error_occurred) {
+        real_times_[run.benchmark_name()] = run.GetAdjustedRealTime();
+      }
+    }
+    benchmark::ConsoleReporter::ReportRuns(reports);
+  }
+
+ public:
+  /// real time per iteration of each benchmark
+  /// \return benchmark name to real time
+  [[nodiscard]] const std::map<std::string, double>& realTimes() const { return real_times_; }
+};
+
+/// compare the results with the baseline written by `--benchmark_out=FILE --benchmark_out_format=json`
+/// \param baseline baseline json file path
+/// \param threshold allowed slow down ratio (0.1 means 10%)
+/// \param real_times current results
+/// \return true if no benchmark regressed
+bool CompareWithBaseline(const std::string& baseline, double threshold,
+                         const std::map<std::string, double>& real_times) {
+  boost::property_tree::ptree root;
+  try {
+    boost::property_tree::read_json(baseline, root);
+  } catch (const boost::property_tree::json_parser_error& e) {
+    std::cerr << "cannot read baseline: " << e.what() << std::endl;
+    return false;
+  }
+
+  bool ok = true;
+  std::cout << std::endl << "comparison with baseline " << baseline << std::endl;
+  for (const auto& [_, bench] : root.get_child("benchmarks")) {
+    const auto name = bench.get<std::string>("name");
+    const auto itr = real_times.find(name);
+    if (itr == std::end(real_times)) {
+      continue;
+    }
+    const auto base = bench.get<double>("real_time");
+    const auto change = base > 0 ? (itr->second - base) / base : 0.0;
+    const auto regressed = change > threshold;
+    ok = ok && !regressed;
+    std::cout << std::left << std::setw(72) << name << std::right << std::showpos << std::fixed
+              << std::setprecision(1) << std::setw(8) << change * 100 << "%" << std::noshowpos
+              << (regressed ? "  REGRESSION" : "") << std::endl;
+  }
+  return ok;
+}
+
+}  // namespace
+
+namespace eidos::bench {
+
+std::uint64_t AllocationCount() { return allocation_count.load(std::memory_order_relaxed); }
+
+}  // namespace eidos::bench
+
+void* operator new(std::size_t size) {
+  allocation_count.fetch_add(1, std::memory_order_relaxed);
+  if (auto p = std::malloc(size == 0 ? 1 : size)) {
+    return p;
+  }
+  throw std::bad_alloc();
+}
+
+void* operator new[](std::size_t size) { return operator new(size); }
+
+void operator delete(void* p) noexcept { std::free(p); }
+
+void operator delete[](void* p) noexcept { std::free(p); }
+
+void operator delete(void* p, std::size_t) noexcept { std::free(p); }
+
+void operator delete[](void* p, std::size_t) noexcept { std::free(p); }
+
+int main(int argc, char** argv) {
+  // eidos specific flags. removed before passing to google benchmark
+  std::string baseline;
+  double threshold = 0.1;
+  int count = 1;
+  for (int i = 1; i < argc; ++i) {
+    const std::string arg = argv[i];
+    if (arg.rfind("--eidos_baseline=", 0) == 0) {
+      baseline = arg.substr(std::string("--eidos_baseline=").size());
+    } else if (arg.rfind("--eidos_threshold=", 0) == 0) {
+      threshold = std::stod(arg.substr(std::string("--eidos_threshold=").size()));
+    } else {
+      argv[count++] = argv[i];
+    }
+  }
+  argc = count;
+
+  boost::log::core::get()->set_filter(boost::log::trivial::severity >= boost::log::trivial::warning);
+
+  benchmark::Initialize(&argc, argv);
+  if (benchmark::ReportUnrecognizedArguments(argc, argv)) {
+    return 1;
+  }
+
+  CollectingReporter reporter;
+  benchmark::RunSpecifiedBenchmarks(&reporter);
+
+  if (!baseline.empty() && !CompareWithBaseline(baseline, threshold, reporter.realTimes())) {
+    return 1;
+  }
+  return 0;
+}
@@ -0,0 +1,161 @@
+// Copyright 2021 SiLeader and Cerussite.
+//
+// Licensed under the Apache License, Version 2.0 (the “License”);
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an “AS IS” BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <benchmark/benchmark.h>
+
+#include <algorithm>
+#include <cstring>
+#include <eidos/types.hpp>
+#include <string>
+#include <vector>
+
+#include "allocation.hpp"
+#include "commands.hpp"
+#include "context.hpp"
+
+namespace {
+
+using eidos::bench::AllocationCounter;
+using eidos::bench::MakeString;
+using eidos::bench::ToBytes;
+
+/// encode command as RESP array of bulk strings
+std::string EncodeCommand(const std::vector<std::string>& args) {
+  std::string s = "*" + std::to_string(args.size()) + "\r\n";
+  for (const auto& arg : args) {
+    s += "$" + std::to_string(arg.size()) + "\r\n" + arg + "\r\n";
+  }
+  return s;
+}
+
+/// arguments: pipeline size, value size
+void PipelineArguments(benchmark::internal::Benchmark* b) {
+  b->ArgNames({"pipeline", "value"});
+  for (const std::int64_t pipeline : {1, 16, 64}) {
+    for (const std::int64_t value : {16, 512}) {
+      b->Args({pipeline, value});
+    }
+  }
+}
+
+void BM_RequestContext_Parse(benchmark::State& state) {
+  const auto pipeline = state.range(0);
+  eidos::RequestContext context;
+  std::vector<std::vector<std::byte>> params;
+
+  std::string payload;
+  for (std::int64_t i = 0; i < pipeline; ++i) {
+    payload += EncodeCommand({"SET", MakeString(i, 16), MakeString(i, state.range(1))});
+  }
+
+  const AllocationCounter counter;
+  for (auto _ : state) {
+    // same as a session: receive bytes into the read area and parse all complete requests
+    std::size_t offset = 0;
+    while (offset < payload.size()) {
+      const auto [data, size] = context.prepare();
+      const auto length = std::min(size, payload.size() - offset);
+      std::memcpy(data, payload.data() + offset, length);
+      context.commit(length);
+      offset += length;
+      while (context.parse(params) == eidos::RequestContext::Status::kComplete) {
+        benchmark::DoNotOptimize(params.data());
+      }
+    }
+  }
+  counter.report(state);
+  state.SetItemsProcessed(state.iterations() * pipeline);
+  state.SetBytesProcessed(state.iterations() * static_cast<std::int64_t>(payload.size()));
+}
+BENCHMARK(BM_RequestContext_Parse)->Apply(PipelineArguments);
+
+void BM_ResponseContext_OkValue(benchmark::State& state) {
+  const auto pipeline = state.range(0);
+  eidos::ResponseContext response;
+
+  const auto value = ToBytes(MakeString(0, state.range(1)));
+  const AllocationCounter counter;
+  for (auto _ : state) {
+    for (std::int64_t i = 0; i < pipeline; ++i) {
+      response.begin();
+      response.ok(value);
+    }
+    benchmark::DoNotOptimize(response.buffer().data());
+    response.clear();
+  }
+  counter.report(state);
+  state.SetItemsProcessed(state.iterations() * pipeline);
+}
+BENCHMARK(BM_ResponseContext_OkValue)->Apply(PipelineArguments);
+
+void BM_ResponseContext_OkArray(benchmark::State& state) {
+  const auto elements = state.range(0);
+  eidos::ResponseContext response;
+
+  std::vector<std::vector<std::byte>> values;
+  for (std::int64_t i = 0; i < elements; ++i) {
+    values.emplace_back(ToBytes(MakeString(i, state.range(1))));
+  }
+
+  const AllocationCounter counter;
+  for (auto _ : state) {
+    response.begin();
+    response.ok(values);
+    benchmark::DoNotOptimize(response.buffer().data());
+    response.clear();
+  }
+  counter.report(state);
+  state.SetItemsProcessed(state.iterations() * elements);
+}
+BENCHMARK(BM_ResponseContext_OkArray)->ArgNames({"elements", "value"})->ArgsProduct({{1, 16, 64}, {16, 512}});
+
+/// command names of a request mix (lower case as sent by most clients, last one is unknown)
+const std::vector<std::vector<std::byte>>& CommandNames() {
+  static const std::vector<std::vector<std::byte>> names = {
+      ToBytes("get"), ToBytes("set"), ToBytes("client"), ToBytes("memory"), ToBytes("unknown"),
+  };
+  return names;
+}
+
+void BM_Command_UpperCaseCompare(benchmark::State& state) {
+  // previous dispatch: upper case copy of the name and a chain of string comparisons
+  std::string cmd;
+  const AllocationCounter counter;
+  for (auto _ : state) {
+    for (const auto& name : CommandNames()) {
+      cmd.assign(reinterpret_cast<const char*>(name.data()), name.size());
+      eidos::commands::ToUpper(cmd);
+      const auto itr = std::find_if(std::begin(eidos::commands::kTable), std::end(eidos::commands::kTable),
+                                    [&cmd](const eidos::commands::Spec& spec) { return spec.name == cmd; });
+      benchmark::DoNotOptimize(itr);
+    }
+  }
+  counter.report(state);
+  state.SetItemsProcessed(state.iterations() * static_cast<std::int64_t>(CommandNames().size()));
+}
+BENCHMARK(BM_Command_UpperCaseCompare);
+
+void BM_Command_Lookup(benchmark::State& state) {
+  const AllocationCounter counter;
+  for (auto _ : state) {
+    for (const auto& name : CommandNames()) {
+      benchmark::DoNotOptimize(eidos::commands::Lookup(name));
+    }
+  }
+  counter.report(state);
+  state.SetItemsProcessed(state.iterations() * static_cast<std::int64_t>(CommandNames().size()));
+}
+BENCHMARK(BM_Command_Lookup);
+
+}  // namespace
@@ -0,0 +1,68 @@
+// Copyright 2021 SiLeader and Cerussite.
+//
+// Licensed under the Apache License, Version 2.0 (the “License”);
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an “AS IS” BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <benchmark/benchmark.h>
+
+#include <eidos/types.hpp>
+#include <filesystem>
+#include <vector>
+
+#include "allocation.hpp"
+#include "storage/memstore.hpp"
+#include "storage/raft.hpp"
+
+namespace {
+
+using eidos::bench::AllocationCounter;
+using eidos::bench::MakeString;
+using eidos::bench::ToBytes;
+
+/// number of distinct log entries committed in benchmark loops
+constexpr std::size_t kEntries = 4096;
+
+/// arguments: key size, value size
+void CommitArguments(benchmark::internal::Benchmark* b) {
+  b->ArgNames({"key", "value"});
+  for (const std::int64_t key : {16, 128}) {
+    for (const std::int64_t value : {64, 4096}) {
+      b->Args({key, value});
+    }
+  }
+}
+
+void BM_StateMachine_CommitSet(benchmark::State& state) {
+  const auto snapshot_dir = std::filesystem::temp_directory_path() / "eidos-microbench-raft";
+  eidos::storage::detail::StateMachine sm(std::make_shared<eidos::storage::MemoryStorageEngine<>>(), snapshot_dir, 0);
+
+  std::vector<nuraft::ptr<nuraft::buffer>> entries;
+  for (std::size_t i = 0; i < kEntries; ++i) {
+    const auto key = MakeString(static_cast<std::int64_t>(i), state.range(0));
+    entries.emplace_back(eidos::storage::detail::EncodeSet(eidos::Key(ToBytes(key), std::hash<std::string>{}(key)),
+                                                           eidos::Value(ToBytes(MakeString(0, state.range(1))))));
+  }
+
+  nuraft::ulong idx = 0;
+  const AllocationCounter counter;
+  for (auto _ : state) {
+    ++idx;
+    auto result = sm.commit(idx, *entries[idx % kEntries]);
+    benchmark::DoNotOptimize(result);
+  }
+  counter.report(state);
+  state.SetItemsProcessed(state.iterations());
+  std::filesystem::remove_all(snapshot_dir);
+}
+BENCHMARK(BM_StateMachine_CommitSet)->Apply(CommitArguments);
+
+}  // namespace
@@ -0,0 +1,142 @@
+// Copyright 2021 SiLeader and Cerussite.
+//
+// Licensed under the Apache License, Version 2.0 (the “License”);
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an “AS IS” BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <benchmark/benchmark.h>
+
+#include <algorithm>
+#include <eidos/types.hpp>
+#include <iostream>
+#include <vector>
+
+#include "allocation.hpp"
+#include "storage/memstore.hpp"
+
+namespace {
+
+using eidos::bench::AllocationCounter;
+using eidos::bench::MakeString;
+using eidos::bench::ToBytes;
+
+/// number of distinct keys looked up in benchmark loops
+constexpr std::size_t kLookupKeys = 4096;
+
+eidos::Key MakeKey(std::int64_t index, std::int64_t size) {
+  const auto s = MakeString(index, size);
+  return eidos::Key(ToBytes(s), std::hash<std::string>{}(s));
+}
+
+/// fill the engine with [count] keys
+void Populate(eidos::storage::StorageEngineBase& engine, std::int64_t count, std::int64_t key_size,
+              std::int64_t value_size) {
+  const eidos::Value value(std::vector<std::byte>(static_cast<std::size_t>(value_size)));
+  for (std::int64_t i = 0; i < count; ++i) {
+    engine.set(MakeKey(i, key_size), value);
+  }
+}
+
+/// arguments: key size, value size, stored keys (load factor against 2048 buckets), hit ratio (%)
+void EngineArguments(benchmark::internal::Benchmark* b) {
+  b->ArgNames({"key", "value", "keys", "hit%"});
+  for (const std::int64_t key : {16, 128}) {
+    for (const std::int64_t value : {64, 4096}) {
+      for (const std::int64_t keys : {1024, 16384, 262144}) {
+        for (const std::int64_t hit : {0, 50, 100}) {
+          b->Args({key, value, keys, hit});
+        }
+      }
+    }
+  }
+}
+
+void BM_MemoryStorageEngine_Get(benchmark::State& state) {
+  const auto key_size = state.range(0);
+  const auto keys = state.range(2);
+  const auto hit = state.range(3);
+
+  eidos::storage::MemoryStorageEngine<> engine;
+  Populate(engine, keys, key_size, state.range(1));
+
+  std::vector<eidos::Key> lookup;
+  for (std::size_t i = 0; i < kLookupKeys; ++i) {
+    const auto is_hit = static_cast<std::int64_t>(i % 100) < hit;
+    const auto index = static_cast<std::int64_t>(i) % keys;
+    lookup.emplace_back(MakeKey(is_hit ? index : keys + index, key_size));
+  }
+
+  std::size_t i = 0;
+  const AllocationCounter counter;
+  for (auto _ : state) {
+    auto result = engine.get(lookup[i++ % kLookupKeys]);
+    benchmark::DoNotOptimize(result);
+  }
+  counter.report(state);
+  state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_MemoryStorageEngine_Get)->Apply(EngineArguments);
+
+void BM_MemoryStorageEngine_Set(benchmark::State& state) {
+  const auto key_size = state.range(0);
+  const auto keys = state.range(2);
+  const auto hit = state.range(3);
+
+  eidos::storage::MemoryStorageEngine<> engine;
+  Populate(engine, keys, key_size, state.range(1));
+
+  // hit: overwrite stored key, miss: insert new key (removed again to keep the load factor)
+  std::vector<eidos::Key> lookup;
+  for (std::size_t i = 0; i < kLookupKeys; ++i) {
+    const auto is_hit = static_cast<std::int64_t>(i % 100) < hit;
+    const auto index = static_cast<std::int64_t>(i) % keys;
+    lookup.emplace_back(MakeKey(is_hit ? index : keys + index, key_size));
+  }
+  const eidos::Value value(std::vector<std::byte>(static_cast<std::size_t>(state.range(1))));
+
+  std::size_t i = 0;
+  const AllocationCounter counter;
+  for (auto _ : state) {
+    auto result = engine.set(lookup[i++ % kLookupKeys], value);
+    benchmark::DoNotOptimize(result);
+  }
+  counter.report(state);
+  state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_MemoryStorageEngine_Set)->Apply(EngineArguments);
+
+void BM_MemoryStorageEngine_Exists(benchmark::State& state) {
+  const auto key_size = state.range(0);
+  const auto keys = state.range(2);
+  const auto hit = state.range(3);
+
+  eidos::storage::MemoryStorageEngine<> engine;
+  Populate(engine, keys, key_size, state.range(1));
+
+  std::vector<eidos::Key> lookup;
+  for (std::size_t i = 0; i < kLookupKeys; ++i) {
+    const auto is_hit = static_cast<std::int64_t>(i % 100) < hit;
+    const auto index = static_cast<std::int64_t>(i) % keys;
+    lookup.emplace_back(MakeKey(is_hit ? index : keys + index, key_size));
+  }
+
+  std::size_t i = 0;
+  const AllocationCounter counter;
+  for (auto _ : state) {
+    auto result = engine.exists(lookup[i++ % kLookupKeys]);
+    benchmark::DoNotOptimize(result);
+  }
+  counter.report(state);
+  state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_MemoryStorageEngine_Exists)->Apply(EngineArguments);
+
+}  // namespace
@@ -0,0 +1,450 @@
+// Copyright 2021 SiLeader and Cerussite.
+//
+// Licensed under the Apache License, Version 2.0 (the “License”);
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an “AS IS” BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// eidos-raft-bench: replication benchmark of a local Raft cluster running in one process
+
+#include <unistd.h>
+
+#include <boost/log/core.hpp>
+#include <boost/log/expressions.hpp>
+#include <boost/log/trivial.hpp>
+#include <boost/program_options.hpp>
+#include <chrono>
+#include <cstdint>
+#include <eidos/histogram.hpp>
+#include <eidos/types.hpp>
+#include <filesystem>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <optional>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "storage/memstore.hpp"
+#include "storage/raft.hpp"
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+/// benchmark options
+struct Options {
+  std::size_t nodes;
+  std::uint16_t base_port;
+  std::size_t threads;
+  std::uint64_t keyspace;
+  std::size_t value_size;
+  double read_ratio;
+  double duration;
+  std::uint64_t catch_up_entries;
+  bool failover;
+  bool catch_up;
+};
+
+/// timeout of waiting for cluster state changes
+constexpr auto kStateTimeout = std::chrono::seconds(30);
+
+/// local Raft cluster
+class Cluster {
+ private:
+  struct Node {
+    int id;
+    std::unique_ptr<eidos::storage::RaftStorageEngine> engine;
+  };
+
+ private:
+  std::size_t size_;
+  std::uint16_t base_port_;
+  eidos::storage::RaftOptions raft_;
+  std::filesystem::path dir_;
+  std::vector<Node> nodes_;
+  int next_id_;
+
+ public:
+  Cluster(std::size_t size, std::uint16_t base_port, const eidos::storage::RaftOptions& raft)
+      : size_(size),
+        base_port_(base_port),
+        raft_(raft),
+        dir_(std::filesystem::temp_directory_path() / ("eidos-raft-bench-" + std::to_string(::getpid()))),
+        nodes_(),
+        next_id_(1) {}
+
+  ~Cluster() {
+    nodes_.clear();
+    std::filesystem::remove_all(dir_);
+  }
+
+  Cluster(const Cluster&) = delete;
+  Cluster& operator=(const Cluster&) = delete;
+
+ private:
+  /// options of the node
+  /// \param id node id
+  /// \return node options
+  [[nodiscard]] eidos::storage::RaftOptions nodeOptions(int id) const {
+    auto options = raft_;
+    options.node_id = id;
+    options.port = static_cast<std::uint16_t>(base_port_ + id - 1);
+    options.peers.clear();
+    return options;
+  }
+
+  /// start a node
+  /// \param options node options
+  void start(const eidos::storage::RaftOptions& options) {
+    auto engine = std::make_unique<eidos::storage::RaftStorageEngine>(
+        std::make_shared<eidos::storage::MemoryStorageEngine<>>(), options,
+        dir_ / ("node-" + std::to_string(options.node_id)));
+    nodes_.push_back({options.node_id, std::move(engine)});
+    next_id_ = std::max(next_id_, options.node_id + 1);
+  }
+
+ public:
+  /// start the initial members
+  void start() {
+    for (std::size_t i = 0; i < size_; ++i) {
+      auto options = nodeOptions(static_cast<int>(i + 1));
+      for (std::size_t j = 0; j < size_; ++j) {
+        if (i != j) {
+          const auto peer = nodeOptions(static_cast<int>(j + 1));
+          options.peers.push_back({peer.node_id, peer.host, peer.port, peer.priority});
+        }
+      }
+      start(options);
+    }
+  }
+
+  /// start a node that is not a member of the cluster yet
+  /// \return node index
+  std::size_t startEmpty() {
+    start(nodeOptions(next_id_));
+    return nodes_.size() - 1;
+  }
+
+  /// stop the node
+  /// \param index node index
+  void stop(std::size_t index) { nodes_.erase(std::begin(nodes_) + static_cast<std::ptrdiff_t>(index)); }
+
+ public:
+  /// index of the leader agreed by all running nodes
+  /// \param members number of members expected in the configuration of the leader
+  /// \return node index
+  std::optional<std::size_t> leader(std::size_t members) {
+    const auto leader_id = nodes_.front().engine->status().leader;
+    std::optional<std::size_t> leader;
+    for (std::size_t i = 0; i < nodes_.size(); ++i) {
+      if (nodes_[i].engine->status().leader != leader_id) {
+        return std::nullopt;
+      }
+      if (nodes_[i].id == leader_id) {
+        leader = i;
+      }
+    }
+    if (!leader || nodes_[*leader].engine->servers().unwrap_or({}).size() != members) {
+      return std::nullopt;
+    }
+    return leader;
+  }
+
+  /// wait until all running nodes agree on the leader
+  /// \param members number of members expected in the configuration of the leader
+  /// \return node index
+  std::optional<std::size_t> waitLeader(std::size_t members) {
+    const auto deadline = Clock::now() + kStateTimeout;
+    while (Clock::now() < deadline) {
+      if (auto leader = this->leader(members)) {
+        return leader;
+      }
+      std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    return std::nullopt;
+  }
+
+ public:
+  /// node id
+  /// \param index node index
+  /// \return node id
+  [[nodiscard]] int id(std::size_t index) const { return nodes_[index].id; }
+
+  /// Raft endpoint of the node
+  /// \param index node index
+  /// \return endpoint
+  [[nodiscard]] std::string endpoint(std::size_t index) const {
+    const auto options = nodeOptions(nodes_[index].id);
+    return options.host + ":" + std::to_string(options.port);
+  }
+
+  /// node
+  /// \param index node index
+  /// \return node
+  eidos::storage::RaftStorageEngine& node(std::size_t index) { return *nodes_[index].engine; }
+
+  /// number of running nodes
+  /// \return number of running nodes
+  [[nodiscard]] std::size_t size() const { return nodes_.size(); }
+};
+
+/// create key
+/// \param index key index
+/// \return key
+eidos::Key MakeKey(std::uint64_t index) {
+  const auto s = "key:" + std::to_string(index);
+  std::vector<std::byte> bytes(s.size());
+  std::transform(std::begin(s), std::end(s), std::begin(bytes), [](char c) { return static_cast<std::byte>(c); });
+  return eidos::Key(bytes, std::hash<std::string>{}(s));
+}
+
+/// resident set size of this process
+/// \return resident set size (bytes)
+std::uint64_t ResidentSetSize() {
+  std::ifstream ifs("/proc/self/status");
+  std::string line;
+  while (std::getline(ifs, line)) {
+    if (line.rfind("VmRSS:", 0) == 0) {
+      return std::stoull(line.substr(6)) * 1024;
+    }
+  }
+  return 0;
+}
+
+/// per thread load result
+struct LoadResult {
+  eidos::histogram::Histogram writes;
+  eidos::histogram::Histogram reads;
+  std::uint64_t errors = 0;
+};
+
+/// drive writes to the leader and reads to all nodes
+/// \param cluster cluster
+/// \param leader leader index
+/// \param options benchmark options
+/// \return load results of each thread
+std::vector<std::unique_ptr<LoadResult>> Drive(Cluster& cluster, std::size_t leader, const Options& options) {
+  std::vector<std::unique_ptr<LoadResult>> results;
+  std::vector<std::thread> threads;
+  const auto deadline = Clock::now() + std::chrono::duration_cast<Clock::duration>(
+                                           std::chrono::duration<double>(options.duration));
+  for (std::size_t t = 0; t < options.threads; ++t) {
+    results.push_back(std::make_unique<LoadResult>());
+    threads.emplace_back([&, t, result = results.back().get()] {
+      std::mt19937_64 engine(t);
+      std::uniform_int_distribution<std::uint64_t> keys(0, options.keyspace - 1);
+      std::uniform_int_distribution<std::size_t> nodes(0, cluster.size() - 1);
+      std::bernoulli_distribution read(options.read_ratio);
+      const eidos::Value value(std::vector<std::byte>(options.value_size, std::byte{'x'}));
+
+      while (Clock::now() < deadline) {
+        const auto key = MakeKey(keys(engine));
+        const auto start = Clock::now();
+        if (read(engine)) {
+          cluster.node(nodes(engine)).get(key);
+          result->reads.record(static_cast<std::uint64_t>((Clock::now() - start).count()));
+        } else if (cluster.node(leader).set(key, value).is_ok()) {
+          result->writes.record(static_cast<std::uint64_t>((Clock::now() - start).count()));
+        } else {
+          result->errors++;
+        }
+      }
+    });
+  }
+  for (auto& thread : threads) {
+    thread.join();
+  }
+  return results;
+}
+
+/// write [count] entries through the leader
+/// \param node leader
+/// \param count number of entries
+/// \param value_size value size
+/// \return number of failed writes
+std::uint64_t Fill(eidos::storage::RaftStorageEngine& node, std::uint64_t count, std::size_t value_size) {
+  const eidos::Value value(std::vector<std::byte>(value_size, std::byte{'x'}));
+  std::uint64_t errors = 0;
+  for (std::uint64_t i = 0; i < count; ++i) {
+    if (node.set(MakeKey(i), value).is_err()) {
+      errors++;
+    }
+  }
+  return errors;
+}
+
+/// write latency histogram
+/// \param os output stream
+/// \param name name of histogram
+/// \param histogram histogram
+/// \param elapsed elapsed time (s)
+void StreamHistogram(std::ostream& os, const std::string& name, const eidos::histogram::Histogram& histogram,
+                     double elapsed) {
+  const auto us = [](std::uint64_t ns) { return static_cast<double>(ns) / 1000.0; };
+  os << std::fixed << std::setprecision(2)                                                 //
+     << name << "\n"                                                                       //
+     << "  count      : " << histogram.count() << "\n"                                     //
+     << "  throughput : " << static_cast<double>(histogram.count()) / elapsed << " op/s\n"  //
+     << "  mean (us)  : " << histogram.mean() / 1000.0 << "\n"                             //
+     << "  p50 (us)   : " << us(histogram.percentile(50)) << "\n"                          //
+     << "  p90 (us)   : " << us(histogram.percentile(90)) << "\n"                          //
+     << "  p99 (us)   : " << us(histogram.percentile(99)) << "\n"                          //
+     << "  p99.9 (us) : " << us(histogram.percentile(99.9)) << "\n"                        //
+     << "  max (us)   : " << us(histogram.max()) << std::endl;
+}
+
+/// seconds since [start]
+/// \param start start time
+/// \return elapsed time (s)
+double SecondsSince(Clock::time_point start) {
+  return std::chrono::duration<double>(Clock::now() - start).count();
+}
+
+}  // namespace
+
+int main(const int argc, const char* const* const argv) {
+  using boost::program_options::value;
+  boost::program_options::options_description description("eidos-raft-bench");
+  description.add_options()                                                                          // options
+      ("help,h", "show help")                                                                        // help
+      ("nodes,n", value<std::size_t>()->default_value(3), "number of Raft nodes")                    // nodes
+      ("base-port", value<std::uint16_t>()->default_value(17001), "Raft port of the first node")     // port
+      ("threads,t", value<std::size_t>()->default_value(4), "number of client threads")             // threads
+      ("keyspace,k", value<std::uint64_t>()->default_value(100000), "number of keys")                // keyspace
+      ("value-size,d", value<std::size_t>()->default_value(64), "value size (bytes)")                // value size
+      ("read-ratio,r", value<double>()->default_value(0.5), "ratio of reads (0.0 - 1.0)")           // ratio
+      ("duration,D", value<double>()->default_value(10), "load duration (s)")                        // duration
+      ("heartbeat-interval", value<int>()->default_value(125), "heartbeat interval (ms)")            // heartbeat
+      ("election-timeout-lower", value<int>()->default_value(250), "election timeout lower (ms)")    // election
+      ("election-timeout-upper", value<int>()->default_value(500), "election timeout upper (ms)")    // election
+      ("snapshot-distance", value<int>()->default_value(10000), "log entries between snapshots")     // snapshot
+      ("max-append-size", value<int>()->default_value(100), "max log entries per append")            // append
+      ("log-sync", value<std::string>()->default_value("commit"), "write completes at: commit, accept")  // sync
+      ("log-store", value<std::string>()->default_value("ring"), "Raft log store: ring, map")        // log store
+      ("catch-up-entries", value<std::uint64_t>()->default_value(20000), "entries written before catch-up")  //
+      ("no-failover", "skip leader failover measurement")                                            // failover
+      ("no-catch-up", "skip new member catch-up measurement")                                        // catch up
+      ;
+  boost::program_options::variables_map vm;
+  boost::program_options::store(boost::program_options::parse_command_line(argc, argv, description), vm);
+  boost::program_options::notify(vm);
+
+  if (vm.count("help")) {
+    std::cout << description << std::endl;
+    return EXIT_SUCCESS;
+  }
+
+  const Options options{
+      vm["nodes"].as<std::size_t>(),      vm["base-port"].as<std::uint16_t>(),
+      vm["threads"].as<std::size_t>(),    vm["keyspace"].as<std::uint64_t>(),
+      vm["value-size"].as<std::size_t>(), vm["read-ratio"].as<double>(),
+      vm["duration"].as<double>(),        vm["catch-up-entries"].as<std::uint64_t>(),
+      vm.count("no-failover") == 0,       vm.count("no-catch-up") == 0,
+  };
+  if (options.nodes == 0 || options.threads == 0 || options.keyspace == 0) {
+    std::cerr << "nodes, threads and keyspace must be > 0" << std::endl;
+    return EXIT_FAILURE;
+  }
+
+  eidos::storage::RaftOptions raft;
+  raft.heartbeat_interval = vm["heartbeat-interval"].as<int>();
+  raft.election_timeout_lower = vm["election-timeout-lower"].as<int>();
+  raft.election_timeout_upper = vm["election-timeout-upper"].as<int>();
+  raft.snapshot_distance = vm["snapshot-distance"].as<int>();
+  raft.max_append_size = vm["max-append-size"].as<int>();
+  raft.wait_for_commit = vm["log-sync"].as<std::string>() != "accept";
+  raft.log_store = vm["log-store"].as<std::string>() == "map" ? eidos::storage::RaftLogStore::kMap
+                                                              : eidos::storage::RaftLogStore::kRing;
+
+  boost::log::core::get()->set_filter(boost::log::trivial::severity >= boost::log::trivial::warning);
+
+  const auto rss_start = ResidentSetSize();
+  Cluster cluster(options.nodes, options.base_port, raft);
+
+  // election
+  auto start = Clock::now();
+  cluster.start();
+  auto leader = cluster.waitLeader(options.nodes);
+  if (!leader) {
+    std::cerr << "cluster did not elect a leader" << std::endl;
+    return EXIT_FAILURE;
+  }
+  std::cout << std::fixed << std::setprecision(3)                                    //
+            << "nodes          : " << options.nodes << "\n"                          //
+            << "cluster ready  : " << SecondsSince(start) << " s (leader: " << cluster.id(*leader) << ")"
+            << std::endl;
+
+  // load
+  const auto results = Drive(cluster, *leader, options);
+  eidos::histogram::Histogram writes;
+  eidos::histogram::Histogram reads;
+  std::uint64_t errors = 0;
+  for (const auto& result : results) {
+    writes.merge(result->writes);
+    reads.merge(result->reads);
+    errors += result->errors;
+  }
+  std::cout << "errors         : " << errors << std::endl;
+  StreamHistogram(std::cout, "commit latency", writes, options.duration);
+  StreamHistogram(std::cout, "read latency", reads, options.duration);
+  std::cout << "memory (RSS)   : " << static_cast<double>(ResidentSetSize() - rss_start) / (1024.0 * 1024.0)
+            << " MiB (" << options.nodes << " nodes)" << std::endl;
+
+  // leader failover: stop the leader and wait until a new leader commits a write
+  if (options.failover && options.nodes >= 3) {
+    const auto old = cluster.id(*leader);
+    start = Clock::now();
+    cluster.stop(*leader);
+    leader.reset();
+    const auto deadline = Clock::now() + kStateTimeout;
+    while (Clock::now() < deadline) {
+      const auto candidate = cluster.waitLeader(options.nodes);
+      if (candidate && cluster.id(*candidate) != old && Fill(cluster.node(*candidate), 1, options.value_size) == 0) {
+        leader = candidate;
+        break;
+      }
+    }
+    if (!leader) {
+      std::cerr << "no leader elected after failover" << std::endl;
+      return EXIT_FAILURE;
+    }
+    std::cout << "failover       : " << SecondsSince(start) << " s (leader: " << old << " -> " << cluster.id(*leader)
+              << ")" << std::endl;
+  }
+
+  // catch up: a new member receives the log (or a snapshot when the log was compacted)
+  if (options.catch_up) {
+    Fill(cluster.node(*leader), options.catch_up_entries, options.value_size);
+    const auto target = cluster.node(*leader).status().committed;
+    const auto members = cluster.node(*leader).servers().unwrap_or({}).size();
+
+    const auto index = cluster.startEmpty();
+    start = Clock::now();
+    if (cluster.node(*leader).addServer(cluster.id(index), cluster.endpoint(index)).is_err()) {
+      std::cerr << "cannot add new member" << std::endl;
+      return EXIT_FAILURE;
+    }
+    const auto deadline = Clock::now() + kStateTimeout;
+    while (Clock::now() < deadline && cluster.node(index).status().committed < target) {
+      std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    if (cluster.node(index).status().committed < target) {
+      std::cerr << "new member did not catch up" << std::endl;
+      return EXIT_FAILURE;
+    }
+    std::cout << "catch up       : " << SecondsSince(start) << " s (" << target << " entries, " << members + 1
+              << " members)" << std::endl;
+  }
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,181 @@
+// Copyright 2021 SiLeader and Cerussite.
+//
+// Licensed under the Apache License, Version 2.0 (the “License”);
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an “AS IS” BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+
+namespace eidos::histogram {
+
+/// HDR (high dynamic range) histogram.
+/// values are recorded into log-linear buckets, so the relative error is bounded by `2^-(kSubBucketBits - 1)`
+/// over the whole 64 bit range.
+/// recording is wait-free and intended to be done by a single thread, while other threads can read or merge.
+class Histogram {
+ public:
+  /// number of bits of the sub bucket (precision)
+  static constexpr unsigned kSubBucketBits = 8;
+
+ private:
+  static constexpr std::size_t kSubBucketCount = std::size_t{1} << kSubBucketBits;
+  static constexpr std::size_t kSubBucketHalf = kSubBucketCount / 2;
+  static constexpr std::size_t kBucketCount = (66 - kSubBucketBits) * kSubBucketHalf;
+
+ private:
+  std::unique_ptr<std::atomic<std::uint64_t>[]> counts_;
+  std::atomic<std::uint64_t> total_;
+  std::atomic<std::uint64_t> sum_;
+  std::atomic<std::uint64_t> max_;
+
+ public:
+  Histogram() : counts_(std::make_unique<std::atomic<std::uint64_t>[]>(kBucketCount)), total_(0), sum_(0), max_(0) {
+    reset();
+  }
+
+  Histogram(const Histogram&) = delete;
+  Histogram& operator=(const Histogram&) = delete;
+
+ public:
+  /// bucket index of the value
+  /// \param value value
+  /// \return bucket index
+  static constexpr std::size_t IndexOf(std::uint64_t value) {
+    if (value < kSubBucketCount) {
+      return static_cast<std::size_t>(value);
+    }
+    unsigned msb = 0;
+    for (auto v = value; v > 1; v >>= 1U) {
+      ++msb;
+    }
+    const auto exponent = msb - (kSubBucketBits - 1);
+    return exponent * kSubBucketHalf + static_cast<std::size_t>(value >> exponent);
+  }
+
+  /// lowest value of the bucket
+  /// \param index bucket index
+  /// \return lowest value
+  static constexpr std::uint64_t LowestOf(std::size_t index) {
+    if (index < kSubBucketCount) {
+      return index;
+    }
+    const auto exponent = index / kSubBucketHalf - 1;
+    return static_cast<std::uint64_t>(index - exponent * kSubBucketHalf) << exponent;
+  }
+
+  /// highest value of the bucket
+  /// \param index bucket index
+  /// \return highest value
+  static constexpr std::uint64_t HighestOf(std::size_t index) {
+    if (index + 1 >= kBucketCount) {
+      return UINT64_MAX;
+    }
+    return LowestOf(index + 1) - 1;
+  }
+
+ private:
+  /// add to counter (single writer)
+  static void add(std::atomic<std::uint64_t>& counter, std::uint64_t n) {
+    counter.store(counter.load(std::memory_order_relaxed) + n, std::memory_order_relaxed);
+  }
+
+ public:
+  /// record value
+  /// \param value value
+  /// \param count number of occurrences
+  void record(std::uint64_t value, std::uint64_t count = 1) {
+    add(counts_[IndexOf(value)], count);
+    add(total_, count);
+    add(sum_, value * count);
+    if (value > max_.load(std::memory_order_relaxed)) {
+      max_.store(value, std::memory_order_relaxed);
+    }
+  }
+
+  /// add all values of other histogram to this.
+  /// this histogram must not be recorded concurrently.
+  /// \param other histogram
+  void merge(const Histogram& other) {
+    for (std::size_t i = 0; i < kBucketCount; ++i) {
+      add(counts_[i], other.counts_[i].load(std::memory_order_relaxed));
+    }
+    add(total_, other.count());
+    add(sum_, other.sum_.load(std::memory_order_relaxed));
+    max_.store(std::max(max(), other.max()), std::memory_order_relaxed);
+  }
+
+  /// clear all values
+  void reset() {
+    for (std::size_t i = 0; i < kBucketCount; ++i) {
+      counts_[i].store(0, std::memory_order_relaxed);
+    }
+    total_.store(0, std::memory_order_relaxed);
+    sum_.store(0, std::memory_order_relaxed);
+    max_.store(0, std::memory_order_relaxed);
+  }
+
+ public:
+  /// number of recorded values
+  [[nodiscard]] std::uint64_t count() const { return total_.load(std::memory_order_relaxed); }
+
+  /// sum of recorded values
+  [[nodiscard]] std::uint64_t sum() const { return sum_.load(std::memory_order_relaxed); }
+
+  /// max recorded value
+  [[nodiscard]] std::uint64_t max() const { return max_.load(std::memory_order_relaxed); }
+
+  /// mean of recorded values
+  [[nodiscard]] double mean() const {
+    const auto n = count();
+    return n == 0 ? 0.0 : static_cast<double>(sum()) / static_cast<double>(n);
+  }
+
+  /// value at percentile
+  /// \param percentile percentile (0.0 - 100.0)
+  /// \return highest equivalent value of the bucket that contains the percentile
+  [[nodiscard]] std::uint64_t percentile(double percentile) const {
+    const auto n = count();
+    if (n == 0) {
+      return 0;
+    }
+    const auto target = std::max<std::uint64_t>(
+        1, static_cast<std::uint64_t>(static_cast<double>(n) * std::min(percentile, 100.0) / 100.0 + 0.5));
+    std::uint64_t seen = 0;
+    for (std::size_t i = 0; i < kBucketCount; ++i) {
+      seen += counts_[i].load(std::memory_order_relaxed);
+      if (seen >= target) {
+        return std::min(HighestOf(i), max());
+      }
+    }
+    return max();
+  }
+
+  /// call [f] for each non-empty bucket in ascending order
+  /// \tparam F callback type (`void f(std::uint64_t lowest, std::uint64_t highest, std::uint64_t count)`)
+  /// \param f callback
+  template <class F>
+  void forEach(F&& f) const {
+    for (std::size_t i = 0; i < kBucketCount; ++i) {
+      const auto c = counts_[i].load(std::memory_order_relaxed);
+      if (c != 0) {
+        f(LowestOf(i), HighestOf(i), c);
+      }
+    }
+  }
+};
+
+}  // namespace eidos::histogram
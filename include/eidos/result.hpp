@@ -14,10 +14,12 @@
 
 #pragma once
 
+#include <iostream>
 #include <optional>
 #include <sstream>
 #include <stdexcept>
 #include <string>
+#include <type_traits>
 #include <variant>
 
 namespace eidos::result {
@@ -184,6 +186,109 @@ class Result {
   }
 };
 
+/// partial specialization for trivially copyable success and error values (e.g. `Result<bool, ErrorCode>`).
+/// the values share storage without std::variant, so the result is as cheap to return as the values themselves.
+/// \tparam T success value
+/// \tparam E error value
+template <class T, class E>
+  requires(std::is_trivially_copyable_v<T> && std::is_trivially_copyable_v<E>)
+class Result<T, E> {
+ private:
+  union {
+    T data_;
+    E error_;
+  };
+  bool ok_;
+
+ private:
+  // constructors
+  struct OkTag {};
+  struct ErrTag {};
+
+  constexpr Result(OkTag, const T& d) : data_(d), ok_(true) {}
+  constexpr Result(ErrTag, const E& e) : error_(e), ok_(false) {}
+
+ public:
+  /// create error instance
+  /// \param error error value
+  /// \return Result instance (error)
+  static constexpr Result Err(E error) { return Result(ErrTag{}, error); }
+
+  /// create success instance
+  /// \param data success value
+  /// \return Result instance (ok)
+  static constexpr Result Ok(T data) { return Result(OkTag{}, data); }
+
+ public:
+  /// check operation result is ok
+  /// \return true: ok, false: error
+  [[nodiscard]] constexpr bool is_ok() const noexcept { return ok_; }
+
+  /// check operation result is error
+  /// \return true: error, false: ok
+  [[nodiscard]] constexpr bool is_err() const noexcept { return !ok_; }
+
+ public:
+  /// get success value
+  /// \return success value or no value
+  [[nodiscard]] constexpr std::optional<T> ok() const {
+    if (ok_) {
+      return data_;
+    }
+    return std::nullopt;
+  }
+
+  /// get error value
+  /// \return error value or no value
+  [[nodiscard]] constexpr std::optional<E> err() const {
+    if (!ok_) {
+      return error_;
+    }
+    return std::nullopt;
+  }
+
+ public:
+  /// get success value or default value
+  /// \param def default value
+  /// \return is_ok() == true: success value, is_ok() == false: default value
+  constexpr T unwrap_or(const T& def) const { return ok_ ? data_ : def; }
+
+  /// get success value or value that returned from [op]
+  /// \tparam F op function type (`T op(E)`)
+  /// \param op function
+  /// \return is_ok() == true: success value, is_ok() == false: op(error value)
+  template <class F>
+  T unwrap_or_else(F&& op) const {
+    if (ok_) {
+      return data_;
+    }
+    return op(error_);
+  }
+
+  /// get success value or throw [PanicError]
+  /// \param msg exception message
+  /// \return success value or throw [PanicError]
+  T expect(const std::string& msg) const {
+    using detail::ToString;
+
+    if (!ok_) {
+      throw PanicError(msg + ": " + ToString(error_));
+    }
+    return data_;
+  }
+
+  /// get success value or throw [PanicError]
+  /// \return success value or throw [PanicError]
+  T unwrap() const {
+    using detail::ToString;
+
+    if (!ok_) {
+      throw PanicError(ToString(error_));
+    }
+    return data_;
+  }
+};
+
 /// partial specialization for `success value type == void`
 /// \tparam E error type
 template <class E>
@@ -0,0 +1,166 @@
+// Copyright 2021 SiLeader and Cerussite.
+//
+// Licensed under the Apache License, Version 2.0 (the “License”);
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an “AS IS” BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <utility>
+#include <vector>
+
+namespace eidos::buffer {
+
+/// smallest size class (bytes)
+inline constexpr std::size_t kMinSize = 16 * 1024;
+
+/// number of size classes (16 KiB to 1 MiB). larger buffers are not pooled
+inline constexpr std::size_t kClasses = 7;
+
+/// max bytes kept in the free list of a size class
+inline constexpr std::size_t kMaxCachedBytes = 8 * 1024 * 1024;
+
+/// size class of a buffer
+/// \param size required size
+/// \return index of the smallest class that can hold [size] (kClasses if the size is not pooled)
+constexpr std::size_t SizeClass(std::size_t size) {
+  std::size_t index = 0;
+  for (auto capacity = kMinSize; capacity < size && index < kClasses; capacity *= 2) {
+    index++;
+  }
+  return index;
+}
+
+/// capacity of a size class
+/// \param index size class
+/// \return bytes
+constexpr std::size_t ClassSize(std::size_t index) { return kMinSize << index; }
+
+class Pool;
+
+/// buffer borrowed from [Pool]. given back to the pool when destroyed.
+class Buffer {
+ private:
+  Pool* pool_;
+  std::unique_ptr<char[]> data_;
+  std::size_t capacity_;
+
+ public:
+  Buffer() : pool_(nullptr), data_(), capacity_(0) {}
+  Buffer(Pool* pool, std::unique_ptr<char[]> data, std::size_t capacity)
+      : pool_(pool), data_(std::move(data)), capacity_(capacity) {}
+  ~Buffer() { reset(); }
+
+  Buffer(Buffer&& other) noexcept
+      : pool_(std::exchange(other.pool_, nullptr)),
+        data_(std::move(other.data_)),
+        capacity_(std::exchange(other.capacity_, 0)) {}
+  Buffer& operator=(Buffer&& other) noexcept {
+    if (this != &other) {
+      reset();
+      pool_ = std::exchange(other.pool_, nullptr);
+      data_ = std::move(other.data_);
+      capacity_ = std::exchange(other.capacity_, 0);
+    }
+    return *this;
+  }
+  Buffer(const Buffer&) = delete;
+  Buffer& operator=(const Buffer&) = delete;
+
+ public:
+  /// give the buffer back to the pool
+  inline void reset();
+
+  [[nodiscard]] char* data() { return data_.get(); }
+  [[nodiscard]] const char* data() const { return data_.get(); }
+  [[nodiscard]] std::size_t capacity() const { return capacity_; }
+  explicit operator bool() const { return static_cast<bool>(data_); }
+};
+
+/// size-classed buffer pool shared by all connections.
+/// buffers are borrowed only while a connection has bytes to read, so idle connections hold no memory.
+class Pool {
+ private:
+  std::mutex mutex_;
+  std::array<std::vector<std::unique_ptr<char[]>>, kClasses> free_;
+  std::atomic<std::size_t> used_;    // bytes borrowed
+  std::atomic<std::size_t> cached_;  // bytes in the free lists
+
+ public:
+  Pool() : mutex_(), free_(), used_(0), cached_(0) {}
+
+  /// pool shared by the server
+  /// \return pool
+  static Pool& Global() {
+    static Pool pool;
+    return pool;
+  }
+
+ public:
+  /// borrow a buffer
+  /// \param size required size
+  /// \return buffer of the smallest size class that can hold [size]
+  Buffer acquire(std::size_t size) {
+    const auto index = SizeClass(size);
+    const auto capacity = index < kClasses ? ClassSize(index) : size;
+    used_.fetch_add(capacity, std::memory_order_relaxed);
+    if (index < kClasses) {
+      const std::lock_guard lock(mutex_);
+      if (auto& list = free_[index]; !list.empty()) {
+        auto data = std::move(list.back());
+        list.pop_back();
+        cached_.fetch_sub(capacity, std::memory_order_relaxed);
+        return Buffer(this, std::move(data), capacity);
+      }
+    }
+    return Buffer(this, std::make_unique_for_overwrite<char[]>(capacity), capacity);
+  }
+
+  /// give a buffer back (called by [Buffer])
+  /// \param data buffer
+  /// \param capacity capacity of the buffer
+  void release(std::unique_ptr<char[]> data, std::size_t capacity) {
+    used_.fetch_sub(capacity, std::memory_order_relaxed);
+    const auto index = SizeClass(capacity);
+    if (index >= kClasses || ClassSize(index) != capacity) {
+      return;
+    }
+    const std::lock_guard lock(mutex_);
+    if (auto& list = free_[index]; (list.size() + 1) * capacity <= kMaxCachedBytes) {
+      list.emplace_back(std::move(data));
+      cached_.fetch_add(capacity, std::memory_order_relaxed);
+    }
+  }
+
+  /// bytes borrowed by connections
+  /// \return bytes
+  [[nodiscard]] std::size_t used() const { return used_.load(std::memory_order_relaxed); }
+
+  /// bytes kept for reuse
+  /// \return bytes
+  [[nodiscard]] std::size_t cached() const { return cached_.load(std::memory_order_relaxed); }
+};
+
+inline void Buffer::reset() {
+  if (data_) {
+    pool_->release(std::move(data_), capacity_);
+  }
+  pool_ = nullptr;
+  capacity_ = 0;
+}
+
+}  // namespace eidos::buffer
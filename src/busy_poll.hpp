@@ -0,0 +1,122 @@
+// Copyright 2021 SiLeader and Cerussite.
+//
+// Licensed under the Apache License, Version 2.0 (the “License”);
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an “AS IS” BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#pragma once
+
+#if defined(__linux__)
+#include <pthread.h>
+#include <sched.h>
+#include <sys/socket.h>
+#endif
+
+#include <boost/log/trivial.hpp>
+#include <cerrno>
+#include <charconv>
+#include <cstring>
+#include <eidos/result.hpp>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+#include "asio.hpp"
+#include "log.hpp"
+
+// low latency mode for dedicated cores.
+// the io thread polls the io_context without blocking in epoll_wait, so a request is picked up without the wake-up
+// latency of the scheduler. this costs one core at 100% even while the server is idle.
+namespace eidos::busy_poll {
+
+template <class T>
+using Result = eidos::result::Result<T, std::string>;
+
+/// parse a CPU list (e.g. "0-3,6")
+/// \param list CPU list
+/// \return CPU numbers or nullopt if malformed
+inline std::optional<std::vector<int>> ParseCpuList(std::string_view list) {
+  const auto parse = [](std::string_view text, int& value) {
+    const auto [ptr, ec] = std::from_chars(text.data(), text.data() + text.size(), value);
+    return !text.empty() && ec == std::errc() && ptr == text.data() + text.size() && value >= 0;
+  };
+  std::vector<int> cpus;
+  while (!list.empty()) {
+    const auto comma = list.find(',');
+    const auto range = list.substr(0, comma);
+    list = comma == std::string_view::npos ? std::string_view() : list.substr(comma + 1);
+
+    const auto dash = range.find('-');
+    int first = 0;
+    int last = 0;
+    if (!parse(range.substr(0, dash), first) ||
+        !parse(dash == std::string_view::npos ? range : range.substr(dash + 1), last) || last < first) {
+      return std::nullopt;
+    }
+    for (auto cpu = first; cpu <= last; ++cpu) {
+      cpus.push_back(cpu);
+    }
+  }
+  if (cpus.empty()) {
+    return std::nullopt;
+  }
+  return cpus;
+}
+
+/// pin the calling thread to the CPUs
+/// \param cpus CPU numbers
+/// \return error message if failed
+inline Result<void> PinCurrentThread(const std::vector<int>& cpus) {
+#if defined(__linux__)
+  cpu_set_t set;
+  CPU_ZERO(&set);
+  for (const auto cpu : cpus) {
+    if (cpu >= CPU_SETSIZE) {
+      return Result<void>::Err("CPU " + std::to_string(cpu) + " is out of range");
+    }
+    CPU_SET(cpu, &set);
+  }
+  if (const auto error = ::pthread_setaffinity_np(::pthread_self(), sizeof(set), &set); error != 0) {
+    return Result<void>::Err(std::string("pthread_setaffinity_np: ") + std::strerror(error));
+  }
+  return Result<void>::Ok();
+#else
+  return Result<void>::Err("CPU pinning is not supported on this platform");
+#endif
+}
+
+/// let the kernel busy poll the device queue on blocking reads of the socket (SO_BUSY_POLL).
+/// values above net.core.busy_read require CAP_NET_ADMIN.
+/// \param fd socket
+/// \param usec busy poll time (us)
+inline void SetSocketBusyPoll(int fd, int usec) {
+#if defined(__linux__) && defined(SO_BUSY_POLL)
+  if (::setsockopt(fd, SOL_SOCKET, SO_BUSY_POLL, &usec, sizeof(usec)) != 0) {
+    EIDOS_LOG_DEBUG << "failed to set SO_BUSY_POLL: " << std::strerror(errno);
+  }
+#endif
+}
+
+/// run the io_context by polling instead of blocking.
+/// the thread yields when nothing was ready, so it still makes progress if the core is shared.
+/// \param ioc io_context
+inline void Run(boost::asio::io_context& ioc) {
+  BOOST_LOG_TRIVIAL(info) << "busy poll mode: the io thread does not sleep";
+  while (!ioc.stopped()) {
+    if (ioc.poll() == 0) {
+      std::this_thread::yield();
+    }
+  }
+}
+
+}  // namespace eidos::busy_poll
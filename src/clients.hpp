@@ -0,0 +1,246 @@
+// Copyright 2021 SiLeader and Cerussite.
+//
+// Licensed under the Apache License, Version 2.0 (the “License”);
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an “AS IS” BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cctype>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <sstream>
+#include <string>
+#include <string_view>
+#include <utility>
+
+namespace eidos::clients {
+
+/// lower case copy
+/// \param str string
+/// \return lower case string
+inline std::string Lower(std::string str) {
+  std::transform(std::begin(str), std::end(str), std::begin(str),
+                 [](unsigned char c) { return static_cast<char>(std::tolower(c)); });
+  return str;
+}
+
+class Registry;
+
+/// connected client.
+/// owned by the session and registered to [Registry] while alive. fields are updated by the session and read by
+/// CLIENT LIST on the io_context thread.
+class Client {
+  friend class Registry;
+
+ public:
+  using Clock = std::chrono::steady_clock;
+
+ private:
+  Registry& registry_;
+  Client* prev_;
+  Client* next_;
+  std::uint64_t id_;
+  std::string addr_;
+  std::function<void()> on_kill_;
+  bool killed_;
+
+ public:
+  std::string name;
+  Clock::time_point created;
+  Clock::time_point last_interaction;
+  std::uint64_t commands = 0;
+  std::uint64_t net_input = 0;   // bytes
+  std::uint64_t net_output = 0;  // bytes
+  std::string last_command;
+  std::size_t query_buffer = 0;       // unparsed bytes
+  std::size_t query_buffer_free = 0;  // free bytes of the receive buffer
+  std::size_t output_memory = 0;      // capacity of the output buffer
+
+ public:
+  /// register the client
+  /// \param registry client registry
+  /// \param addr peer address (IP:PORT)
+  inline Client(Registry& registry, std::string addr);
+  inline ~Client();
+
+  Client(const Client&) = delete;
+  Client& operator=(const Client&) = delete;
+
+ public:
+  /// set handler called by [kill] (cancels pending operations of the connection)
+  /// \tparam F handler type
+  /// \param on_kill handler
+  template <class F>
+  void onKill(F&& on_kill) {
+    on_kill_ = std::forward<F>(on_kill);
+  }
+
+  /// close the connection
+  void kill() {
+    killed_ = true;
+    if (on_kill_) {
+      on_kill_();
+    }
+  }
+
+  /// mark the client as active
+  void touch() { last_interaction = Clock::now(); }
+
+  [[nodiscard]] std::uint64_t id() const { return id_; }
+  [[nodiscard]] const std::string& addr() const { return addr_; }
+  [[nodiscard]] bool killed() const { return killed_; }
+};
+
+/// registry of connected clients.
+/// clients are kept in an intrusive list, so connecting and disconnecting do not allocate.
+class Registry {
+  friend class Client;
+
+ private:
+  mutable std::mutex mutex_;
+  Client* head_;
+  std::size_t size_;
+  std::atomic<std::uint64_t> next_id_;
+
+ public:
+  Registry() : mutex_(), head_(nullptr), size_(0), next_id_(1) {}
+
+  Registry(const Registry&) = delete;
+  Registry& operator=(const Registry&) = delete;
+
+ private:
+  void add(Client& client) {
+    client.id_ = next_id_.fetch_add(1, std::memory_order_relaxed);
+    const std::lock_guard lock(mutex_);
+    client.next_ = head_;
+    if (head_ != nullptr) {
+      head_->prev_ = &client;
+    }
+    head_ = &client;
+    size_++;
+  }
+
+  void remove(Client& client) {
+    const std::lock_guard lock(mutex_);
+    if (client.prev_ != nullptr) {
+      client.prev_->next_ = client.next_;
+    } else {
+      head_ = client.next_;
+    }
+    if (client.next_ != nullptr) {
+      client.next_->prev_ = client.prev_;
+    }
+    size_--;
+  }
+
+  /// kill clients that match the predicate
+  /// \tparam F predicate type
+  /// \param pred predicate
+  /// \return number of killed clients
+  template <class F>
+  std::size_t killIf(F&& pred) {
+    // handlers only cancel pending operations, so the clients stay registered while the list is walked
+    const std::lock_guard lock(mutex_);
+    std::size_t count = 0;
+    for (auto* client = head_; client != nullptr; client = client->next_) {
+      if (!client->killed_ && pred(*client)) {
+        client->kill();
+        count++;
+      }
+    }
+    return count;
+  }
+
+ public:
+  /// number of connected clients
+  /// \return number of clients
+  [[nodiscard]] std::size_t size() const {
+    const std::lock_guard lock(mutex_);
+    return size_;
+  }
+
+  /// kill the client by id
+  /// \param id client id
+  /// \return number of killed clients (0 or 1)
+  std::size_t killById(std::uint64_t id) {
+    return killIf([id](const Client& client) { return client.id() == id; });
+  }
+
+  /// kill the client by address
+  /// \param addr peer address (IP:PORT)
+  /// \return number of killed clients (0 or 1)
+  std::size_t killByAddr(std::string_view addr) {
+    return killIf([addr](const Client& client) { return client.addr() == addr; });
+  }
+
+  /// kill clients idle longer than the timeout
+  /// \param timeout idle timeout
+  /// \return number of killed clients
+  std::size_t killIdle(std::chrono::seconds timeout) {
+    const auto deadline = Client::Clock::now() - timeout;
+    return killIf([deadline](const Client& client) { return client.last_interaction < deadline; });
+  }
+
+  /// CLIENT LIST (one line per client, oldest first)
+  /// \return client list
+  [[nodiscard]] std::string list() const {
+    const auto now = Client::Clock::now();
+    const auto seconds = [now](Client::Clock::time_point tp) {
+      return std::chrono::duration_cast<std::chrono::seconds>(now - tp).count();
+    };
+    std::ostringstream os;
+    const std::lock_guard lock(mutex_);
+    const Client* tail = head_;
+    while (tail != nullptr && tail->next_ != nullptr) {
+      tail = tail->next_;
+    }
+    for (const auto* client = tail; client != nullptr; client = client->prev_) {
+      os << "id=" << client->id_                               //
+         << " addr=" << client->addr_                          //
+         << " name=" << client->name                           //
+         << " age=" << seconds(client->created)                //
+         << " idle=" << seconds(client->last_interaction)      //
+         << " qbuf=" << client->query_buffer                   //
+         << " qbuf-free=" << client->query_buffer_free         //
+         << " omem=" << client->output_memory                  //
+         << " tot-net-in=" << client->net_input                //
+         << " tot-net-out=" << client->net_output              //
+         << " tot-cmds=" << client->commands                   //
+         << " cmd=" << (client->last_command.empty() ? "NULL" : Lower(client->last_command)) << "\n";
+    }
+    return os.str();
+  }
+};
+
+inline Client::Client(Registry& registry, std::string addr)
+    : registry_(registry),
+      prev_(nullptr),
+      next_(nullptr),
+      id_(0),
+      addr_(std::move(addr)),
+      on_kill_(),
+      killed_(false),
+      name(),
+      created(Clock::now()),
+      last_interaction(created),
+      last_command() {
+  registry_.add(*this);
+}
+
+inline Client::~Client() { registry_.remove(*this); }
+
+}  // namespace eidos::clients
@@ -0,0 +1,297 @@
+// Copyright 2021 SiLeader and Cerussite.
+//
+// Licensed under the Apache License, Version 2.0 (the “License”);
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an “AS IS” BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <span>
+#include <string>
+#include <string_view>
+
+// command table.
+// the command name of a request is looked up with a perfect hash generated at compile time, so dispatch costs one
+// hash and one comparison over the raw argument bytes regardless of the number of commands.
+namespace eidos::commands {
+
+/// command id (index of [kTable])
+enum class Id : std::uint8_t {
+  kGet,
+  kSet,
+  kExists,
+  kDel,
+  kKeys,
+  kRaft,
+  kCommand,
+  kInfo,
+  kLatency,
+  kSlowlog,
+  kHotkeys,
+  kBigkeys,
+  kMemory,
+  kDebug,
+  kClient,
+  kMulti,
+  kExec,
+  kDiscard,
+  kWatch,
+  kUnwatch,
+};
+
+/// command flags (COMMAND reply)
+enum Flag : std::uint32_t {
+  kWrite = 1U << 0U,     // may modify the keyspace
+  kReadonly = 1U << 1U,  // never modifies the keyspace
+  kDenyOom = 1U << 2U,   // may increase memory usage
+  kAdmin = 1U << 3U,     // administrative command
+  kFast = 1U << 4U,      // O(1) or O(log N)
+  kLoading = 1U << 5U,   // allowed while loading
+  kStale = 1U << 6U,     // allowed while the replica is stale
+};
+
+/// flag names in bit order
+inline constexpr std::array<std::string_view, 7> kFlagNames = {
+    "write", "readonly", "denyoom", "admin", "fast", "loading", "stale",
+};
+
+/// command metadata
+struct Spec {
+  Id id;
+  std::string_view name;  // upper case
+  int arity;              // number of arguments including the command name, negative: at least -arity
+  std::uint32_t flags;
+  int first_key;  // position of the first key argument (0: no key)
+  int last_key;   // position of the last key argument
+  int step;       // step between key arguments
+};
+
+/// all commands (in [Id] order)
+inline constexpr std::array<Spec, 20> kTable = {{
+    {Id::kGet, "GET", 2, kReadonly | kFast, 1, 1, 1},
+    {Id::kSet, "SET", 3, kWrite | kDenyOom, 1, 1, 1},
+    {Id::kExists, "EXISTS", 2, kReadonly | kFast, 1, 1, 1},
+    {Id::kDel, "DEL", 2, kWrite, 1, 1, 1},
+    {Id::kKeys, "KEYS", 2, kReadonly, 0, 0, 0},
+    {Id::kRaft, "RAFT", -2, kAdmin, 0, 0, 0},
+    {Id::kCommand, "COMMAND", -1, kLoading | kStale, 0, 0, 0},
+    {Id::kInfo, "INFO", -1, kLoading | kStale, 0, 0, 0},
+    {Id::kLatency, "LATENCY", -2, kAdmin | kLoading | kStale, 0, 0, 0},
+    {Id::kSlowlog, "SLOWLOG", -2, kAdmin | kLoading | kStale, 0, 0, 0},
+    {Id::kHotkeys, "HOTKEYS", -1, kAdmin, 0, 0, 0},
+    {Id::kBigkeys, "BIGKEYS", -1, kAdmin, 0, 0, 0},
+    {Id::kMemory, "MEMORY", -2, kReadonly, 0, 0, 0},
+    {Id::kDebug, "DEBUG", -2, kAdmin, 0, 0, 0},
+    {Id::kClient, "CLIENT", -2, kAdmin | kLoading | kStale, 0, 0, 0},
+    {Id::kMulti, "MULTI", 1, kFast | kLoading | kStale, 0, 0, 0},
+    {Id::kExec, "EXEC", 1, kLoading | kStale, 0, 0, 0},
+    {Id::kDiscard, "DISCARD", 1, kFast | kLoading | kStale, 0, 0, 0},
+    {Id::kWatch, "WATCH", -2, kFast | kLoading | kStale, 1, -1, 1},
+    {Id::kUnwatch, "UNWATCH", 1, kFast | kLoading | kStale, 0, 0, 0},
+}};
+
+/// metadata of the command
+/// \param id command id
+/// \return metadata
+constexpr const Spec& Get(Id id) { return kTable[static_cast<std::size_t>(id)]; }
+
+/// check the number of arguments
+/// \param spec command metadata
+/// \param argc number of arguments including the command name
+/// \return true if accepted
+constexpr bool CheckArity(const Spec& spec, std::size_t argc) {
+  return spec.arity >= 0 ? argc == static_cast<std::size_t>(spec.arity)
+                         : argc >= static_cast<std::size_t>(-spec.arity);
+}
+
+namespace detail {
+
+/// ASCII upper case
+constexpr unsigned char Upper(unsigned char c) { return c >= 'a' && c <= 'z' ? c - ('a' - 'A') : c; }
+
+/// case-insensitive FNV-1a
+/// \tparam Char char or std::byte
+/// \param seed hash seed
+/// \param data name
+/// \param size name size
+/// \return hash
+template <class Char>
+constexpr std::uint64_t Hash(std::uint64_t seed, const Char* data, std::size_t size) {
+  auto hash = 0xcbf29ce484222325ULL ^ seed;
+  for (std::size_t i = 0; i < size; ++i) {
+    hash = (hash ^ Upper(static_cast<unsigned char>(data[i]))) * 0x100000001b3ULL;
+  }
+  return hash ^ (hash >> 29U);
+}
+
+/// number of hash slots (power of two, at least 4 slots per command so that a seed is found quickly)
+inline constexpr std::size_t kSlots = [] {
+  std::size_t slots = 1;
+  while (slots < kTable.size() * 4) {
+    slots *= 2;
+  }
+  return slots;
+}();
+
+/// longest command name
+inline constexpr std::size_t kMaxNameLength = [] {
+  std::size_t length = 0;
+  for (const auto& spec : kTable) {
+    length = spec.name.size() > length ? spec.name.size() : length;
+  }
+  return length;
+}();
+
+/// perfect hash: seed and slot to command index (kTable.size(): empty)
+struct PerfectHash {
+  std::uint64_t seed = 0;
+  std::array<std::uint8_t, kSlots> slots{};
+};
+
+/// find a seed that maps every command to a distinct slot
+consteval PerfectHash Build() {
+  for (std::uint64_t seed = 0; seed < 100000; ++seed) {
+    PerfectHash table{seed, {}};
+    table.slots.fill(static_cast<std::uint8_t>(kTable.size()));
+    bool collided = false;
+    for (std::size_t i = 0; i < kTable.size() && !collided; ++i) {
+      auto& slot = table.slots[Hash(seed, kTable[i].name.data(), kTable[i].name.size()) & (kSlots - 1)];
+      collided = slot != kTable.size();
+      slot = static_cast<std::uint8_t>(i);
+    }
+    if (!collided) {
+      return table;
+    }
+  }
+  throw "no perfect hash seed found";  // compile error
+}
+
+inline constexpr PerfectHash kHash = Build();
+
+static_assert(
+    [] {
+      for (std::size_t i = 0; i < kTable.size(); ++i) {
+        if (static_cast<std::size_t>(kTable[i].id) != i) {
+          return false;
+        }
+      }
+      return true;
+    }(),
+    "kTable must be in Id order");
+
+}  // namespace detail
+
+/// look up a command by name (case-insensitive)
+/// \tparam Char char or std::byte
+/// \param data command name bytes
+/// \param size command name size
+/// \return metadata or nullptr if unknown
+template <class Char>
+constexpr const Spec* Lookup(const Char* data, std::size_t size) {
+  if (size == 0 || size > detail::kMaxNameLength) {
+    return nullptr;
+  }
+  const auto index = detail::kHash.slots[detail::Hash(detail::kHash.seed, data, size) & (detail::kSlots - 1)];
+  if (index == kTable.size()) {
+    return nullptr;
+  }
+  const auto& spec = kTable[index];
+  if (spec.name.size() != size) {
+    return nullptr;
+  }
+  for (std::size_t i = 0; i < size; ++i) {
+    if (detail::Upper(static_cast<unsigned char>(data[i])) != static_cast<unsigned char>(spec.name[i])) {
+      return nullptr;
+    }
+  }
+  return &spec;
+}
+
+/// look up a command by the raw argument bytes
+/// \param name command name
+/// \return metadata or nullptr if unknown
+inline const Spec* Lookup(std::span<const std::byte> name) { return Lookup(name.data(), name.size()); }
+
+/// look up a command by name
+/// \param name command name
+/// \return metadata or nullptr if unknown
+constexpr const Spec* Lookup(std::string_view name) { return Lookup(name.data(), name.size()); }
+
+/// convert to ASCII upper case in place.
+/// unlike `::toupper`, this is defined for all `char` values and does not depend on the locale
+/// \param str string
+inline void ToUpper(std::string& str) {
+  for (auto& c : str) {
+    c = static_cast<char>(detail::Upper(static_cast<unsigned char>(c)));
+  }
+}
+
+/// static replies built from the table once
+class Replies {
+ private:
+  std::array<std::string, kTable.size()> entries_;       // COMMAND INFO entry of each command
+  std::array<std::string, kTable.size()> arity_errors_;  // wrong number of arguments error
+  std::string command_;                                  // COMMAND reply
+  std::string count_;                                    // COMMAND COUNT reply
+
+  Replies() : entries_(), arity_errors_(), command_(), count_() {
+    command_ = "*" + std::to_string(kTable.size()) + "\r\n";
+    for (std::size_t i = 0; i < kTable.size(); ++i) {
+      const auto& spec = kTable[i];
+      std::string name(spec.name);
+      for (auto& c : name) {
+        c = c >= 'A' && c <= 'Z' ? static_cast<char>(c - 'A' + 'a') : c;
+      }
+      std::size_t flag_count = 0;
+      std::string flags;
+      for (std::size_t bit = 0; bit < kFlagNames.size(); ++bit) {
+        if ((spec.flags & (1U << bit)) != 0) {
+          flags += "+" + std::string(kFlagNames[bit]) + "\r\n";
+          flag_count++;
+        }
+      }
+      // name, arity, flags, first key, last key, step, ACL categories
+      entries_[i] = "*7\r\n$" + std::to_string(name.size()) + "\r\n" + name + "\r\n:" + std::to_string(spec.arity) +
+                    "\r\n*" + std::to_string(flag_count) + "\r\n" + flags + ":" + std::to_string(spec.first_key) +
+                    "\r\n:" + std::to_string(spec.last_key) + "\r\n:" + std::to_string(spec.step) + "\r\n*0\r\n";
+      arity_errors_[i] = "wrong number of arguments for '" + name + "' command";
+      command_ += entries_[i];
+    }
+    count_ = ":" + std::to_string(kTable.size()) + "\r\n";
+  }
+
+ public:
+  /// replies shared by all sessions
+  /// \return replies
+  static const Replies& Global() {
+    static const Replies replies;
+    return replies;
+  }
+
+  /// COMMAND reply
+  [[nodiscard]] const std::string& command() const { return command_; }
+
+  /// COMMAND COUNT reply
+  [[nodiscard]] const std::string& count() const { return count_; }
+
+  /// COMMAND INFO entry
+  /// \param id command id
+  [[nodiscard]] const std::string& entry(Id id) const { return entries_[static_cast<std::size_t>(id)]; }
+
+  /// error message of a wrong number of arguments
+  /// \param id command id
+  [[nodiscard]] const std::string& arityError(Id id) const { return arity_errors_[static_cast<std::size_t>(id)]; }
+};
+
+}  // namespace eidos::commands
@@ -14,149 +14,371 @@
 
 #pragma once
 
+#include <algorithm>
+#include <charconv>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
 #include <eidos/types.hpp>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
 
-#include "tcp.hpp"
+#include "buffer_pool.hpp"
+#include "log.hpp"
 
 namespace eidos {
 
 /// response context
-/// Redis protocol wrapper
+/// Redis protocol encoder. responses are appended to the output buffer and flushed by the session.
 class ResponseContext {
+ public:
+  static constexpr std::size_t kRetainSize = 64 * 1024;  // capacity kept after a flush
+  static constexpr std::size_t kPauseSize = 64 * 1024;   // output size that pauses parsing until the flush
+
  private:
-  std::shared_ptr<net::tcp::Socket> socket_;
+  std::string buffer_;
+  std::size_t mark_;   // start of the current response
+  std::size_t limit_;  // max output size (0: unlimited)
+  bool failed_;
+  bool overflowed_;
 
  public:
-  /// constructor
-  /// \param socket socket connected with client
-  explicit ResponseContext(std::shared_ptr<net::tcp::Socket> socket) : socket_(std::move(socket)) {}
+  ResponseContext() : buffer_(), mark_(0), limit_(0), failed_(false), overflowed_(false) {}
+
+ private:
+  /// check the output limit before appending
+  /// \param size bytes to append
+  /// \return false if the output would exceed the limit (the response is dropped)
+  bool reserve(std::size_t size) {
+    if (limit_ != 0 && (overflowed_ || buffer_.size() + size > limit_)) {
+      overflowed_ = true;
+      return false;
+    }
+    return true;
+  }
+
+  /// append bulk string
+  /// \param data data
+  /// \param size data size
+  void bulk(const void* data, std::size_t size) {
+    if (!reserve(size + 16)) {
+      return;
+    }
+    buffer_ += '$';
+    buffer_ += std::to_string(size);
+    buffer_ += "\r\n";
+    buffer_.append(static_cast<const char*>(data), size);
+    buffer_ += "\r\n";
+  }
 
  public:
+  /// start a response of the next command
+  void begin() {
+    mark_ = buffer_.size();
+    failed_ = false;
+  }
+
   /// send ok response to client
-  /// \tparam F response wrote callback function type
-  /// \param on_write response wrote callback function
-  template <class F>
-  void ok(F&& on_write) {
-    BOOST_LOG_TRIVIAL(trace) << "return simple string +OK";
-    socket_->write("+OK\r\n", std::forward<F>(on_write));
+  void ok() {
+    EIDOS_LOG_TRACE << "return simple string +OK";
+    if (reserve(5)) {
+      buffer_ += "+OK\r\n";
+    }
   }
 
   /// send ok response with bytes value to client
-  /// \tparam F response wrote callback function type
   /// \param value response bytes
-  /// \param on_write response wrote callback function
-  template <class F>
-  void ok(const std::vector<std::byte>& value, F&& on_write) {
-    BOOST_LOG_TRIVIAL(trace) << "return string +OK";
-    socket_->write("$" + std::to_string(value.size()) + "\r\n" + eidos::BytesToString(value) + "\r\n",
-                   std::forward<F>(on_write));
+  void ok(const std::vector<std::byte>& value) {
+    EIDOS_LOG_TRACE << "return string +OK";
+    bulk(value.data(), value.size());
   }
 
   /// send ok response with array of bytes to client
-  /// \tparam F response wrote callback function type
   /// \param value response bytes
-  /// \param on_write response wrote callback function
-  template <class F>
-  void ok(const std::vector<std::vector<std::byte>>& value, F&& on_write) {
-    std::stringstream ss;
-    ss << "*" << value.size() << "\r\n";
+  void ok(const std::vector<std::vector<std::byte>>& value) {
+    EIDOS_LOG_TRACE << "return string ok with array of bytes";
+    if (!reserve(16)) {
+      return;
+    }
+    buffer_ += '*';
+    buffer_ += std::to_string(value.size());
+    buffer_ += "\r\n";
     for (const auto& v : value) {
-      ss << "$" << v.size() << "\r\n";
-      ss << eidos::BytesToString(v) << "\r\n";
+      if (overflowed_) {
+        return;
+      }
+      bulk(v.data(), v.size());
+    }
+  }
+
+  /// send nil response (null bulk string) to client
+  void nil() {
+    EIDOS_LOG_TRACE << "return nil";
+    if (reserve(5)) {
+      buffer_ += "$-1\r\n";
     }
-    BOOST_LOG_TRIVIAL(trace) << "return string ok with array of bytes";
-    socket_->write(ss.str(), std::forward<F>(on_write));
   }
 
   /// send error response to client
-  /// \tparam F response wrote callback function type
   /// \param message error message
-  /// \param on_write response wrote callback function
-  template <class F>
-  void err(const std::string& message, F&& on_write) {
-    BOOST_LOG_TRIVIAL(trace) << "return string -ERR " << message;
-    socket_->write("-ERR " + message + "\r\n", std::forward<F>(on_write));
+  void err(std::string_view message) { err("ERR", message); }
+
+  /// send error response with an error code to client
+  /// \param code error code (e.g. EXECABORT)
+  /// \param message error message
+  void err(std::string_view code, std::string_view message) {
+    EIDOS_LOG_TRACE << "return string -" << code << " " << message;
+    failed_ = true;
+    if (!reserve(code.size() + message.size() + 4)) {
+      return;
+    }
+    buffer_ += '-';
+    buffer_ += code;
+    buffer_ += ' ';
+    buffer_ += message;
+    buffer_ += "\r\n";
   }
 
  public:
   /// send raw response to client
-  /// \tparam F response wrote callback function type
   /// \param str raw string
-  /// \param on_write response wrote callback function
-  template <class F>
-  void okRaw(const std::string& str, F&& on_write) {
-    BOOST_LOG_TRIVIAL(trace) << "return string ok with raw response string";
-    socket_->write(str, std::forward<F>(on_write));
+  void okRaw(std::string_view str) {
+    EIDOS_LOG_TRACE << "return string ok with raw response string";
+    if (reserve(str.size())) {
+      buffer_ += str;
+    }
+  }
+
+ public:
+  /// drop the current response (e.g. replies of a transaction that failed to commit)
+  void rollback() {
+    buffer_.resize(mark_);
+    failed_ = false;
+  }
+
+  /// size of the current response
+  /// \return bytes
+  [[nodiscard]] std::size_t written() const { return buffer_.size() - mark_; }
+
+  /// limit the output size. a response that would exceed the limit is dropped and the connection should be closed
+  /// (client output buffer hard limit)
+  /// \param limit max output size (0: unlimited)
+  void setLimit(std::size_t limit) { limit_ = limit; }
+
+  /// output limit status
+  /// \return true if a response was dropped by the limit
+  [[nodiscard]] bool overflowed() const { return overflowed_; }
+
+  /// error response status of the current response
+  /// \return true if error response was sent
+  [[nodiscard]] bool failed() const { return failed_; }
+
+  /// responses not flushed yet
+  /// \return output buffer
+  [[nodiscard]] const std::string& buffer() const { return buffer_; }
+
+  /// discard flushed responses.
+  /// the capacity is kept for the next responses unless a large reply grew the buffer beyond [kRetainSize].
+  void clear() {
+    if (buffer_.capacity() > kRetainSize) {
+      std::string().swap(buffer_);
+    } else {
+      buffer_.clear();
+    }
+    mark_ = 0;
   }
 };
 
 /// request context
-/// Redis protocol wrapper
+/// Redis protocol decoder. bytes read from the client are parsed in place.
+/// the receive buffer is borrowed from the buffer pool while a request is being received and given back by
+/// [release], so idle connections hold no receive buffer.
 class RequestContext {
+ public:
+  /// result of [parse]
+  enum class Status {
+    kComplete,    // a request is parsed
+    kIncomplete,  // more bytes are required
+    kError,       // protocol error
+  };
+
+  static constexpr std::size_t kReadSize = 16 * 1024;
+  static constexpr std::int64_t kMaxParams = 1024 * 1024;
+  static constexpr std::int64_t kMaxBulkLength = 512 * 1024 * 1024;
+  static constexpr std::size_t kMaxLineLength = 64 * 1024;
+  static constexpr std::size_t kMaxReadAhead = 1024 * 1024;  // max growth beyond received bytes
+
  private:
-  std::shared_ptr<net::tcp::Socket> socket_;
-  std::size_t param_count_;
-  std::size_t current_read_;
-  std::vector<std::vector<std::byte>> param_bytes_;
+  buffer::Pool* pool_;
+  buffer::Buffer buffer_;
+  std::size_t begin_;     // first unparsed byte
+  std::size_t end_;       // end of received bytes
+  std::size_t expected_;  // known size of the current request (lower bound, 0: unknown)
+  std::size_t request_size_;
+  std::string error_;
 
  public:
-  explicit RequestContext(std::shared_ptr<net::tcp::Socket> socket)
-      : socket_(std::move(socket)), param_count_(0), current_read_(0), param_bytes_() {}
+  /// constructor
+  /// \param pool receive buffer pool
+  explicit RequestContext(buffer::Pool& pool = buffer::Pool::Global())
+      : pool_(&pool), buffer_(), begin_(0), end_(0), expected_(0), request_size_(0), error_() {}
+
+  RequestContext(const RequestContext&) = delete;
+  RequestContext& operator=(const RequestContext&) = delete;
 
  private:
-  /// read command arguments
-  /// \tparam F request read callback function type
-  /// \param callback request read callback
-  template <class F>
-  void readParams(F&& callback) {
-    socket_->readString("\r\n", [this, callback = std::forward<F>(callback)](const std::string& payload) {
-      if (payload[0] != '$') {
-        BOOST_LOG_TRIVIAL(error) << "invalid request. payload is not started with '$'.";
-        BOOST_LOG_TRIVIAL(trace) << "additional info for error: payload: " << payload;
-        return;
+  /// parse "<prefix><integer>\r\n" at [pos]
+  /// \param prefix expected prefix
+  /// \param pos position (advanced to the next line if parsed)
+  /// \param value parsed integer
+  /// \return status
+  Status line(char prefix, std::size_t& pos, std::int64_t& value) {
+    if (pos >= end_) {
+      return Status::kIncomplete;
+    }
+    if (buffer_.data()[pos] != prefix) {
+      error_ = std::string("expected '") + prefix + "', got '" + buffer_.data()[pos] + "'";
+      return Status::kError;
+    }
+    const auto* first = buffer_.data() + pos + 1;
+    const auto* last = buffer_.data() + end_;
+    const auto* cr = static_cast<const char*>(std::memchr(first, '\r', static_cast<std::size_t>(last - first)));
+    if (cr == nullptr || cr + 1 >= last) {
+      if (static_cast<std::size_t>(last - first) > kMaxLineLength) {
+        error_ = "too big length line";
+        return Status::kError;
       }
-      const auto length = std::stoul(payload.substr(1));
-      BOOST_LOG_TRIVIAL(trace) << "parameter (" << (current_read_ + 1) << "/" << param_count_ << ") length";
-      socket_->readBytes(length + 2,  // length + '\r' '\n'
-                         [this, callback = std::forward<F>(callback)](const std::vector<std::byte>& bytes) {
-                           BOOST_LOG_TRIVIAL(trace)
-                               << "read parameter body " << (current_read_ + 1) << "/" << param_count_;
-                           current_read_++;
-                           param_bytes_.emplace_back(std::begin(bytes), std::end(bytes) - 2);
-                           if (current_read_ >= param_count_) {
-                             BOOST_LOG_TRIVIAL(trace) << "all parameters read. calling callback";
-                             callback(param_bytes_);
-                             return;
-                           }
-                           readParams(std::forward<F>(callback));
-                         });
-    });
+      return Status::kIncomplete;
+    }
+    const auto [ptr, ec] = std::from_chars(first, cr, value);
+    if (ec != std::errc() || ptr != cr || cr[1] != '\n') {
+      error_ = std::string("invalid ") + (prefix == '*' ? "multibulk" : "bulk") + " length";
+      return Status::kError;
+    }
+    pos = static_cast<std::size_t>(cr + 2 - buffer_.data());
+    return Status::kComplete;
   }
 
  public:
-  /// read the request that contains command name and arguments
-  /// \tparam F request read callback function type
-  /// \param callback request read callback
-  template <class F>
-  void read(F&& callback) {
-    socket_->readString("\r\n", [this, callback = std::forward<F>(callback)](const std::string& payload) {
-      if (payload[0] != '*') {
-        BOOST_LOG_TRIVIAL(error) << "invalid request. payload is not started with '*'.";
-        BOOST_LOG_TRIVIAL(trace) << "additional info for error: payload: " << payload;
-        return;
+  /// writable area for the next read. a buffer is borrowed if none is held, unparsed bytes are moved to the front
+  /// and the buffer grows to the size of a partially received bulk string (at most [kMaxReadAhead] ahead).
+  /// \return pointer and size of the writable area
+  std::pair<char*, std::size_t> prepare() {
+    if (begin_ == end_) {
+      begin_ = end_ = 0;
+    }
+    const auto pending = end_ - begin_;
+    const auto required = std::max(pending + kReadSize, std::min(expected_, pending + kMaxReadAhead));
+    if (!buffer_) {
+      buffer_ = pool_->acquire(required);
+    } else if (buffer_.capacity() - begin_ < required) {
+      auto grown = pool_->acquire(std::max(required, buffer_.capacity() * 2));
+      std::memcpy(grown.data(), buffer_.data() + begin_, pending);
+      buffer_ = std::move(grown);
+      begin_ = 0;
+      end_ = pending;
+    } else if (buffer_.capacity() - end_ < required - pending) {
+      std::memmove(buffer_.data(), buffer_.data() + begin_, pending);
+      begin_ = 0;
+      end_ = pending;
+    }
+    return {buffer_.data() + end_, buffer_.capacity() - end_};
+  }
+
+  /// mark bytes written to the area returned by [prepare] as received
+  /// \param size received bytes
+  void commit(std::size_t size) { end_ += size; }
+
+  /// parse a request (RESP array of bulk strings).
+  /// the capacity of [params] is reused, so pass the same vector for every request of a connection.
+  /// \param params command name and arguments
+  /// \return status
+  Status parse(std::vector<std::vector<std::byte>>& params) {
+    auto pos = begin_;
+    std::int64_t count = 0;
+    if (const auto status = line('*', pos, count); status != Status::kComplete) {
+      return status;
+    }
+    if (count < 0 || count > kMaxParams) {
+      error_ = "invalid multibulk length";
+      return Status::kError;
+    }
+
+    // check that the whole request is received before copying
+    const auto first = pos;
+    for (std::int64_t i = 0; i < count; ++i) {
+      std::int64_t length = 0;
+      if (const auto status = line('$', pos, length); status != Status::kComplete) {
+        return status;
+      }
+      if (length < 0 || length > kMaxBulkLength) {
+        error_ = "invalid bulk length";
+        return Status::kError;
+      }
+      const auto size = static_cast<std::size_t>(length);
+      if (end_ - pos < size + 2) {
+        expected_ = pos + size + 2 - begin_;
+        return Status::kIncomplete;
       }
-      param_bytes_.clear();
-      param_count_ = std::stoul(payload.substr(1));
-      current_read_ = 0;
-      BOOST_LOG_TRIVIAL(trace) << "param count";
-      readParams(callback);
-    });
+      if (buffer_.data()[pos + size] != '\r' || buffer_.data()[pos + size + 1] != '\n') {
+        error_ = "bulk string is not terminated by CRLF";
+        return Status::kError;
+      }
+      pos += size + 2;
+    }
+
+    params.resize(static_cast<std::size_t>(count));
+    pos = first;
+    for (auto& param : params) {
+      std::int64_t length = 0;
+      line('$', pos, length);
+      const auto* data = reinterpret_cast<const std::byte*>(buffer_.data() + pos);
+      param.assign(data, data + length);
+      pos += static_cast<std::size_t>(length) + 2;
+    }
+    EIDOS_LOG_TRACE << "request parsed (" << params.size() << " parameters)";
+    request_size_ = pos - begin_;
+    begin_ = pos;
+    expected_ = 0;
+    return Status::kComplete;
   }
 
- public:
-  /// create [ResponseContext] instance
-  /// \return response context
-  [[nodiscard]] std::shared_ptr<ResponseContext> response() { return std::make_shared<ResponseContext>(socket_); }
+  /// give the receive buffer back to the pool if no partial request is buffered and drop parameter buffers grown
+  /// by large bulk strings. called when all received requests are executed.
+  /// \param params parameters passed to [parse]
+  void release(std::vector<std::vector<std::byte>>& params) {
+    if (begin_ == end_) {
+      buffer_.reset();
+      begin_ = end_ = 0;
+    }
+    for (auto& param : params) {
+      if (param.capacity() > kReadSize) {
+        std::vector<std::byte>().swap(param);
+      }
+    }
+  }
+
+  /// no partially received request is buffered
+  /// \return true if idle
+  [[nodiscard]] bool idle() const { return begin_ == end_; }
+
+  /// received bytes not parsed yet
+  /// \return bytes
+  [[nodiscard]] std::size_t buffered() const { return end_ - begin_; }
+
+  /// size of the borrowed receive buffer
+  /// \return bytes (0 if no buffer is held)
+  [[nodiscard]] std::size_t capacity() const { return buffer_.capacity(); }
+
+  /// size of the last parsed request
+  /// \return bytes
+  [[nodiscard]] std::size_t requestSize() const { return request_size_; }
+
+  /// reason of the last protocol error
+  /// \return message
+  [[nodiscard]] const std::string& error() const { return error_; }
 };
 
-}  // namespace eidos
\ No newline at end of file
+}  // namespace eidos
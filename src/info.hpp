@@ -0,0 +1,282 @@
+// Copyright 2021 SiLeader and Cerussite.
+//
+// Licensed under the Apache License, Version 2.0 (the “License”);
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an “AS IS” BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#pragma once
+
+#include <unistd.h>
+
+#include <algorithm>
+#include <array>
+#include <cctype>
+#include <cstdint>
+#include <eidos/histogram.hpp>
+#include <eidos/version.hpp>
+#include <fstream>
+#include <iomanip>
+#include <map>
+#include <sstream>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#if defined(__GLIBC__)
+#include <malloc.h>
+#endif
+
+#include "buffer_pool.hpp"
+#include "profile.hpp"
+#include "server.hpp"
+#include "stats.hpp"
+
+namespace eidos::info {
+
+/// sections of INFO in output order
+inline constexpr std::array<std::string_view, 8> kSections = {
+    "server", "clients", "memory", "stats", "commandstats", "latencystats", "profile", "keyspace",
+};
+
+/// heap memory in use
+/// \return bytes
+inline std::uint64_t UsedMemory() {
+#if defined(__GLIBC__) && (__GLIBC__ > 2 || (__GLIBC__ == 2 && __GLIBC_MINOR__ >= 33))
+  const auto info = ::mallinfo2();
+  return info.uordblks + info.hblkhd;
+#else
+  return 0;
+#endif
+}
+
+/// resident set size
+/// \return bytes
+inline std::uint64_t ResidentSetSize() {
+  std::ifstream ifs("/proc/self/statm");
+  std::uint64_t size = 0;
+  std::uint64_t resident = 0;
+  ifs >> size >> resident;
+  return resident * static_cast<std::uint64_t>(::sysconf(_SC_PAGESIZE));
+}
+
+namespace detail {
+
+/// lower case string
+/// \param s string
+/// \return lower case string
+inline std::string ToLower(std::string_view s) {
+  std::string lower(s);
+  std::transform(std::begin(lower), std::end(lower), std::begin(lower),
+                 [](unsigned char c) { return static_cast<char>(std::tolower(c)); });
+  return lower;
+}
+
+/// human readable bytes (e.g. 1.50M)
+/// \param bytes bytes
+/// \return string
+inline std::string HumanBytes(std::uint64_t bytes) {
+  constexpr char kUnits[] = "BKMGT";
+  auto value = static_cast<double>(bytes);
+  std::size_t unit = 0;
+  while (value >= 1024 && unit + 1 < sizeof(kUnits) - 1) {
+    value /= 1024;
+    unit++;
+  }
+  std::stringstream ss;
+  ss << std::fixed << std::setprecision(2) << value << kUnits[unit];
+  return ss.str();
+}
+
+/// write a section of INFO
+/// \param os output stream
+/// \param state server state
+/// \param section section name (lower case)
+inline void StreamSection(std::ostream& os, ServerState& state, std::string_view section) {
+  static constexpr char NL[] = "\r\n";
+  const auto& stats = state.stats;
+  const auto us = [](std::uint64_t ns) { return static_cast<double>(ns) / 1000.0; };
+
+  if (section == "server") {
+    const auto uptime = stats.uptime().count();
+    os << "# Server" << NL                                           //
+       << "redis_version:" << version::Version() << NL               //
+       << "eidos_version:" << version::Version() << NL               //
+       << "redis_mode:standalone" << NL                              //
+       << "arch_bits:" << sizeof(void*) * 8 << NL                    //
+       << "process_id:" << ::getpid() << NL                          //
+       << "tcp_port:" << state.options.port << NL                    //
+       << "uptime_in_seconds:" << uptime << NL                       //
+       << "uptime_in_days:" << uptime / (24 * 60 * 60) << NL << NL;  //
+  } else if (section == "clients") {
+    os << "# Clients" << NL                                       //
+       << "connected_clients:" << stats.connectedClients() << NL  //
+       << "maxclients:" << state.options.maxclients << NL << NL;  //
+  } else if (section == "memory") {
+    const auto used = info::UsedMemory();
+    const auto rss = info::ResidentSetSize();
+    os << "# Memory" << NL                                                       //
+       << "used_memory:" << used << NL                                           //
+       << "used_memory_human:" << HumanBytes(used) << NL                         //
+       << "used_memory_rss:" << rss << NL                                        //
+       << "used_memory_rss_human:" << HumanBytes(rss) << NL                      //
+       << "mem_receive_buffers:" << buffer::Pool::Global().used() << NL          //
+       << "mem_pooled_buffers:" << buffer::Pool::Global().cached() << NL << NL;  //
+  } else if (section == "stats") {
+    std::uint64_t commands = 0;
+    std::uint64_t errors = 0;
+    for (std::size_t i = 0; i < stats::kCommands.size(); ++i) {
+      histogram::Histogram latency;
+      errors += stats.command(i, latency);
+      commands += latency.count();
+    }
+    os << "# Stats" << NL                                                                                  //
+       << "total_connections_received:" << stats.totalConnections() << NL                                  //
+       << "total_commands_processed:" << commands << NL                                                    //
+       << "total_net_input_bytes:" << stats.netInput() << NL                                               //
+       << "total_net_output_bytes:" << stats.netOutput() << NL                                             //
+       << "rejected_connections:" << stats.rejectedConnections() << NL                                     //
+       << "total_error_replies:" << errors << NL                                                           //
+       << "client_output_buffer_limit_disconnections:" << stats.outputBufferDisconnections() << NL << NL;  //
+  } else if (section == "commandstats") {
+    os << "# Commandstats" << NL;
+    for (std::size_t i = 0; i < stats::kCommands.size(); ++i) {
+      histogram::Histogram latency;
+      const auto failed = stats.command(i, latency);
+      if (latency.count() == 0) {
+        continue;
+      }
+      os << "cmdstat_" << ToLower(stats::kCommands[i]) << ":calls=" << latency.count()
+         << ",usec=" << latency.sum() / 1000 << ",usec_per_call=" << std::fixed << std::setprecision(2)
+         << latency.mean() / 1000.0 << ",rejected_calls=0,failed_calls=" << failed << NL;
+    }
+    os << NL;
+  } else if (section == "latencystats") {
+    os << "# Latencystats" << NL;
+    for (std::size_t i = 0; i < stats::kCommands.size(); ++i) {
+      histogram::Histogram latency;
+      stats.command(i, latency);
+      if (latency.count() == 0) {
+        continue;
+      }
+      os << "latency_percentiles_usec_" << ToLower(stats::kCommands[i]) << ":" << std::fixed
+         << std::setprecision(3) << "p50=" << us(latency.percentile(50)) << ",p99=" << us(latency.percentile(99))
+         << ",p99.9=" << us(latency.percentile(99.9)) << NL;
+    }
+    os << NL;
+  } else if (section == "profile") {
+    // hardware counters per call (--profile-counters)
+    os << "# Profile" << NL                                                                  //
+       << "profile_counters:" << (state.profiler.enabled() ? "enabled" : "disabled") << NL;  //
+    for (std::size_t i = 0; i < stats::kCommands.size(); ++i) {
+      const auto command = state.profiler.command(i);
+      if (command.calls == 0) {
+        continue;
+      }
+      const auto per_call = [&command](std::size_t event) {
+        return static_cast<double>(command.values[event]) / static_cast<double>(command.calls);
+      };
+      os << "profile_" << ToLower(stats::kCommands[i]) << ":calls=" << command.calls << std::fixed
+         << std::setprecision(2);
+      for (std::size_t event = 0; event < profile::kEvents.size(); ++event) {
+        os << "," << profile::kEvents[event] << "_per_call=" << per_call(event);
+      }
+      const auto cycles = command.values[0];        // kEvents[0]: cycles
+      const auto instructions = command.values[1];  // kEvents[1]: instructions
+      os << ",ipc=" << (cycles == 0 ? 0.0 : static_cast<double>(instructions) / static_cast<double>(cycles)) << NL;
+    }
+    os << NL;
+  } else if (section == "keyspace") {
+    os << "# Keyspace" << NL;
+    const auto size = state.engine->size();
+    if (size.is_ok() && size.unwrap() > 0) {
+      os << "db0:keys=" << size.unwrap() << ",expires=0,avg_ttl=0" << NL;
+    }
+    os << NL;
+  }
+}
+
+}  // namespace detail
+
+/// create INFO response text
+/// \param state server state
+/// \param sections requested section names (empty, "default", "all" or "everything": all sections)
+/// \return INFO text
+inline std::string Info(ServerState& state, const std::vector<std::string>& sections) {
+  std::vector<std::string> requested;
+  for (const auto& section : sections) {
+    requested.emplace_back(detail::ToLower(section));
+  }
+  const auto all = requested.empty() || std::any_of(std::begin(requested), std::end(requested), [](const auto& s) {
+                     return s == "default" || s == "all" || s == "everything";
+                   });
+
+  std::stringstream ss;
+  for (const auto section : kSections) {
+    if (all || std::find(std::begin(requested), std::end(requested), section) != std::end(requested)) {
+      detail::StreamSection(ss, state, section);
+    }
+  }
+  return ss.str();
+}
+
+/// create LATENCY HISTOGRAM response (RESP).
+/// latency is reported in power of two microsecond buckets with cumulative counts.
+/// \param state server state
+/// \param commands command names (empty: all commands that have been called)
+/// \return RESP encoded response
+inline std::string LatencyHistogram(ServerState& state, const std::vector<std::string>& commands) {
+  static constexpr char NL[] = "\r\n";
+  std::vector<std::size_t> indices;
+  for (std::size_t i = 0; i < stats::kCommands.size(); ++i) {
+    const auto requested =
+        commands.empty() || std::any_of(std::begin(commands), std::end(commands), [i](const std::string& cmd) {
+          return detail::ToLower(cmd) == detail::ToLower(stats::kCommands[i]);
+        });
+    if (requested) {
+      indices.push_back(i);
+    }
+  }
+
+  std::size_t count = 0;
+  std::stringstream body;
+  for (const auto index : indices) {
+    histogram::Histogram latency;
+    state.stats.command(index, latency);
+    if (latency.count() == 0) {
+      continue;
+    }
+
+    std::map<std::uint64_t, std::uint64_t> buckets;
+    latency.forEach([&buckets](std::uint64_t, std::uint64_t highest, std::uint64_t n) {
+      std::uint64_t bucket = 1;
+      while (bucket * 1000 < highest && bucket < (std::uint64_t{1} << 40U)) {
+        bucket <<= 1U;
+      }
+      buckets[bucket] += n;
+    });
+
+    const auto name = detail::ToLower(stats::kCommands[index]);
+    body << "$" << name.size() << NL << name << NL                          //
+         << "*4" << NL                                                      //
+         << "$5" << NL << "calls" << NL << ":" << latency.count() << NL     //
+         << "$14" << NL << "histogram_usec" << NL                           //
+         << "*" << buckets.size() * 2 << NL;                                //
+    std::uint64_t cumulative = 0;
+    for (const auto& [bucket, n] : buckets) {
+      cumulative += n;
+      body << ":" << bucket << NL << ":" << cumulative << NL;
+    }
+    count++;
+  }
+  return "*" + std::to_string(count * 2) + NL + body.str();
+}
+
+}  // namespace eidos::info
@@ -0,0 +1,338 @@
+// Copyright 2021 SiLeader and Cerussite.
+//
+// Licensed under the Apache License, Version 2.0 (the “License”);
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an “AS IS” BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <eidos/types.hpp>
+#include <limits>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <tuple>
+#include <utility>
+#include <vector>
+
+#include "storage/storage_base.hpp"
+
+namespace eidos::keystats {
+
+/// number of keys kept by trackers
+inline constexpr std::size_t kTopKeys = 32;
+
+/// estimated memory usage of a stored key value pair (bytes)
+/// \param key key
+/// \param value value
+/// \return bytes
+inline std::size_t MemoryUsage(const Key& key, const Value& value) {
+  // list node of MemoryStorageEngine: links + tuple + heap blocks of key and value
+  return 2 * sizeof(void*) + sizeof(std::tuple<Key, Value>) + key.bytes().capacity() + value.bytes().capacity();
+}
+
+/// hot key tracker.
+/// sampled accesses are counted by a count-min sketch and the most accessed keys are kept in a top-K min-heap.
+/// counts are halved periodically so that the tracker follows recent access patterns.
+class HotKeys {
+ private:
+  static constexpr std::size_t kDepth = 4;
+  static constexpr std::size_t kWidth = 4096;  // power of 2
+  static constexpr std::uint64_t kDecayInterval = 1U << 16U;
+
+  using Entry = std::pair<std::string, std::uint32_t>;
+
+ private:
+  std::uint32_t sample_rate_;  // 1 in N accesses is sampled. 0: disabled
+  std::unique_ptr<std::atomic<std::uint32_t>[]> sketch_;
+  std::atomic<std::uint64_t> samples_;
+  std::atomic<std::uint32_t> admission_;  // min count of the top-K when it is full
+  std::mutex mutex_;
+  std::vector<Entry> top_;  // min-heap by count
+
+ public:
+  /// constructor
+  /// \param sample_rate 1 in [sample_rate] accesses is sampled. 0 disables the tracker
+  explicit HotKeys(std::uint32_t sample_rate)
+      : sample_rate_(sample_rate),
+        sketch_(std::make_unique<std::atomic<std::uint32_t>[]>(kDepth * kWidth)),
+        samples_(0),
+        admission_(0),
+        mutex_(),
+        top_() {}
+
+ private:
+  /// decide whether the access is sampled
+  /// \return true if sampled
+  [[nodiscard]] bool sample() const {
+    thread_local std::uint64_t x = 0x9E3779B97F4A7C15ULL ^ reinterpret_cast<std::uintptr_t>(&x);
+    // xorshift64
+    x ^= x << 13U;
+    x ^= x >> 7U;
+    x ^= x << 17U;
+    return x % sample_rate_ == 0;
+  }
+
+  /// slot of the row
+  /// \param digest key digest
+  /// \param row row
+  /// \return slot index
+  static std::size_t slot(std::uint64_t digest, std::size_t row) {
+    auto h = digest + (row + 1) * 0x9E3779B97F4A7C15ULL;
+    h = (h ^ (h >> 30U)) * 0xBF58476D1CE4E5B9ULL;
+    h = (h ^ (h >> 27U)) * 0x94D049BB133111EBULL;
+    h ^= h >> 31U;
+    return row * kWidth + (h & (kWidth - 1));
+  }
+
+  /// halve all counts. `mutex_` must be locked.
+  void decay() {
+    for (std::size_t i = 0; i < kDepth * kWidth; ++i) {
+      sketch_[i].store(sketch_[i].load(std::memory_order_relaxed) / 2, std::memory_order_relaxed);
+    }
+    for (auto& [key, count] : top_) {
+      count /= 2;
+    }
+    top_.erase(std::remove_if(std::begin(top_), std::end(top_), [](const Entry& e) { return e.second == 0; }),
+               std::end(top_));
+    std::make_heap(std::begin(top_), std::end(top_), greater);
+  }
+
+  static bool greater(const Entry& a, const Entry& b) { return a.second > b.second; }
+
+ public:
+  /// record an access to the key
+  /// \param key key
+  void record(const Key& key) {
+    if (sample_rate_ == 0 || !sample()) {
+      return;
+    }
+    std::uint32_t estimate = std::numeric_limits<std::uint32_t>::max();
+    for (std::size_t row = 0; row < kDepth; ++row) {
+      estimate = std::min(estimate, sketch_[slot(key.digest(), row)].fetch_add(1, std::memory_order_relaxed) + 1);
+    }
+    const auto samples = samples_.fetch_add(1, std::memory_order_relaxed) + 1;
+    if (estimate < admission_.load(std::memory_order_relaxed) && samples % kDecayInterval != 0) {
+      return;
+    }
+
+    std::lock_guard lock(mutex_);
+    const auto name = eidos::BytesToString(key.bytes());
+    const auto itr =
+        std::find_if(std::begin(top_), std::end(top_), [&name](const Entry& e) { return e.first == name; });
+    if (itr != std::end(top_)) {
+      itr->second = estimate;
+      std::make_heap(std::begin(top_), std::end(top_), greater);
+    } else if (top_.size() < kTopKeys) {
+      top_.emplace_back(name, estimate);
+      std::push_heap(std::begin(top_), std::end(top_), greater);
+    } else if (estimate > top_.front().second) {
+      std::pop_heap(std::begin(top_), std::end(top_), greater);
+      top_.back() = {name, estimate};
+      std::push_heap(std::begin(top_), std::end(top_), greater);
+    }
+    if (samples % kDecayInterval == 0) {
+      decay();
+    }
+    admission_.store(top_.size() < kTopKeys ? 0 : top_.front().second, std::memory_order_relaxed);
+  }
+
+  /// most accessed keys
+  /// \param count max number of keys
+  /// \return keys and estimated number of accesses (most accessed first)
+  std::vector<std::pair<std::string, std::uint64_t>> top(std::size_t count) {
+    std::vector<Entry> top;
+    {
+      std::lock_guard lock(mutex_);
+      top = top_;
+    }
+    std::sort(std::begin(top), std::end(top), greater);
+    std::vector<std::pair<std::string, std::uint64_t>> keys;
+    for (std::size_t i = 0; i < std::min(count, top.size()); ++i) {
+      keys.emplace_back(top[i].first, static_cast<std::uint64_t>(top[i].second) * sample_rate_);
+    }
+    return keys;
+  }
+};
+
+/// big key tracker.
+/// keeps the largest values that are larger than the threshold.
+class BigKeys {
+ private:
+  using Entry = std::pair<std::string, std::size_t>;
+
+ private:
+  std::size_t threshold_;
+  std::atomic<std::size_t> size_;  // number of tracked keys (checked without lock)
+  std::mutex mutex_;
+  std::vector<Entry> keys_;
+
+ public:
+  /// constructor
+  /// \param threshold min value size (bytes) to be tracked
+  explicit BigKeys(std::size_t threshold) : threshold_(threshold), size_(0), mutex_(), keys_() {}
+
+ private:
+  /// find tracked key. `mutex_` must be locked.
+  /// \param name key
+  /// \return iterator
+  std::vector<Entry>::iterator find(const std::string& name) {
+    return std::find_if(std::begin(keys_), std::end(keys_), [&name](const Entry& e) { return e.first == name; });
+  }
+
+ public:
+  /// record stored value size of the key
+  /// \param key key
+  /// \param size value size (bytes)
+  void record(const Key& key, std::size_t size) {
+    if (size < threshold_) {
+      remove(key);
+      return;
+    }
+    std::lock_guard lock(mutex_);
+    const auto name = eidos::BytesToString(key.bytes());
+    if (const auto itr = find(name); itr != std::end(keys_)) {
+      itr->second = size;
+    } else if (keys_.size() < kTopKeys) {
+      keys_.emplace_back(name, size);
+    } else {
+      const auto smallest = std::min_element(std::begin(keys_), std::end(keys_),
+                                             [](const Entry& a, const Entry& b) { return a.second < b.second; });
+      if (smallest->second < size) {
+        *smallest = {name, size};
+      }
+    }
+    size_.store(keys_.size(), std::memory_order_relaxed);
+  }
+
+  /// forget the key (deleted or overwritten by a small value)
+  /// \param key key
+  void remove(const Key& key) {
+    if (size_.load(std::memory_order_relaxed) == 0) {
+      return;
+    }
+    std::lock_guard lock(mutex_);
+    if (const auto itr = find(eidos::BytesToString(key.bytes())); itr != std::end(keys_)) {
+      keys_.erase(itr);
+    }
+    size_.store(keys_.size(), std::memory_order_relaxed);
+  }
+
+  /// forget all keys (the storage is cleared)
+  void clear() {
+    std::lock_guard lock(mutex_);
+    keys_.clear();
+    size_.store(0, std::memory_order_relaxed);
+  }
+
+  /// largest keys
+  /// \param count max number of keys
+  /// \return keys and value sizes (largest first)
+  std::vector<std::pair<std::string, std::size_t>> top(std::size_t count) {
+    std::vector<Entry> keys;
+    {
+      std::lock_guard lock(mutex_);
+      keys = keys_;
+    }
+    std::sort(std::begin(keys), std::end(keys), [](const Entry& a, const Entry& b) { return a.second > b.second; });
+    keys.resize(std::min(count, keys.size()));
+    return keys;
+  }
+};
+
+/// storage engine that records the writes applied to the wrapped engine to [BigKeys].
+/// with the Raft engine, this wraps the engine written by the state machine, so writes replicated from other nodes
+/// and installed snapshots are tracked as well as the writes of local clients.
+class BigKeysEngine : public storage::StorageEngineBase {
+ private:
+  std::shared_ptr<storage::StorageEngineBase> engine_;
+  std::shared_ptr<BigKeys> bigkeys_;
+
+ public:
+  /// constructor
+  /// \param engine wrapped engine
+  /// \param bigkeys big key tracker
+  BigKeysEngine(std::shared_ptr<storage::StorageEngineBase> engine, std::shared_ptr<BigKeys> bigkeys)
+      : engine_(std::move(engine)), bigkeys_(std::move(bigkeys)) {}
+
+ private:
+  /// record applied writes
+  /// \param mutations writes in order
+  void record(const std::vector<storage::Mutation>& mutations) {
+    for (const auto& mutation : mutations) {
+      if (mutation.value) {
+        bigkeys_->record(mutation.key, mutation.value->bytes().size());
+      } else {
+        bigkeys_->remove(mutation.key);
+      }
+    }
+  }
+
+ public:
+  Result<void> set(const Key& key, const Value& value) override {
+    auto result = engine_->set(key, value);
+    if (result.is_ok()) {
+      bigkeys_->record(key, value.bytes().size());
+    }
+    return result;
+  }
+
+  Result<Value> get(const Key& key) override { return engine_->get(key); }
+
+  Result<void> del(const Key& key) override {
+    auto result = engine_->del(key);
+    if (result.is_ok()) {
+      bigkeys_->remove(key);
+    }
+    return result;
+  }
+
+  Result<bool> exists(const Key& key) override { return engine_->exists(key); }
+
+  Result<std::vector<Key>> keys(const std::string& pattern) override { return engine_->keys(pattern); }
+
+  Result<std::vector<std::tuple<Key, Value>>> dump() override { return engine_->dump(); }
+
+  Result<std::size_t> size() override { return engine_->size(); }
+
+  std::uint64_t version(const Key& key) override { return engine_->version(key); }
+
+  Result<void> apply(const std::vector<storage::Mutation>& mutations) override {
+    auto result = engine_->apply(mutations);
+    if (result.is_ok()) {
+      record(mutations);
+    }
+    return result;
+  }
+
+  Result<void> applyIfUnchanged(const std::vector<storage::Mutation>& mutations,
+                                const std::vector<storage::Watch>& watched) override {
+    auto result = engine_->applyIfUnchanged(mutations, watched);
+    if (result.is_ok()) {
+      record(mutations);
+    }
+    return result;
+  }
+
+  Result<void> clear() override {
+    auto result = engine_->clear();
+    if (result.is_ok()) {
+      bigkeys_->clear();
+    }
+    return result;
+  }
+};
+
+}  // namespace eidos::keystats
@@ -0,0 +1,165 @@
+// Copyright 2021 SiLeader and Cerussite.
+//
+// Licensed under the Apache License, Version 2.0 (the “License”);
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an “AS IS” BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#pragma once
+
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include <boost/log/trivial.hpp>
+#include <cerrno>
+#include <cstring>
+#include <eidos/result.hpp>
+#include <memory>
+#include <string>
+#include <utility>
+
+#include "asio.hpp"
+#include "log.hpp"
+#include "tcp.hpp"
+#include "trace.hpp"
+
+// Unix domain socket transport for clients on the same host.
+// the session and the protocol stack are shared with the TCP transports; only the socket type differs.
+namespace eidos::net::local {
+
+template <class T>
+using Result = eidos::result::Result<T, std::string>;
+
+/// connection accepted by [Listen].
+/// has the same interface as tcp::Connection so the session is independent of the transport.
+class Connection {
+ private:
+  boost::asio::local::stream_protocol::socket socket_;
+  std::shared_ptr<const std::string> path_;  // listening socket path (clients are unnamed)
+
+ public:
+  Connection(boost::asio::local::stream_protocol::socket socket, std::shared_ptr<const std::string> path)
+      : socket_(std::move(socket)), path_(std::move(path)) {}
+
+ public:
+  /// wait until bytes can be read
+  /// \tparam Token completion token type
+  /// \param token completion token
+  template <class Token>
+  auto async_wait_read(Token&& token) {
+    return socket_.async_wait(boost::asio::local::stream_protocol::socket::wait_read, std::forward<Token>(token));
+  }
+
+  /// read some bytes
+  /// \tparam Token completion token type
+  /// \param buffer read buffer
+  /// \param token completion token
+  template <class Token>
+  auto async_read_some(boost::asio::mutable_buffer buffer, Token&& token) {
+    return socket_.async_read_some(buffer, std::forward<Token>(token));
+  }
+
+  /// write all bytes
+  /// \tparam Token completion token type
+  /// \param buffer data (must be valid until the completion)
+  /// \param token completion token
+  template <class Token>
+  auto async_write(boost::asio::const_buffer buffer, Token&& token) {
+    return boost::asio::async_write(socket_, buffer, std::forward<Token>(token));
+  }
+
+  /// native socket
+  /// \return file descriptor
+  int nativeHandle() { return socket_.native_handle(); }
+
+  /// cancel pending operations (completed with operation_aborted)
+  void cancel() {
+    boost::system::error_code ec;
+    socket_.cancel(ec);
+  }
+
+  /// address of the peer. clients of a Unix domain socket have no address, so the socket path is used
+  /// \return PATH:0
+  [[nodiscard]] std::string peer() const { return *path_ + ":0"; }
+};
+
+/// accept loop.
+/// the acceptor is owned by the coroutine frame.
+/// \tparam F on accept event handler type
+/// \param acceptor listening acceptor
+/// \param path listening socket path
+/// \param on_accept on accept event handler (called with the accepted [Connection])
+template <class F>
+boost::asio::awaitable<void> Accept(boost::asio::local::stream_protocol::acceptor acceptor,
+                                    std::shared_ptr<const std::string> path, F on_accept) {
+  for (;;) {
+    boost::system::error_code ec;
+    auto socket = co_await acceptor.async_accept(boost::asio::redirect_error(boost::asio::use_awaitable, ec));
+    if (ec) {
+      if (ec == boost::asio::error::operation_aborted) {
+        co_return;
+      }
+      BOOST_LOG_TRIVIAL(error) << "accept error: " << ec.message();
+      if (tcp::IsResourceError(ec)) {
+        boost::asio::steady_timer backoff(acceptor.get_executor(), tcp::kAcceptBackoff);
+        co_await backoff.async_wait(boost::asio::redirect_error(boost::asio::use_awaitable, ec));
+      }
+      continue;
+    }
+    EIDOS_LOG_TRACE << "client connected: " << *path;
+    trace::Scope span("accept", "net");
+    on_accept(Connection(std::move(socket), path));
+  }
+}
+
+/// start listen on a Unix domain socket.
+/// a socket file left by a previous process is removed. other files at the path are not touched.
+/// \tparam F on accept event handler type
+/// \param ioc io_context
+/// \param path socket path
+/// \param permissions permission bits of the socket file (0: umask default)
+/// \param on_accept on accept event handler (called with the accepted [Connection])
+/// \return error message if failed
+template <class F>
+Result<void> Listen(boost::asio::io_context& ioc, const std::string& path, unsigned permissions, F&& on_accept) {
+  if (path.size() >= sizeof(sockaddr_un::sun_path)) {
+    return Result<void>::Err(path + ": socket path is too long");
+  }
+  struct stat st {};
+  if (::lstat(path.c_str(), &st) == 0) {
+    if (!S_ISSOCK(st.st_mode)) {
+      return Result<void>::Err(path + " exists and is not a socket");
+    }
+    ::unlink(path.c_str());
+  }
+
+  boost::system::error_code ec;
+  boost::asio::local::stream_protocol::acceptor acceptor(ioc);
+  const boost::asio::local::stream_protocol::endpoint endpoint(path);
+  if (acceptor.open(endpoint.protocol(), ec); !ec) {
+    if (acceptor.bind(endpoint, ec); !ec) {
+      acceptor.listen(boost::asio::socket_base::max_listen_connections, ec);
+    }
+  }
+  if (ec) {
+    return Result<void>::Err(path + ": " + ec.message());
+  }
+  if (permissions != 0 && ::chmod(path.c_str(), permissions) != 0) {
+    return Result<void>::Err(path + ": chmod: " + std::strerror(errno));
+  }
+
+  boost::asio::co_spawn(
+      ioc, Accept(std::move(acceptor), std::make_shared<const std::string>(path), std::forward<F>(on_accept)),
+      boost::asio::detached);
+  return Result<void>::Ok();
+}
+
+}  // namespace eidos::net::local
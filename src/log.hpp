@@ -0,0 +1,98 @@
+// Copyright 2021 SiLeader and Cerussite.
+//
+// Licensed under the Apache License, Version 2.0 (the “License”);
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an “AS IS” BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#pragma once
+
+#include <boost/core/null_deleter.hpp>
+#include <boost/date_time/posix_time/posix_time_types.hpp>
+#include <boost/log/attributes/clock.hpp>
+#include <boost/log/core.hpp>
+#include <boost/log/expressions.hpp>
+#include <boost/log/sinks/async_frontend.hpp>
+#include <boost/log/sinks/text_ostream_backend.hpp>
+#include <boost/log/sinks/unbounded_fifo_queue.hpp>
+#include <boost/log/support/date_time.hpp>
+#include <boost/log/trivial.hpp>
+#include <boost/shared_ptr.hpp>
+#include <iostream>
+#include <optional>
+#include <string>
+
+// trace and debug logs are on the request path.
+// they are removed at compile time from release builds (NDEBUG) unless EIDOS_ENABLE_DEBUG_LOG is defined.
+// the arguments of removed logs are not evaluated.
+#if defined(NDEBUG) && !defined(EIDOS_ENABLE_DEBUG_LOG)
+#define EIDOS_LOG_TRACE \
+  while (false) BOOST_LOG_TRIVIAL(trace)
+#define EIDOS_LOG_DEBUG \
+  while (false) BOOST_LOG_TRIVIAL(debug)
+#else
+#define EIDOS_LOG_TRACE BOOST_LOG_TRIVIAL(trace)
+#define EIDOS_LOG_DEBUG BOOST_LOG_TRIVIAL(debug)
+#endif
+
+namespace eidos::log {
+
+/// parse severity level name
+/// \param name level name (trace, debug, info, warning, error, fatal)
+/// \return severity level or nullopt if unknown
+inline std::optional<boost::log::trivial::severity_level> ParseLevel(const std::string& name) {
+  boost::log::trivial::severity_level level{};
+  if (!boost::log::trivial::from_string(name.data(), name.size(), level)) {
+    return std::nullopt;
+  }
+  return level;
+}
+
+/// asynchronous console logging.
+/// log records are pushed to a lock-free queue and written to stderr by a dedicated thread,
+/// so that worker threads never block on console I/O.
+/// remaining records are flushed when this object is destroyed.
+class AsyncLogging {
+ private:
+  using Sink = boost::log::sinks::asynchronous_sink<boost::log::sinks::text_ostream_backend,
+                                                    boost::log::sinks::unbounded_fifo_queue>;
+
+ private:
+  boost::shared_ptr<Sink> sink_;
+
+ public:
+  /// constructor
+  /// \param level minimum severity level
+  explicit AsyncLogging(boost::log::trivial::severity_level level) : sink_(boost::make_shared<Sink>()) {
+    namespace expr = boost::log::expressions;
+
+    sink_->locked_backend()->add_stream(boost::shared_ptr<std::ostream>(&std::clog, boost::null_deleter()));
+    sink_->set_formatter(expr::stream << "[" << expr::format_date_time<boost::posix_time::ptime>(
+                                                    "TimeStamp", "%Y-%m-%d %H:%M:%S.%f")
+                                      << "] [" << boost::log::trivial::severity << "] " << expr::smessage);
+
+    auto core = boost::log::core::get();
+    core->add_global_attribute("TimeStamp", boost::log::attributes::local_clock());
+    core->set_filter(boost::log::trivial::severity >= level);
+    core->remove_all_sinks();
+    core->add_sink(sink_);
+  }
+
+  ~AsyncLogging() {
+    boost::log::core::get()->remove_sink(sink_);
+    sink_->stop();
+    sink_->flush();
+  }
+
+  AsyncLogging(const AsyncLogging&) = delete;
+  AsyncLogging& operator=(const AsyncLogging&) = delete;
+};
+
+}  // namespace eidos::log
@@ -14,11 +14,19 @@
 
 #include <boost/log/trivial.hpp>
 #include <boost/program_options.hpp>
+#include <charconv>
 #include <eidos/version.hpp>
+#include <filesystem>
 #include <iostream>
+#include <limits>
+#include <optional>
 
+#include "busy_poll.hpp"
+#include "keystats.hpp"
+#include "log.hpp"
 #include "server.hpp"
 #include "storage/memstore.hpp"
+#include "storage/multi_raft.hpp"
 #include "storage/raft.hpp"
 
 namespace {
@@ -27,33 +35,165 @@ namespace {
 /// \param os output stream
 /// \param program program name (argv[0])
 void StreamHelp(std::ostream& os, const char* program) {
-  os << "usage: " << program << " [-hv] [--engine ENGINE] [--port PORT]\n"  //
-     << "\n"                                                                //
-     << "options\n"                                                         //
-     << "  --help, -h           : show this help message\n"                 //
-     << "  --version, -v        : show version\n"                           //
-     << "  --port PORT, -p PORT : set port number (default: 6379)\n"        //
-     << "  --engine ENGINE      : set storage engine (default: memory)\n"   //
-     << "\n"                                                                //
-     << "storage engine\n"                                                  //
-     << "  memory    : use program heap memory as data storage.\n"          //
-     << "  raft      : use Raft replicated in-memory storage\n"             //
-     << "\n"                                                                //
+  os << "usage: " << program << " [-hv] [--engine ENGINE] [--port PORT]\n"                              //
+     << "\n"                                                                                            //
+     << "options\n"                                                                                     //
+     << "  --help, -h                        : show this help message\n"                                //
+     << "  --version, -v                     : show version\n"                                          //
+     << "  --port PORT, -p PORT              : set port number (default: 6379, 0 disables TCP)\n"       //
+     << "  --engine ENGINE                   : set storage engine (default: memory)\n"                  //
+     << "  --log-level LEVEL                 : set minimum log level (default: info)\n"                 //
+     << "                                      (trace and debug logs are not in release builds)\n"      //
+     << "  --slowlog-log-slower-than US      : log commands slower than US microseconds\n"              //
+     << "                                      (default: 10000, negative value disables the log)\n"     //
+     << "  --slowlog-max-len COUNT           : max number of slow log entries (default: 128)\n"         //
+     << "  --metrics-port PORT               : serve Prometheus metrics over HTTP on PORT\n"            //
+     << "                                      (default: 0, disabled)\n"                                //
+     << "  --hotkeys-sample-rate N           : sample 1 in N key accesses for HOTKEYS\n"                //
+     << "                                      (default: 16, 0 disables the tracker)\n"                 //
+     << "  --bigkeys-threshold BYTES         : track values larger than BYTES for BIGKEYS\n"            //
+     << "                                      (default: 1048576)\n"                                    //
+     << "  --profile-counters                : count CPU cycles, instructions, cache misses and\n"      //
+     << "                                      branch misses of each command (INFO profile)\n"          //
+     << "  --client-output-buffer-hard-limit BYTES\n"                                                   //
+     << "                                    : close a client whose pending replies exceed BYTES\n"     //
+     << "                                      (default: 0, disabled)\n"                                //
+     << "  --client-output-buffer-soft-limit BYTES\n"                                                   //
+     << "                                    : close a client whose pending replies exceed BYTES\n"     //
+     << "                                      for SECONDS (default: 0, disabled)\n"                    //
+     << "  --client-output-buffer-soft-seconds SECONDS\n"                                               //
+     << "                                    : duration of the soft limit (default: 0)\n"               //
+     << "  --unixsocket PATH                 : also listen on a Unix domain socket at PATH\n"           //
+     << "  --unixsocketperm MODE             : permission bits of the socket file in octal\n"           //
+     << "                                      (e.g. 770)\n"                                            //
+     << "  --maxclients COUNT                : max number of connected clients (default: 10000)\n"      //
+     << "  --timeout SECONDS                 : close clients idle for SECONDS (default: 0, disabled)\n" //
+     << "  --tcp-keepalive SECONDS           : send TCP keepalive probes after SECONDS idle\n"          //
+     << "                                      (default: 300, 0 disables keepalive)\n"                  //
+     << "  --busy-poll                       : poll the network without sleeping in epoll_wait\n"       //
+     << "                                      (lower wake-up latency, keeps a core busy)\n"            //
+     << "  --cpu-affinity LIST               : pin the io thread to CPUs (e.g. 2 or 0-3,6)\n"           //
+     << "  --so-busy-poll USEC               : set SO_BUSY_POLL on TCP connections\n"                   //
+     << "                                      (default: 0, disabled)\n"                                //
+     << "  --io-uring                        : serve clients with io_uring (multishot accept/recv)\n"   //
+     << "                                      built with -DEIDOS_IO_URING=ON, falls back to epoll\n"   //
+     << "\n"                                                                                            //
+     << "raft options\n"                                                                                //
+     << "  --node-id ID                      : set id of this node (default: 1)\n"                      //
+     << "  --raft-host HOST                  : set advertised host of this node (default: 127.0.0.1)\n" //
+     << "  --raft-port PORT                  : set Raft port number (default: 16379)\n"                 //
+     << "  --raft-groups COUNT               : set number of Raft groups (default: 1)\n"                //
+     << "                                      group N listens on PORT + N\n"                           //
+     << "  --peers ID=HOST:PORT              : add cluster members (the node that has the smallest\n"   //
+     << "                                      id adds others to the cluster)\n"                        //
+     << "  --raft-heartbeat-interval MS      : heartbeat interval (default: 125)\n"                     //
+     << "  --raft-election-timeout-lower MS  : election timeout lower bound (default: 250)\n"           //
+     << "  --raft-election-timeout-upper MS  : election timeout upper bound (default: 500)\n"           //
+     << "  --raft-snapshot-distance COUNT    : log entries between snapshots (default: 0, disabled)\n"  //
+     << "  --raft-max-append-size COUNT      : max log entries per append request (default: 100)\n"     //
+     << "  --raft-batch-size-hint BYTES      : batch size hint for the leader (default: 0, no hint)\n"  //
+     << "  --raft-log-sync POLICY            : log sync policy (default: commit)\n"                     //
+     << "                                      commit: reply after the entry is committed\n"            //
+     << "                                      accept: reply after the leader accepted the entry\n"     //
+     << "  --raft-log-store STORE            : log store implementation (default: ring)\n"              //
+     << "                                      ring: ring buffer, reads skip the writer lock\n"         //
+     << "                                      map: std::map with a store-wide lock\n"                  //
+     << "\n"                                                                                            //
+     << "transactions\n"                                                                                //
+     << "  MULTI / EXEC / DISCARD : queue commands and execute them atomically\n"                       //
+     << "  WATCH KEY [KEY ...]    : abort EXEC if a key is written before it (UNWATCH: forget)\n"       //
+     << "                           with multiple Raft groups, the written and watched keys must\n"     //
+     << "                           be in one group\n"                                                  //
+     << "\n"                                                                                            //
+     << "admin commands (raft)\n"                                                                       //
+     << "  RAFT ADD ID HOST:PORT : add server to the cluster\n"                                         //
+     << "  RAFT REMOVE ID        : remove server from the cluster\n"                                    //
+     << "  RAFT NODES            : list cluster members\n"                                              //
+     << "\n"                                                                                            //
+     << "admin commands\n"                                                                              //
+     << "  INFO [SECTION ...]             : show server information and statistics\n"                   //
+     << "  LATENCY HISTOGRAM [CMD ...]    : show latency histogram of commands\n"                       //
+     << "  SLOWLOG GET [COUNT]|LEN|RESET  : show, count or clear the slow log\n"                        //
+     << "  HOTKEYS [COUNT]                : show most accessed keys (estimated)\n"                      //
+     << "  BIGKEYS [COUNT]                : show keys that have the largest values\n"                   //
+     << "  MEMORY USAGE KEY               : show estimated memory usage of the key\n"                   //
+     << "  CLIENT LIST|ID|GETNAME         : list clients, show id or name of this client\n"             //
+     << "  CLIENT SETNAME NAME            : set name of this client\n"                                  //
+     << "  CLIENT KILL ID|ADDR VALUE      : close clients by id or address (IP:PORT)\n"                 //
+     << "  DEBUG TRACE START|STOP         : record request spans, STOP returns Chrome trace JSON\n"     //
+     << "\n"                                                                                            //
+     << "storage engine\n"                                                                              //
+     << "  memory    : use program heap memory as data storage.\n"                                      //
+     << "  raft      : use Raft replicated in-memory storage\n"                                         //
+     << "              the keyspace is partitioned if the number of Raft groups is > 1\n"               //
+     << "\n"                                                                                            //
      << "published under Apache License 2.0" << std::endl;
 }
 
+/// parse cluster member specification
+/// \param spec cluster member specification (ID=HOST:PORT)
+/// \return cluster member or no value (invalid specification)
+std::optional<eidos::storage::RaftPeer> ParsePeer(const std::string& spec) {
+  const auto eq = spec.find('=');
+  const auto colon = spec.rfind(':');
+  if (eq == std::string::npos || colon == std::string::npos || colon < eq) {
+    return std::nullopt;
+  }
+  try {
+    const auto id = std::stoi(spec.substr(0, eq));
+    const auto port = std::stoul(spec.substr(colon + 1));
+    if (port > std::numeric_limits<std::uint16_t>::max()) {
+      return std::nullopt;
+    }
+    return eidos::storage::RaftPeer{id, spec.substr(eq + 1, colon - eq - 1), static_cast<std::uint16_t>(port), 1};
+  } catch (const std::logic_error&) {
+    return std::nullopt;
+  }
+}
+
 }  // namespace
 
 int main(const int argc, const char* const* const argv) {
   // parsing command line arguments
   using boost::program_options::value;
   boost::program_options::options_description options("eidos");
-  options.add_options()                                                       // options
-      ("help,h", "show help")                                                 // --help, -h: help
-      ("version,v", "show version")                                           // --version, -v: version
-      ("port,p", value<std::uint16_t>()->default_value(6379), "port number")  // port
-      ("engine", value<std::string>()->default_value("memory"),
-       "storage engine (memory)")  //
+  options.add_options()                                                                    // options
+      ("help,h", "show help")                                                              // --help, -h: help
+      ("version,v", "show version")                                                        // --version, -v: version
+      ("port,p", value<std::uint16_t>()->default_value(6379), "port number")               // port
+      ("engine", value<std::string>()->default_value("memory"), "storage engine (memory)")  // engine
+      ("log-level", value<std::string>()->default_value("info"), "minimum log level")      // log level
+      ("slowlog-log-slower-than", value<std::int64_t>()->default_value(10000), "slow log threshold (us)")  //
+      ("slowlog-max-len", value<std::size_t>()->default_value(128), "max slow log entries")               //
+      ("metrics-port", value<std::uint16_t>()->default_value(0), "Prometheus metrics port")               //
+      ("hotkeys-sample-rate", value<std::uint32_t>()->default_value(16), "hot key sample rate")            //
+      ("bigkeys-threshold", value<std::size_t>()->default_value(1024 * 1024), "big key threshold (bytes)")  //
+      ("profile-counters", "per command CPU counters")                                     // profiling mode
+      ("client-output-buffer-hard-limit", value<std::size_t>()->default_value(0), "output hard limit (bytes)")  //
+      ("client-output-buffer-soft-limit", value<std::size_t>()->default_value(0), "output soft limit (bytes)")  //
+      ("client-output-buffer-soft-seconds", value<std::int64_t>()->default_value(0), "soft limit time (s)")     //
+      ("unixsocket", value<std::string>()->default_value(""), "Unix domain socket path")   // Unix socket
+      ("unixsocketperm", value<std::string>()->default_value("0"), "socket permissions")   // octal mode
+      ("maxclients", value<std::size_t>()->default_value(10000), "max number of clients")  // max clients
+      ("timeout", value<std::int64_t>()->default_value(0), "idle client timeout (s)")      // idle timeout
+      ("tcp-keepalive", value<std::int64_t>()->default_value(300), "TCP keepalive (s)")    // keepalive
+      ("busy-poll", "busy poll the io_context")                                            // busy poll
+      ("cpu-affinity", value<std::string>()->default_value(""), "io thread CPUs")          // CPU pinning
+      ("so-busy-poll", value<int>()->default_value(0), "SO_BUSY_POLL (us)")                // socket busy poll
+      ("io-uring", "io_uring network backend")                                             // io_uring transport
+      ("node-id", value<int>()->default_value(1), "node id")                               // Raft node id
+      ("raft-host", value<std::string>()->default_value("127.0.0.1"), "advertised host")   // Raft host
+      ("raft-port", value<std::uint16_t>()->default_value(16379), "Raft port number")      // Raft port
+      ("raft-groups", value<std::size_t>()->default_value(1), "number of Raft groups")     // Raft groups
+      ("peers", value<std::vector<std::string>>()->multitoken(), "cluster members")        // Raft peers
+      ("raft-heartbeat-interval", value<int>()->default_value(125), "heartbeat interval (ms)")  //
+      ("raft-election-timeout-lower", value<int>()->default_value(250), "election timeout lower bound (ms)")  //
+      ("raft-election-timeout-upper", value<int>()->default_value(500), "election timeout upper bound (ms)")  //
+      ("raft-snapshot-distance", value<int>()->default_value(0), "log entries between snapshots")             //
+      ("raft-max-append-size", value<int>()->default_value(100), "max log entries per append request")        //
+      ("raft-batch-size-hint", value<std::int64_t>()->default_value(0), "batch size hint (bytes)")            //
+      ("raft-log-sync", value<std::string>()->default_value("commit"), "log sync policy (commit, accept)")    //
+      ("raft-log-store", value<std::string>()->default_value("ring"), "log store (ring, map)")                //
       ;
   boost::program_options::variables_map vm;
   boost::program_options::store(boost::program_options::parse_command_line(argc, argv, options), vm);
@@ -68,25 +208,145 @@ int main(const int argc, const char* const* const argv) {
     return EXIT_SUCCESS;
   }
 
+  const auto log_level = eidos::log::ParseLevel(vm["log-level"].as<std::string>());
+  if (!log_level) {
+    std::cerr << "unknown log level: " << vm["log-level"].as<std::string>() << std::endl;
+    return EXIT_FAILURE;
+  }
+  const eidos::log::AsyncLogging logging(log_level.value());
+
   // start server
   BOOST_LOG_TRIVIAL(info) << "starting eidos server";
 
   boost::asio::io_context ioc;
+  // the engine that holds the data records big keys, so a Raft node also tracks the writes replicated to it
+  const auto bigkeys = std::make_shared<eidos::keystats::BigKeys>(vm["bigkeys-threshold"].as<std::size_t>());
+  const auto make_memory_engine = [bigkeys] {
+    return std::make_shared<eidos::keystats::BigKeysEngine>(std::make_shared<eidos::storage::MemoryStorageEngine<>>(),
+                                                            bigkeys);
+  };
   std::shared_ptr<eidos::storage::StorageEngineBase> engine;
   if (vm["engine"].as<std::string>() == "memory") {
     BOOST_LOG_TRIVIAL(info) << "storage engine: memory";
-    engine = std::make_shared<eidos::storage::MemoryStorageEngine<>>();
+    engine = make_memory_engine();
   } else if (vm["engine"].as<std::string>() == "raft") {
-    BOOST_LOG_TRIVIAL(info) << "storage engine: raft";
-    engine = std::make_shared<eidos::storage::RaftStorageEngine>(
-        std::make_shared<eidos::storage::MemoryStorageEngine<>>(), 16379);
+    eidos::storage::RaftOptions raft_options;
+    raft_options.node_id = vm["node-id"].as<int>();
+    raft_options.host = vm["raft-host"].as<std::string>();
+    raft_options.port = vm["raft-port"].as<std::uint16_t>();
+    raft_options.heartbeat_interval = vm["raft-heartbeat-interval"].as<int>();
+    raft_options.election_timeout_lower = vm["raft-election-timeout-lower"].as<int>();
+    raft_options.election_timeout_upper = vm["raft-election-timeout-upper"].as<int>();
+    raft_options.snapshot_distance = vm["raft-snapshot-distance"].as<int>();
+    raft_options.max_append_size = vm["raft-max-append-size"].as<int>();
+    raft_options.batch_size_hint = vm["raft-batch-size-hint"].as<std::int64_t>();
+    if (vm.count("peers")) {
+      for (const auto& spec : vm["peers"].as<std::vector<std::string>>()) {
+        const auto peer = ParsePeer(spec);
+        if (!peer) {
+          BOOST_LOG_TRIVIAL(fatal) << "invalid peer: " << spec << " (expect: ID=HOST:PORT)";
+          return EXIT_FAILURE;
+        }
+        raft_options.peers.emplace_back(peer.value());
+      }
+    }
+    const auto log_sync = vm["raft-log-sync"].as<std::string>();
+    if (log_sync == "commit" || log_sync == "accept") {
+      raft_options.wait_for_commit = log_sync == "commit";
+    } else {
+      BOOST_LOG_TRIVIAL(fatal) << "unknown log sync policy: " << log_sync;
+      return EXIT_FAILURE;
+    }
+
+    const auto log_store = vm["raft-log-store"].as<std::string>();
+    if (log_store == "ring" || log_store == "map") {
+      raft_options.log_store =
+          log_store == "ring" ? eidos::storage::RaftLogStore::kRing : eidos::storage::RaftLogStore::kMap;
+    } else {
+      BOOST_LOG_TRIVIAL(fatal) << "unknown log store: " << log_store;
+      return EXIT_FAILURE;
+    }
+
+    const auto raft_groups = vm["raft-groups"].as<std::size_t>();
+    const auto snapshot_dir =
+        std::filesystem::temp_directory_path() / ("eidos-raft-" + std::to_string(raft_options.node_id));
+    if (raft_groups == 0) {
+      BOOST_LOG_TRIVIAL(fatal) << "number of Raft groups must be > 0";
+      return EXIT_FAILURE;
+    }
+    // group i uses port + i on every node, so the last port must not wrap around
+    const auto last_port_fits = [raft_groups](std::uint16_t port) {
+      return raft_groups - 1 <= static_cast<std::size_t>(std::numeric_limits<std::uint16_t>::max() - port);
+    };
+    if (!last_port_fits(raft_options.port)) {
+      BOOST_LOG_TRIVIAL(fatal) << "Raft port " << raft_options.port << " + " << raft_groups - 1
+                               << " (number of Raft groups - 1) exceeds 65535";
+      return EXIT_FAILURE;
+    }
+    for (const auto& peer : raft_options.peers) {
+      if (!last_port_fits(peer.port)) {
+        BOOST_LOG_TRIVIAL(fatal) << "Raft port of peer " << peer.id << " (" << peer.port << ") + " << raft_groups - 1
+                                 << " (number of Raft groups - 1) exceeds 65535";
+        return EXIT_FAILURE;
+      }
+    }
+    if (raft_groups == 1) {
+      BOOST_LOG_TRIVIAL(info) << "storage engine: raft";
+      engine = std::make_shared<eidos::storage::RaftStorageEngine>(make_memory_engine(), raft_options, snapshot_dir);
+    } else {
+      BOOST_LOG_TRIVIAL(info) << "storage engine: raft (" << raft_groups << " groups)";
+      engine = std::make_shared<eidos::storage::MultiRaftStorageEngine>(raft_groups, raft_options, snapshot_dir,
+                                                                        make_memory_engine);
+    }
   } else {
     BOOST_LOG_TRIVIAL(fatal) << "unknown engine name";
     return EXIT_FAILURE;
   }
 
   // start listen and serve
-  eidos::Serve(ioc, vm["port"].as<std::uint16_t>(), engine);
-  ioc.run();
+  eidos::ServerOptions server_options;
+  server_options.port = vm["port"].as<std::uint16_t>();
+  server_options.slowlog_slower_than = vm["slowlog-log-slower-than"].as<std::int64_t>();
+  server_options.slowlog_max_len = vm["slowlog-max-len"].as<std::size_t>();
+  server_options.metrics_port = vm["metrics-port"].as<std::uint16_t>();
+  server_options.hotkeys_sample_rate = vm["hotkeys-sample-rate"].as<std::uint32_t>();
+  server_options.profile_counters = vm.count("profile-counters") > 0;
+  server_options.client_output_buffer_hard_limit = vm["client-output-buffer-hard-limit"].as<std::size_t>();
+  server_options.client_output_buffer_soft_limit = vm["client-output-buffer-soft-limit"].as<std::size_t>();
+  server_options.client_output_buffer_soft_seconds = vm["client-output-buffer-soft-seconds"].as<std::int64_t>();
+  server_options.maxclients = vm["maxclients"].as<std::size_t>();
+  server_options.timeout = vm["timeout"].as<std::int64_t>();
+  server_options.tcp_keepalive = vm["tcp-keepalive"].as<std::int64_t>();
+  server_options.io_uring = vm.count("io-uring") > 0;
+  server_options.so_busy_poll = vm["so-busy-poll"].as<int>();
+  server_options.unixsocket = vm["unixsocket"].as<std::string>();
+  const auto perm = vm["unixsocketperm"].as<std::string>();
+  if (const auto [ptr, ec] = std::from_chars(perm.data(), perm.data() + perm.size(), server_options.unixsocketperm, 8);
+      ec != std::errc() || ptr != perm.data() + perm.size() || server_options.unixsocketperm > 07777) {
+    BOOST_LOG_TRIVIAL(fatal) << "invalid unixsocketperm: " << perm << " (expect: octal mode)";
+    return EXIT_FAILURE;
+  }
+  if (auto result = eidos::Serve(ioc, server_options, engine, bigkeys); result.is_err()) {
+    BOOST_LOG_TRIVIAL(fatal) << result.err().value();
+    return EXIT_FAILURE;
+  }
+
+  if (const auto& list = vm["cpu-affinity"].as<std::string>(); !list.empty()) {
+    const auto cpus = eidos::busy_poll::ParseCpuList(list);
+    if (!cpus) {
+      BOOST_LOG_TRIVIAL(fatal) << "invalid CPU list: " << list << " (expect: e.g. 2 or 0-3,6)";
+      return EXIT_FAILURE;
+    }
+    if (auto result = eidos::busy_poll::PinCurrentThread(cpus.value()); result.is_err()) {
+      BOOST_LOG_TRIVIAL(fatal) << "failed to pin the io thread: " << result.err().value();
+      return EXIT_FAILURE;
+    }
+    BOOST_LOG_TRIVIAL(info) << "io thread pinned to CPU " << list;
+  }
+  if (vm.count("busy-poll")) {
+    eidos::busy_poll::Run(ioc);
+  } else {
+    ioc.run();
+  }
   return 0;
 }
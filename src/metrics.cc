@@ -0,0 +1,140 @@
+// Copyright 2021 SiLeader and Cerussite.
+//
+// Licensed under the Apache License, Version 2.0 (the “License”);
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an “AS IS” BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "metrics.hpp"
+
+#include <boost/log/trivial.hpp>
+#include <chrono>
+#include <memory>
+#include <string>
+
+#include "asio.hpp"
+#include "log.hpp"
+#include "tcp.hpp"
+
+namespace {
+
+/// max size of HTTP request header
+constexpr std::size_t kMaxRequestSize = 8192;
+
+/// time limit of a metrics connection (reading the request and writing the response)
+constexpr std::chrono::seconds kSessionTimeout(10);
+
+/// HTTP connection of metrics endpoint. one request is served per connection.
+class MetricsSession : public std::enable_shared_from_this<MetricsSession> {
+ private:
+  boost::asio::ip::tcp::socket socket_;
+  boost::asio::streambuf buffer_;
+  std::string response_;
+  std::shared_ptr<eidos::ServerState> state_;
+  boost::asio::steady_timer deadline_;
+
+ public:
+  MetricsSession(boost::asio::ip::tcp::socket socket, std::shared_ptr<eidos::ServerState> state)
+      : socket_(std::move(socket)),
+        buffer_(kMaxRequestSize),
+        response_(),
+        state_(std::move(state)),
+        deadline_(socket_.get_executor()) {}
+
+ public:
+  /// read request and write response.
+  /// the connection is closed if it is not done within [kSessionTimeout]
+  void start() {
+    deadline_.expires_after(kSessionTimeout);
+    deadline_.async_wait([self = shared_from_this()](const boost::system::error_code& ec) {
+      if (ec) {
+        return;
+      }
+      EIDOS_LOG_DEBUG << "metrics connection timed out";
+      boost::system::error_code ignored;
+      self->socket_.close(ignored);
+    });
+
+    boost::asio::async_read_until(
+        socket_, buffer_, "\r\n\r\n",
+        [self = shared_from_this()](const boost::system::error_code& ec, std::size_t length) {
+          if (ec) {
+            EIDOS_LOG_DEBUG << "metrics request read error: " << ec;
+            self->deadline_.cancel();
+            return;
+          }
+          const auto data = boost::asio::buffer_cast<const char*>(self->buffer_.data());
+          const std::string request(data, length);
+          const auto line = request.substr(0, request.find("\r\n"));
+          if (line.rfind("GET /metrics ", 0) == 0 || line.rfind("GET / ", 0) == 0) {
+            self->respond("200 OK", eidos::metrics::Render(*self->state_));
+          } else {
+            self->respond("404 Not Found", "not found\n");
+          }
+        });
+  }
+
+ private:
+  /// write response and close connection
+  /// \param status HTTP status
+  /// \param body response body
+  void respond(const std::string& status, const std::string& body) {
+    response_ = "HTTP/1.1 " + status + "\r\n" +                          //
+                "Content-Type: text/plain; version=0.0.4\r\n" +          //
+                "Content-Length: " + std::to_string(body.size()) + "\r\n" +  //
+                "Connection: close\r\n\r\n" + body;
+    boost::asio::async_write(socket_, boost::asio::buffer(response_),
+                             [self = shared_from_this()](const boost::system::error_code& ec, std::size_t) {
+                               if (ec) {
+                                 EIDOS_LOG_DEBUG << "metrics response write error: " << ec;
+                               }
+                               self->deadline_.cancel();
+                               boost::system::error_code ignored;
+                               self->socket_.shutdown(boost::asio::ip::tcp::socket::shutdown_both, ignored);
+                             });
+  }
+};
+
+/// accept metrics connections
+/// \param acceptor acceptor
+/// \param state server state
+void Accept(const std::shared_ptr<boost::asio::ip::tcp::acceptor>& acceptor,
+            const std::shared_ptr<eidos::ServerState>& state) {
+  acceptor->async_accept([acceptor, state](const boost::system::error_code& ec, boost::asio::ip::tcp::socket socket) {
+    if (ec) {
+      if (ec == boost::asio::error::operation_aborted) {
+        return;
+      }
+      BOOST_LOG_TRIVIAL(error) << "metrics accept error: " << ec;
+      if (eidos::net::tcp::IsResourceError(ec)) {
+        auto backoff = std::make_shared<boost::asio::steady_timer>(acceptor->get_executor(),
+                                                                   eidos::net::tcp::kAcceptBackoff);
+        backoff->async_wait([acceptor, state, backoff](const boost::system::error_code&) { Accept(acceptor, state); });
+        return;
+      }
+    } else {
+      std::make_shared<MetricsSession>(std::move(socket), state)->start();
+    }
+    Accept(acceptor, state);
+  });
+}
+
+}  // namespace
+
+namespace eidos {
+
+void ServeMetrics(boost::asio::io_context& ioc, std::uint16_t port, std::shared_ptr<ServerState> state) {
+  auto acceptor = std::make_shared<boost::asio::ip::tcp::acceptor>(
+      ioc, boost::asio::ip::tcp::endpoint(boost::asio::ip::tcp::v4(), port));
+  Accept(acceptor, state);
+  BOOST_LOG_TRIVIAL(info) << "metrics listening on 0.0.0.0:" << port;
+}
+
+}  // namespace eidos
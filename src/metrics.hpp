@@ -0,0 +1,132 @@
+// Copyright 2021 SiLeader and Cerussite.
+//
+// Licensed under the Apache License, Version 2.0 (the “License”);
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an “AS IS” BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#pragma once
+
+#include <cstdint>
+#include <eidos/histogram.hpp>
+#include <memory>
+#include <sstream>
+#include <string>
+
+#include "asio.hpp"
+#include "info.hpp"
+#include "server.hpp"
+#include "stats.hpp"
+#include "storage/cluster_base.hpp"
+
+namespace eidos::metrics {
+
+/// render metrics in Prometheus text exposition format
+/// \param state server state
+/// \return metrics text
+inline std::string Render(ServerState& state) {
+  const auto& stats = state.stats;
+  std::stringstream ss;
+  const auto family = [&ss](const char* name, const char* type, const char* help) {
+    ss << "# HELP " << name << " " << help << "\n"
+       << "# TYPE " << name << " " << type << "\n";
+  };
+
+  family("eidos_uptime_seconds", "gauge", "Time since the server started.");
+  ss << "eidos_uptime_seconds " << stats.uptime().count() << "\n";
+
+  // commands
+  std::array<std::unique_ptr<histogram::Histogram>, stats::kCommands.size()> latencies;
+  std::array<std::uint64_t, stats::kCommands.size()> failures{};
+  for (std::size_t i = 0; i < stats::kCommands.size(); ++i) {
+    latencies[i] = std::make_unique<histogram::Histogram>();
+    failures[i] = stats.command(i, *latencies[i]);
+  }
+  family("eidos_commands_total", "counter", "Number of executed commands.");
+  for (std::size_t i = 0; i < stats::kCommands.size(); ++i) {
+    ss << "eidos_commands_total{cmd=\"" << info::detail::ToLower(stats::kCommands[i]) << "\"} "
+       << latencies[i]->count() << "\n";
+  }
+  family("eidos_command_failures_total", "counter", "Number of commands that returned an error.");
+  for (std::size_t i = 0; i < stats::kCommands.size(); ++i) {
+    ss << "eidos_command_failures_total{cmd=\"" << info::detail::ToLower(stats::kCommands[i]) << "\"} "
+       << failures[i] << "\n";
+  }
+  family("eidos_command_duration_seconds", "summary", "Execution time of commands.");
+  for (std::size_t i = 0; i < stats::kCommands.size(); ++i) {
+    const auto cmd = info::detail::ToLower(stats::kCommands[i]);
+    const auto& latency = *latencies[i];
+    for (const auto q : {0.5, 0.9, 0.99, 0.999}) {
+      ss << "eidos_command_duration_seconds{cmd=\"" << cmd << "\",quantile=\"" << q << "\"} "
+         << static_cast<double>(latency.percentile(q * 100)) / 1e9 << "\n";
+    }
+    ss << "eidos_command_duration_seconds_sum{cmd=\"" << cmd << "\"} " << static_cast<double>(latency.sum()) / 1e9
+       << "\n"
+       << "eidos_command_duration_seconds_count{cmd=\"" << cmd << "\"} " << latency.count() << "\n";
+  }
+
+  // clients and network
+  family("eidos_connected_clients", "gauge", "Number of connected clients.");
+  ss << "eidos_connected_clients " << stats.connectedClients() << "\n";
+  family("eidos_connections_received_total", "counter", "Number of accepted connections.");
+  ss << "eidos_connections_received_total " << stats.totalConnections() << "\n";
+  family("eidos_net_input_bytes_total", "counter", "Bytes read from clients.");
+  ss << "eidos_net_input_bytes_total " << stats.netInput() << "\n";
+  family("eidos_net_output_bytes_total", "counter", "Bytes written to clients.");
+  ss << "eidos_net_output_bytes_total " << stats.netOutput() << "\n";
+
+  // keyspace and memory
+  if (const auto size = state.engine->size(); size.is_ok()) {
+    family("eidos_keys", "gauge", "Number of stored keys.");
+    ss << "eidos_keys " << size.unwrap() << "\n";
+  }
+  family("eidos_memory_used_bytes", "gauge", "Heap memory in use.");
+  ss << "eidos_memory_used_bytes " << info::UsedMemory() << "\n";
+  family("eidos_memory_rss_bytes", "gauge", "Resident set size.");
+  ss << "eidos_memory_rss_bytes " << info::ResidentSetSize() << "\n";
+
+  // replication
+  const auto cluster = std::dynamic_pointer_cast<storage::ClusterBase>(state.engine);
+  if (cluster) {
+    const auto groups = cluster->groups();
+    const auto gauge = [&](const char* name, const char* type, const char* help, auto&& value) {
+      family(name, type, help);
+      for (std::size_t i = 0; i < groups.size(); ++i) {
+        ss << name << "{group=\"" << i << "\"} " << value(groups[i]) << "\n";
+      }
+    };
+    gauge("eidos_raft_leader", "gauge", "1 if this node is the leader of the group.",
+          [](const storage::RaftStatus& s) { return s.leader == s.id ? 1 : 0; });
+    gauge("eidos_raft_term", "gauge", "Current term.", [](const storage::RaftStatus& s) { return s.term; });
+    gauge("eidos_raft_commit_index", "gauge", "Index of the last committed log entry.",
+          [](const storage::RaftStatus& s) { return s.committed; });
+    gauge("eidos_raft_last_log_index", "gauge", "Index of the last log entry.",
+          [](const storage::RaftStatus& s) { return s.last_log; });
+    gauge("eidos_raft_log_entries", "gauge", "Number of log entries kept in the log store.",
+          [](const storage::RaftStatus& s) { return s.last_log + 1 - std::min(s.log_start, s.last_log + 1); });
+    gauge("eidos_raft_snapshots_total", "counter", "Number of snapshots created or received.",
+          [](const storage::RaftStatus& s) { return s.snapshots; });
+    gauge("eidos_raft_last_snapshot_index", "gauge", "Last log index of the newest snapshot.",
+          [](const storage::RaftStatus& s) { return s.last_snapshot; });
+  }
+  return ss.str();
+}
+
+}  // namespace eidos::metrics
+
+namespace eidos {
+
+/// serve metrics over HTTP (GET /metrics)
+/// \param ioc reference to instance of io_context
+/// \param port listening port
+/// \param state server state
+void ServeMetrics(boost::asio::io_context& ioc, std::uint16_t port, std::shared_ptr<ServerState> state);
+
+}  // namespace eidos
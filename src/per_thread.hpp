@@ -0,0 +1,97 @@
+// Copyright 2021 SiLeader and Cerussite.
+//
+// Licensed under the Apache License, Version 2.0 (the “License”);
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an “AS IS” BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <type_traits>
+#include <unordered_map>
+#include <vector>
+
+namespace eidos::detail {
+
+/// values owned by an object, one for each thread that uses it.
+/// values are created on first use and kept until the object is destroyed.
+/// \tparam T value type. constructed with its creation order (0, 1, ...) if it takes one, otherwise by default
+template <class T>
+class PerThread {
+ private:
+  std::uint64_t id_;
+  mutable std::mutex values_mutex_;
+  std::vector<std::unique_ptr<T>> values_;
+
+ public:
+  PerThread() : id_(NextId()), values_mutex_(), values_() {}
+
+  PerThread(const PerThread&) = delete;
+  PerThread& operator=(const PerThread&) = delete;
+
+ private:
+  /// unique id of [PerThread] instance.
+  /// values are looked up by id since the address may be reused by another instance
+  /// \return id
+  static std::uint64_t NextId() {
+    static std::atomic<std::uint64_t> next(1);
+    return next.fetch_add(1, std::memory_order_relaxed);
+  }
+
+  /// create the value of the calling thread
+  /// \return value
+  T* create() {
+    std::lock_guard lock(values_mutex_);
+    if constexpr (std::is_constructible_v<T, std::size_t>) {
+      values_.emplace_back(std::make_unique<T>(values_.size()));
+    } else {
+      values_.emplace_back(std::make_unique<T>());
+    }
+    return values_.back().get();
+  }
+
+ public:
+  /// value of the calling thread.
+  /// the last instance used by the thread is cached, so the map is searched only when a thread uses several
+  /// instances in turn
+  /// \return value
+  T& local() {
+    thread_local std::uint64_t last_id = 0;
+    thread_local T* last = nullptr;
+    if (last_id != id_) {
+      thread_local std::unordered_map<std::uint64_t, T*> values;
+      auto& value = values[id_];
+      if (value == nullptr) {
+        value = create();
+      }
+      last_id = id_;
+      last = value;
+    }
+    return *last;
+  }
+
+  /// call [f] with each value while new values are not created
+  /// \tparam F callback type
+  /// \param f callback
+  template <class F>
+  void forEach(F&& f) const {
+    std::lock_guard lock(values_mutex_);
+    for (const auto& value : values_) {
+      f(static_cast<const T&>(*value));
+    }
+  }
+};
+
+}  // namespace eidos::detail
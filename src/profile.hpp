@@ -0,0 +1,218 @@
+// Copyright 2021 SiLeader and Cerussite.
+//
+// Licensed under the Apache License, Version 2.0 (the “License”);
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an “AS IS” BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#pragma once
+
+#if defined(__linux__)
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+#include <array>
+#include <atomic>
+#include <boost/log/trivial.hpp>
+#include <cerrno>
+#include <cstdint>
+#include <cstring>
+#include <optional>
+#include <string_view>
+#include <vector>
+
+#include "per_thread.hpp"
+#include "stats.hpp"
+
+namespace eidos::profile {
+
+/// hardware events counted around each command
+inline constexpr std::array<std::string_view, 4> kEvents = {
+    "cycles",
+    "instructions",
+    "cache_misses",
+    "branch_misses",
+};
+
+/// counter values (same order as [kEvents])
+using Values = std::array<std::uint64_t, kEvents.size()>;
+
+namespace detail {
+
+/// perf_event counter group of the calling thread.
+/// user space events only, so that it works with the default perf_event_paranoid (2).
+class CounterGroup {
+ private:
+  std::vector<int> fds_;  // front is the group leader
+
+ public:
+  CounterGroup() : fds_() {
+#if defined(__linux__)
+    constexpr std::array<std::uint64_t, kEvents.size()> kConfigs = {
+        PERF_COUNT_HW_CPU_CYCLES,
+        PERF_COUNT_HW_INSTRUCTIONS,
+        PERF_COUNT_HW_CACHE_MISSES,
+        PERF_COUNT_HW_BRANCH_MISSES,
+    };
+    for (const auto config : kConfigs) {
+      perf_event_attr attr{};
+      attr.type = PERF_TYPE_HARDWARE;
+      attr.size = sizeof(attr);
+      attr.config = config;
+      attr.disabled = fds_.empty() ? 1 : 0;
+      attr.exclude_kernel = 1;
+      attr.exclude_hv = 1;
+      attr.read_format = PERF_FORMAT_GROUP;
+      const int leader = fds_.empty() ? -1 : fds_.front();
+      const auto fd = static_cast<int>(::syscall(SYS_perf_event_open, &attr, 0, -1, leader, 0));
+      if (fd < 0) {
+        BOOST_LOG_TRIVIAL(warning) << "perf_event_open failed: " << std::strerror(errno)
+                                   << ". profile counters are disabled on this thread";
+        close();
+        return;
+      }
+      fds_.push_back(fd);
+    }
+    ::ioctl(fds_.front(), PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP);
+#endif
+  }
+
+  ~CounterGroup() { close(); }
+
+  CounterGroup(const CounterGroup&) = delete;
+  CounterGroup& operator=(const CounterGroup&) = delete;
+
+ private:
+  void close() {
+#if defined(__linux__)
+    for (const auto fd : fds_) {
+      ::close(fd);
+    }
+#endif
+    fds_.clear();
+  }
+
+ public:
+  /// read all counters
+  /// \return values or nullopt if counters are not available
+  std::optional<Values> read() const {
+#if defined(__linux__)
+    if (fds_.empty()) {
+      return std::nullopt;
+    }
+    // PERF_FORMAT_GROUP: number of events followed by values
+    std::array<std::uint64_t, 1 + kEvents.size()> buffer{};
+    if (::read(fds_.front(), buffer.data(), sizeof(buffer)) != static_cast<ssize_t>(sizeof(buffer))) {
+      return std::nullopt;
+    }
+    Values values{};
+    std::copy(std::begin(buffer) + 1, std::end(buffer), std::begin(values));
+    return values;
+#else
+    return std::nullopt;
+#endif
+  }
+};
+
+}  // namespace detail
+
+/// per command hardware counters.
+/// counters of the calling thread are read before and after a command and the difference is added
+/// to the shard owned by the thread. a counter read is a system call, so this is a profiling mode.
+class Profiler {
+ public:
+  /// accumulated counters of a command
+  struct Command {
+    std::uint64_t calls = 0;
+    Values values{};
+  };
+
+ private:
+  struct AtomicCommand {
+    std::atomic<std::uint64_t> calls{0};
+    std::array<std::atomic<std::uint64_t>, kEvents.size()> values{};
+  };
+
+  using Shard = std::array<AtomicCommand, stats::kCommands.size()>;
+
+ private:
+  bool enabled_;
+  eidos::detail::PerThread<Shard> shards_;
+
+ public:
+  /// constructor
+  /// \param enabled true if counters are recorded
+  explicit Profiler(bool enabled) : enabled_(enabled), shards_() {}
+
+  Profiler(const Profiler&) = delete;
+  Profiler& operator=(const Profiler&) = delete;
+
+ private:
+  /// counter group of the calling thread (opened on first use)
+  /// \return counter group
+  static const detail::CounterGroup& counters() {
+    thread_local detail::CounterGroup group;
+    return group;
+  }
+
+  /// add to counter (single writer)
+  static void add(std::atomic<std::uint64_t>& counter, std::uint64_t n) {
+    counter.store(counter.load(std::memory_order_relaxed) + n, std::memory_order_relaxed);
+  }
+
+ public:
+  /// profiling mode is enabled
+  /// \return true if enabled
+  [[nodiscard]] bool enabled() const { return enabled_; }
+
+  /// read counters of the calling thread before a command
+  /// \return counter values or nullopt if disabled or not available
+  [[nodiscard]] std::optional<Values> start() const {
+    if (!enabled_) {
+      return std::nullopt;
+    }
+    return counters().read();
+  }
+
+  /// record counters consumed by a command since [start]
+  /// \param index command index (nullopt: unknown command)
+  /// \param start values returned by [start]
+  void record(std::optional<std::size_t> index, const Values& start) {
+    const auto end = counters().read();
+    if (!end || !index) {
+      return;
+    }
+    auto& command = shards_.local()[index.value()];
+    add(command.calls, 1);
+    for (std::size_t i = 0; i < kEvents.size(); ++i) {
+      add(command.values[i], end.value()[i] - start[i]);
+    }
+  }
+
+  /// merge counters of the command
+  /// \param index command index
+  /// \return accumulated counters
+  [[nodiscard]] Command command(std::size_t index) const {
+    Command command;
+    shards_.forEach([&](const Shard& shard) {
+      const auto& c = shard[index];
+      command.calls += c.calls.load(std::memory_order_relaxed);
+      for (std::size_t i = 0; i < kEvents.size(); ++i) {
+        command.values[i] += c.values[i].load(std::memory_order_relaxed);
+      }
+    });
+    return command;
+  }
+};
+
+}  // namespace eidos::profile
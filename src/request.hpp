@@ -14,35 +14,46 @@
 
 #pragma once
 
+#include <algorithm>
 #include <cstddef>
 #include <cstdint>
 #include <eidos/types.hpp>
 #include <memory>
+#include <optional>
+#include <span>
 #include <string>
 #include <vector>
 
+#include "commands.hpp"
+#include "info.hpp"
+#include "log.hpp"
 #include "server.hpp"
+#include "storage/cluster_base.hpp"
+#include "storage/storage_base.hpp"
+#include "trace.hpp"
+#include "transaction.hpp"
 
 namespace eidos {
 
-/// request received event callback function.
-/// process Redis command.
-/// \tparam F response wrote event callback function type
-/// \param engine storage engine
+/// request received event handler.
+/// process Redis command and append the response to the response context.
+/// \param state server state
+/// \param client client that sent the command
+/// \param transaction transaction state of the session
+/// \param engine storage engine (state.engine, or the transaction view while EXEC runs the queued commands)
 /// \param res response context
-/// \param cmd command name
+/// \param spec command metadata (nullptr: unknown command)
+/// \param cmd command name (upper case)
 /// \param args command arguments
-/// \param callback response wrote event callback function
-template <class F>
-void OnRequest(const std::shared_ptr<eidos::storage::StorageEngineBase>& engine,
-               const std::shared_ptr<ResponseContext>& res, const std::string& cmd,
-               const std::vector<std::vector<std::byte>>& args, F&& callback) {
+inline void OnRequest(ServerState& state, clients::Client& client, transaction::Transaction& transaction,
+                      storage::StorageEngineBase& engine, ResponseContext& res, const commands::Spec* spec,
+                      const std::string& cmd, std::span<const std::vector<std::byte>> args) {
 #define ARGS_LENGTH_ASSERT(len)                                                                    \
   do {                                                                                             \
     if (args.size() != len) {                                                                      \
       BOOST_LOG_TRIVIAL(error) << "invalid number of arguments for " << cmd << " (expect: " << len \
                                << ", actual: " << args.size() << ")";                              \
-      res->err("wrong number of arguments for '" + cmd + "' command", std::forward<F>(callback));  \
+      res.err(commands::Replies::Global().arityError(spec->id));                                   \
       return;                                                                                      \
     }                                                                                              \
   } while (0)
@@ -55,138 +66,479 @@ void OnRequest(const std::shared_ptr<eidos::storage::StorageEngineBase>& engine,
     return std::hash<std::string>{}(eidos::BytesToString(k));
   };
 
-  BOOST_LOG_TRIVIAL(trace) << "command '" << cmd << "' received";
-  if (cmd == "GET") {
-    // GET key
-    ARGS_LENGTH_ASSERT(1);
+  EIDOS_LOG_TRACE << "command '" << cmd << "' received";
+  if (spec == nullptr) {
+    BOOST_LOG_TRIVIAL(error) << "unknown command '" << cmd << "'";
+    res.err("unknown command: " + cmd);
+    transaction.abort();
+    return;
+  }
+  if (!commands::CheckArity(*spec, args.size() + 1)) {
+    BOOST_LOG_TRIVIAL(error) << "invalid number of arguments for " << cmd << " (arity: " << spec->arity
+                             << ", actual: " << args.size() + 1 << ")";
+    res.err(commands::Replies::Global().arityError(spec->id));
+    transaction.abort();
+    return;
+  }
+  if (transaction.active() && spec->id != commands::Id::kExec && spec->id != commands::Id::kDiscard &&
+      spec->id != commands::Id::kMulti && spec->id != commands::Id::kWatch) {
+    transaction.queue(*spec, args);
+    res.okRaw("+QUEUED\r\n");
+    return;
+  }
 
-    Key key(args[0], calculate_digest(args[0]));
-    auto result = engine->get(key);
-    if (result.is_ok()) {
-      auto v = result.unwrap();
-      res->ok(v.bytes(), std::forward<F>(callback));
+  switch (spec->id) {
+    case commands::Id::kGet: {
+      // GET key
+      Key key(args[0], calculate_digest(args[0]));
+      state.hotkeys.record(key);
+      const auto begin = trace::Begin();
+      auto result = engine.get(key);
+      trace::End("engine.get", "storage", begin);
+      if (result.is_ok()) {
+        auto v = result.unwrap();
+        res.ok(v.bytes());
+        return;
+      }
+      const auto err = result.err().value();
+      if (err == eidos::storage::Error::kNotFound) {
+        res.nil();
+        return;
+      }
+      res.err(eidos::storage::Message(err));
       return;
     }
-    const auto err = result.err().value();
-    res->err(err, std::forward<F>(callback));
-    return;
-
-  } else if (cmd == "SET") {
-    // SET key value
-    ARGS_LENGTH_ASSERT(2);
-
-    Key key(args[0], calculate_digest(args[0]));
-    Value value(args[1]);
-    auto result = engine->set(key, value);
-    if (result.is_ok()) {
-      res->ok(std::forward<F>(callback));
+    case commands::Id::kSet: {
+      // SET key value
+      Key key(args[0], calculate_digest(args[0]));
+      Value value(args[1]);
+      state.hotkeys.record(key);
+      const auto begin = trace::Begin();
+      auto result = engine.set(key, value);
+      trace::End("engine.set", "storage", begin);
+      if (result.is_ok()) {
+        res.ok();
+        return;
+      }
+      res.err(eidos::storage::Message(result.err().value()));
       return;
     }
-    const auto err = result.err().value();
-    res->err(err, std::forward<F>(callback));
-    return;
+    case commands::Id::kExists: {
+      // EXISTS key
+      Key key(args[0], calculate_digest(args[0]));
+      state.hotkeys.record(key);
+      const auto begin = trace::Begin();
+      auto result = engine.exists(key);
+      trace::End("engine.exists", "storage", begin);
+      if (result.is_ok()) {
+        res.okRaw(result.unwrap() ? ":1\r\n" : ":0\r\n");
+        return;
+      }
+      res.err(eidos::storage::Message(result.err().value()));
+      return;
+    }
+    case commands::Id::kDel: {
+      // DEL key
+      Key key(args[0], calculate_digest(args[0]));
+      state.hotkeys.record(key);
+      const auto begin = trace::Begin();
+      auto result = engine.del(key);
+      trace::End("engine.del", "storage", begin);
+      if (result.is_ok()) {
+        res.ok();
+        return;
+      }
+      res.err(eidos::storage::Message(result.err().value()));
+      return;
+    }
+    case commands::Id::kKeys: {
+      // KEYS pattern
+      auto pattern = eidos::BytesToString(args[0]);
+      auto result = engine.keys(pattern);
+      if (result.is_ok()) {
+        const auto keys = result.unwrap();
+        std::vector<std::vector<std::byte>> keys_bytes(keys.size());
+        std::transform(std::begin(keys), std::end(keys), std::begin(keys_bytes),
+                       [](const Key& key) { return key.bytes(); });
+        res.ok(keys_bytes);
+        return;
+      }
+      res.err(eidos::storage::Message(result.err().value()));
+      return;
+    }
+    case commands::Id::kRaft: {
+      // RAFT ADD id endpoint
+      // RAFT REMOVE id
+      // RAFT NODES
+      const auto cluster = std::dynamic_pointer_cast<eidos::storage::ClusterBase>(state.engine);
+      if (!cluster) {
+        res.err("cluster commands are not supported by this storage engine");
+        return;
+      }
+      auto sub = eidos::BytesToString(args[0]);
+      commands::ToUpper(sub);
+
+      const auto parse_id = [](const std::vector<std::byte>& bytes) -> std::optional<int> {
+        try {
+          return std::stoi(eidos::BytesToString(bytes));
+        } catch (const std::logic_error&) {
+          return std::nullopt;
+        }
+      };
 
-  } else if (cmd == "EXISTS") {
-    // EXISTS key
-    ARGS_LENGTH_ASSERT(1);
+      if (sub == "ADD" || sub == "REMOVE") {
+        ARGS_LENGTH_ASSERT((sub == "ADD" ? 3u : 2u));
+        const auto id = parse_id(args[1]);
+        if (!id) {
+          res.err("invalid server id");
+          return;
+        }
+        const auto result = sub == "ADD" ? cluster->addServer(id.value(), eidos::BytesToString(args[2]))
+                                         : cluster->removeServer(id.value());
+        if (result.is_ok()) {
+          res.ok();
+          return;
+        }
+        res.err(result.err().value());
+        return;
 
-    Key key(args[0], calculate_digest(args[0]));
-    auto result = engine->exists(key);
-    if (result.is_ok()) {
-      res->okRaw(result.unwrap() ? ":1\r\n" : ":0\r\n", std::forward<F>(callback));
+      } else if (sub == "NODES") {
+        ARGS_LENGTH_ASSERT(1);
+        const auto result = cluster->servers();
+        if (result.is_err()) {
+          res.err(result.err().value());
+          return;
+        }
+        const auto servers = result.unwrap();
+        std::vector<std::vector<std::byte>> nodes(servers.size());
+        std::transform(std::begin(servers), std::end(servers), std::begin(nodes),
+                       [](const eidos::storage::ServerInfo& server) {
+                         const auto line = std::to_string(server.id) + " " + server.endpoint + " " +
+                                           (server.leader ? "leader" : "follower");
+                         std::vector<std::byte> bytes(line.size());
+                         std::transform(std::begin(line), std::end(line), std::begin(bytes),
+                                        [](char c) { return static_cast<std::byte>(c); });
+                         return bytes;
+                       });
+        res.ok(nodes);
+        return;
+      }
+      res.err("unknown subcommand for 'RAFT': " + sub);
       return;
     }
-    const auto err = result.err().value();
-    res->err(err, std::forward<F>(callback));
-    return;
+    case commands::Id::kInfo: {
+      // INFO [section ...]
+      std::vector<std::string> sections(args.size());
+      std::transform(std::begin(args), std::end(args), std::begin(sections),
+                     [](const std::vector<std::byte>& arg) { return eidos::BytesToString(arg); });
+      const auto info = eidos::info::Info(state, sections);
+      std::vector<std::byte> bytes(info.size());
+      std::transform(std::begin(info), std::end(info), std::begin(bytes),
+                     [](char c) { return static_cast<std::byte>(c); });
+      res.ok(bytes);
+      return;
+    }
+    case commands::Id::kLatency: {
+      // LATENCY HISTOGRAM [command ...]
+      auto sub = eidos::BytesToString(args[0]);
+      commands::ToUpper(sub);
+      if (sub != "HISTOGRAM") {
+        res.err("unknown subcommand for 'LATENCY': " + sub);
+        return;
+      }
+      std::vector<std::string> commands(args.size() - 1);
+      std::transform(std::begin(args) + 1, std::end(args), std::begin(commands),
+                     [](const std::vector<std::byte>& arg) { return eidos::BytesToString(arg); });
+      res.okRaw(eidos::info::LatencyHistogram(state, commands));
+      return;
+    }
+    case commands::Id::kSlowlog: {
+      // SLOWLOG GET [count]
+      // SLOWLOG LEN
+      // SLOWLOG RESET
+      auto sub = eidos::BytesToString(args[0]);
+      commands::ToUpper(sub);
 
-  } else if (cmd == "DEL") {
-    // DEL key
-    ARGS_LENGTH_ASSERT(1);
+      if (sub == "GET") {
+        std::size_t count = 10;
+        if (args.size() > 1) {
+          try {
+            count = std::stoul(eidos::BytesToString(args[1]));
+          } catch (const std::logic_error&) {
+            res.err("value is not an integer or out of range");
+            return;
+          }
+        }
+        res.okRaw(eidos::slowlog::Encode(state.slowlog.get(count)));
+        return;
+      } else if (sub == "LEN") {
+        ARGS_LENGTH_ASSERT(1);
+        res.okRaw(":" + std::to_string(state.slowlog.size()) + "\r\n");
+        return;
+      } else if (sub == "RESET") {
+        ARGS_LENGTH_ASSERT(1);
+        state.slowlog.reset();
+        res.ok();
+        return;
+      }
+      res.err("unknown subcommand for 'SLOWLOG': " + sub);
+      return;
+    }
+    case commands::Id::kClient: {
+      // CLIENT LIST
+      // CLIENT KILL ip:port
+      // CLIENT KILL ID id | ADDR ip:port
+      // CLIENT SETNAME name
+      // CLIENT GETNAME
+      // CLIENT ID
+      auto sub = eidos::BytesToString(args[0]);
+      commands::ToUpper(sub);
 
-    Key key(args[0], calculate_digest(args[0]));
-    auto result = engine->del(key);
-    if (result.is_ok()) {
-      res->ok(std::forward<F>(callback));
+      if (sub == "LIST") {
+        ARGS_LENGTH_ASSERT(1);
+        const auto list = state.clients.list();
+        res.okRaw("$" + std::to_string(list.size()) + "\r\n" + list + "\r\n");
+        return;
+      } else if (sub == "KILL") {
+        if (args.size() == 2) {
+          // old form: reply +OK or error
+          if (state.clients.killByAddr(eidos::BytesToString(args[1])) == 0) {
+            res.err("No such client");
+            return;
+          }
+          res.ok();
+          return;
+        }
+        ARGS_LENGTH_ASSERT(3);
+        auto filter = eidos::BytesToString(args[1]);
+        commands::ToUpper(filter);
+        const auto value = eidos::BytesToString(args[2]);
+        std::size_t killed = 0;
+        if (filter == "ID") {
+          try {
+            killed = state.clients.killById(std::stoull(value));
+          } catch (const std::logic_error&) {
+            res.err("client-id should be greater than 0");
+            return;
+          }
+        } else if (filter == "ADDR") {
+          killed = state.clients.killByAddr(value);
+        } else {
+          res.err("syntax error");
+          return;
+        }
+        res.okRaw(":" + std::to_string(killed) + "\r\n");
+        return;
+      } else if (sub == "SETNAME") {
+        ARGS_LENGTH_ASSERT(2);
+        auto name = eidos::BytesToString(args[1]);
+        if (std::any_of(std::begin(name), std::end(name), [](char c) { return c <= ' ' || c > '~'; })) {
+          res.err("Client names cannot contain spaces, newlines or special characters.");
+          return;
+        }
+        client.name = std::move(name);
+        res.ok();
+        return;
+      } else if (sub == "GETNAME") {
+        ARGS_LENGTH_ASSERT(1);
+        if (client.name.empty()) {
+          res.nil();
+          return;
+        }
+        res.okRaw("$" + std::to_string(client.name.size()) + "\r\n" + client.name + "\r\n");
+        return;
+      } else if (sub == "ID") {
+        ARGS_LENGTH_ASSERT(1);
+        res.okRaw(":" + std::to_string(client.id()) + "\r\n");
+        return;
+      }
+      res.err("unknown subcommand for 'CLIENT': " + sub);
       return;
     }
-    const auto err = result.err().value();
-    res->err(err, std::forward<F>(callback));
-    return;
+    case commands::Id::kDebug: {
+      // DEBUG TRACE START
+      // DEBUG TRACE STOP
+      if (args.size() < 2) {
+        ARGS_LENGTH_ASSERT(2);
+      }
+      auto sub = eidos::BytesToString(args[0]);
+      commands::ToUpper(sub);
+      if (sub != "TRACE") {
+        res.err("unknown subcommand for 'DEBUG': " + sub);
+        return;
+      }
+      ARGS_LENGTH_ASSERT(2);
+      auto action = eidos::BytesToString(args[1]);
+      commands::ToUpper(action);
 
-  } else if (cmd == "KEYS") {
-    // KEYS pattern
-    ARGS_LENGTH_ASSERT(1);
+      if (action == "START") {
+        trace::Tracer::Global().start();
+        res.ok();
+        return;
+      } else if (action == "STOP") {
+        // Chrome trace JSON (chrome://tracing, https://ui.perfetto.dev)
+        const auto json = trace::Tracer::Global().stop();
+        res.okRaw("$" + std::to_string(json.size()) + "\r\n" + json + "\r\n");
+        return;
+      }
+      res.err("unknown action for 'DEBUG TRACE': " + action);
+      return;
+    }
+    case commands::Id::kHotkeys:
+    case commands::Id::kBigkeys: {
+      // HOTKEYS [count]
+      // BIGKEYS [count]
+      std::size_t count = 10;
+      if (!args.empty()) {
+        ARGS_LENGTH_ASSERT(1);
+        try {
+          count = std::stoul(eidos::BytesToString(args[0]));
+        } catch (const std::logic_error&) {
+          res.err("value is not an integer or out of range");
+          return;
+        }
+      }
+      // flat array of key and number of accesses (HOTKEYS) or value size (BIGKEYS)
+      const auto encode = [](const auto& keys) {
+        std::stringstream ss;
+        ss << "*" << keys.size() * 2 << "\r\n";
+        for (const auto& [key, n] : keys) {
+          ss << "$" << key.size() << "\r\n" << key << "\r\n:" << n << "\r\n";
+        }
+        return ss.str();
+      };
+      res.okRaw(spec->id == commands::Id::kHotkeys ? encode(state.hotkeys.top(count))
+                                                   : encode(state.bigkeys->top(count)));
+      return;
+    }
+    case commands::Id::kMemory: {
+      // MEMORY USAGE key
+      auto sub = eidos::BytesToString(args[0]);
+      commands::ToUpper(sub);
+      if (sub != "USAGE") {
+        res.err("unknown subcommand for 'MEMORY': " + sub);
+        return;
+      }
+      ARGS_LENGTH_ASSERT(2);
 
-    auto pattern = eidos::BytesToString(args[0]);
-    auto result = engine->keys(pattern);
-    if (result.is_ok()) {
-      const auto keys = result.unwrap();
-      std::vector<std::vector<std::byte>> keys_bytes(keys.size());
-      std::transform(std::begin(keys), std::end(keys), std::begin(keys_bytes),
-                     [](const Key& key) { return key.bytes(); });
-      res->ok(keys_bytes, std::forward<F>(callback));
+      Key key(args[1], calculate_digest(args[1]));
+      const auto value = engine.get(key);
+      if (value.is_err()) {
+        if (value.err().value() == eidos::storage::Error::kNotFound) {
+          res.nil();
+        } else {
+          res.err(eidos::storage::Message(value.err().value()));
+        }
+        return;
+      }
+      res.okRaw(":" + std::to_string(eidos::keystats::MemoryUsage(key, value.unwrap())) + "\r\n");
+      return;
+    }
+    case commands::Id::kCommand: {
+      // COMMAND
+      // COMMAND COUNT
+      // COMMAND INFO name [name ...]
+      // redis-cli send this command before any commands. replies are built from the command table once
+      const auto& replies = commands::Replies::Global();
+      if (args.empty()) {
+        res.okRaw(replies.command());
+        return;
+      }
+      auto sub = eidos::BytesToString(args[0]);
+      commands::ToUpper(sub);
+      if (sub == "COUNT") {
+        ARGS_LENGTH_ASSERT(1);
+        res.okRaw(replies.count());
+        return;
+      } else if (sub == "INFO") {
+        res.okRaw("*" + std::to_string(args.size() - 1) + "\r\n");
+        for (const auto& name : args.subspan(1)) {
+          const auto* info = commands::Lookup(name);
+          res.okRaw(info != nullptr ? std::string_view(replies.entry(info->id)) : std::string_view("*-1\r\n"));
+        }
+        return;
+      }
+      res.err("unknown subcommand for 'COMMAND': " + sub);
+      return;
+    }
+    case commands::Id::kMulti: {
+      // MULTI
+      if (transaction.active()) {
+        res.err("MULTI calls can not be nested");
+        return;
+      }
+      transaction.begin();
+      res.ok();
+      return;
+    }
+    case commands::Id::kExec: {
+      // EXEC
+      // the queued commands run against a view that buffers their writes, and the writes are applied as one batch
+      if (!transaction.active()) {
+        res.err("EXEC without MULTI");
+        return;
+      }
+      const auto aborted = transaction.aborted();
+      const auto changed = transaction.changed(engine);
+      const auto watched = transaction.watched();
+      const auto queued = transaction.finish();
+      if (aborted) {
+        res.err("EXECABORT", "Transaction discarded because of previous errors.");
+        return;
+      }
+      if (changed) {
+        // a watched key was written. the stamps are checked again when the batch is applied
+        res.okRaw("*-1\r\n");
+        return;
+      }
+      transaction::BufferedEngine buffered(engine);
+      res.okRaw("*" + std::to_string(queued.size()) + "\r\n");
+      for (const auto& command : queued) {
+        OnRequest(state, client, transaction, buffered, res, command.spec, std::string(command.spec->name),
+                  command.args);
+      }
+      const auto begin = trace::Begin();
+      const auto result = buffered.commit(watched);
+      trace::End("engine.apply", "storage", begin);
+      if (result.is_err()) {
+        res.rollback();
+        if (result.err().value() == eidos::storage::Error::kWatchConflict) {
+          res.okRaw("*-1\r\n");
+        } else {
+          res.err(eidos::storage::Message(result.err().value()));
+        }
+        return;
+      }
+      return;
+    }
+    case commands::Id::kDiscard: {
+      // DISCARD
+      if (!transaction.active()) {
+        res.err("DISCARD without MULTI");
+        return;
+      }
+      transaction.finish();
+      res.ok();
+      return;
+    }
+    case commands::Id::kWatch: {
+      // WATCH key [key ...]
+      if (transaction.active()) {
+        res.err("WATCH inside MULTI is not allowed");
+        return;
+      }
+      for (const auto& arg : args) {
+        transaction.watch(engine, Key(arg, calculate_digest(arg)));
+      }
+      res.ok();
+      return;
+    }
+    case commands::Id::kUnwatch: {
+      // UNWATCH
+      transaction.unwatch();
+      res.ok();
       return;
     }
-    const auto err = result.err().value();
-    res->err(err, std::forward<F>(callback));
-    return;
-  } else if (cmd == "COMMAND") {
-    // COMMAND
-    // redis-cli send this command before any commands
-    static constexpr char NL[] = "\r\n";
-    std::stringstream ss;
-    ss << "*5" << NL         //
-                             //
-       << "*7" << NL         // 1 get
-       << "$3" << NL         //
-       << "get" << NL        // get
-       << ":1" << NL         // arity
-       << "*1" << NL         //
-       << "+readonly" << NL  //
-       << ":1" << NL << ":1" << NL << ":0" << NL << "*0"
-       << NL  //
-       //
-       << "*7" << NL        // 2 set
-       << "$3" << NL        //
-       << "set" << NL       // set
-       << ":2" << NL        // arity
-       << "*2" << NL        //
-       << "+write" << NL    //
-       << "+denyoom" << NL  //
-       << ":1" << NL << ":1" << NL << ":0" << NL << "*0"
-       << NL  //
-       //
-       << "*7" << NL         // 3 exists
-       << "$6" << NL         //
-       << "exists" << NL     // exists
-       << ":1" << NL         // arity
-       << "*1" << NL         //
-       << "+readonly" << NL  //
-       << ":1" << NL << ":1" << NL << ":0" << NL << "*0"
-       << NL  //
-       //
-       << "*7" << NL      // 4 del
-       << "$3" << NL      //
-       << "del" << NL     // del
-       << ":1" << NL      // arity
-       << "*1" << NL      //
-       << "+write" << NL  //
-       << ":1" << NL << ":1" << NL << ":0" << NL << "*0"
-       << NL  //
-       //
-       << "*7" << NL                                             // 5 keys
-       << "$4" << NL                                             //
-       << "keys" << NL                                           // keys
-       << ":1" << NL                                             // arity
-       << "*1" << NL                                             //
-       << "+readonly" << NL                                      //
-       << ":0" << NL << ":0" << NL << ":0" << NL << "*0" << NL;  //
-    res->okRaw(ss.str(), std::forward<F>(callback));
-  } else {
-    BOOST_LOG_TRIVIAL(error) << "unknown command '" << cmd << "'";
-    res->err("unknown command: " + cmd, std::forward<F>(callback));
-    return;
   }
 #undef ARGS_LENGTH_ASSERT
 }
@@ -12,59 +12,328 @@
 // See the License for the specific language governing permissions and
 // limitations under the License.
 
-#include <boost/asio.hpp>
+#include <algorithm>
 #include <boost/log/trivial.hpp>
+#include <chrono>
 #include <cstdint>
+#include <memory>
+#include <optional>
+#include <span>
 #include <string>
+#include <vector>
 
+#include "asio.hpp"
+#include "busy_poll.hpp"
+#include "commands.hpp"
 #include "context.hpp"
+#include "local.hpp"
+#include "metrics.hpp"
 #include "request.hpp"
 #include "storage/storage_base.hpp"
 #include "tcp.hpp"
+#include "trace.hpp"
+#include "transaction.hpp"
+#ifdef EIDOS_IO_URING
+#include "uring.hpp"
+#endif
 
 namespace {
 
-/// request parameter read event handler
-/// \param engine storage engine
-/// \param context request context
-/// \param params parameters
-void OnParamsRead(const std::shared_ptr<eidos::storage::StorageEngineBase>& engine,
-                  std::shared_ptr<eidos::RequestContext> context, const std::vector<std::vector<std::byte>>& params) {
-  auto res = context->response();
-  auto cmd = eidos::BytesToString(params.front());
-  // command name convert to uppercase
-  std::transform(std::begin(cmd), std::end(cmd), std::begin(cmd), ::toupper);
+/// execute a parsed request and record its statistics
+/// \tparam P client address function type
+/// \param state server state
+/// \param client client of the session
+/// \param transaction transaction state of the session
+/// \param res response context
+/// \param params command name and arguments
+/// \param request_size request size (bytes)
+/// \param cmd command name buffer (reused by the session)
+/// \param peer client address function
+template <class P>
+void Execute(eidos::ServerState& state, eidos::clients::Client& client, eidos::transaction::Transaction& transaction,
+             eidos::ResponseContext& res, const std::vector<std::vector<std::byte>>& params, std::size_t request_size,
+             std::string& cmd, P&& peer) {
+  // look up the command over the raw bytes. only an unknown command name is copied and converted to upper case
+  const auto* spec = eidos::commands::Lookup(params.front());
+  std::optional<std::size_t> index;
+  if (spec != nullptr) {
+    cmd.assign(spec->name);
+    index = static_cast<std::size_t>(spec->id);
+  } else {
+    cmd.assign(reinterpret_cast<const char*>(params.front().data()), params.front().size());
+    eidos::commands::ToUpper(cmd);
+  }
 
-  // repack command arguments
-  std::vector<std::vector<std::byte>> args(std::begin(params) + 1, std::end(params));
+  eidos::trace::Scope span("dispatch", "server", spec != nullptr ? spec->name : "unknown");
+  res.begin();
+  client.commands++;
+  client.last_command = cmd;
 
   // call on request handler
-  eidos::OnRequest(engine, res, cmd, args, [context = std::move(context), engine](bool) {
-    // start to read next command
-    context->read([context, engine](const std::vector<std::vector<std::byte>>& params) {
-      OnParamsRead(engine, context, params);
-    });
-  });
+  const auto counters = state.profiler.start();
+  const auto start = std::chrono::steady_clock::now();
+  eidos::OnRequest(state, client, transaction, *state.engine, res, spec, cmd, std::span(params).subspan(1));
+  const auto elapsed = std::chrono::steady_clock::now() - start;
+  if (counters) {
+    state.profiler.record(index, counters.value());
+  }
+  state.stats.record(index, elapsed, res.failed(), request_size, res.written());
+  state.slowlog.record(elapsed, params, std::forward<P>(peer),
+                       [&client]() -> const std::string& { return client.name; });
+}
+
+/// client session.
+/// reads requests, executes all requests already received (pipelining) and flushes the responses.
+/// parsing pauses while the output is over ResponseContext::kPauseSize, so a client that does not read its replies
+/// stops being served instead of growing the output buffer.
+/// \tparam Connection connection type (tcp::Connection, local::Connection or uring::Connection)
+/// \param state server state
+/// \param connection accepted connection (owned by the coroutine frame)
+template <class Connection>
+boost::asio::awaitable<void> Session(std::shared_ptr<eidos::ServerState> state, Connection connection) {
+  const auto& options = state->options;
+  boost::system::error_code ec;
+  if (state->clients.size() >= options.maxclients) {
+    static constexpr std::string_view kRejected = "-ERR max number of clients reached\r\n";
+    state->stats.rejected();
+    co_await connection.async_write(boost::asio::buffer(kRejected),
+                                    boost::asio::redirect_error(boost::asio::use_awaitable, ec));
+    co_return;
+  }
+
+  const eidos::stats::ClientGuard guard(state->stats);
+  eidos::clients::Client client(state->clients, connection.peer());
+  const auto get_peer = [&client]() -> const std::string& { return client.addr(); };
+  // CLIENT KILL and the idle timeout cancel the pending operation, and the session ends at the next check
+  client.onKill([&connection] { connection.cancel(); });
+
+  // client output buffer soft limit.
+  // a write blocked by a client that stopped reading is canceled by the timer when the duration elapses.
+  // the timer handler may run after the session ended, so the state is shared with it.
+  struct SoftLimit {
+    bool writing = false;
+    bool expired = false;
+  };
+  const auto soft_limit = options.client_output_buffer_soft_limit;
+  const auto soft_seconds = std::chrono::seconds(options.client_output_buffer_soft_seconds);
+  const auto soft = std::make_shared<SoftLimit>();
+  boost::asio::steady_timer soft_timer(co_await boost::asio::this_coro::executor);
+  std::optional<std::chrono::steady_clock::time_point> soft_since;  // soft limit exceeded continuously since
+  const auto over_soft_limit = [&](std::size_t pending) {
+    if (soft_limit == 0 || pending <= soft_limit) {
+      soft_since.reset();
+      return false;
+    }
+    const auto now = std::chrono::steady_clock::now();
+    if (!soft_since) {
+      soft_since = now;
+    }
+    return now - soft_since.value() >= soft_seconds;
+  };
+  const auto limit_reached = [&](const char* limit) {
+    BOOST_LOG_TRIVIAL(warning) << "client output buffer " << limit << " limit reached, closing connection (peer: "
+                               << get_peer() << ")";
+    state->stats.outputBufferLimitReached();
+  };
+
+  eidos::RequestContext req;
+  eidos::ResponseContext res;
+  res.setLimit(options.client_output_buffer_hard_limit);
+  std::vector<std::vector<std::byte>> params;
+  std::string cmd;
+  eidos::transaction::Transaction transaction;
+  bool paused = false;  // requests are left in the receive buffer until the output is flushed
+  for (;;) {
+    if (!paused) {
+      // wait for readiness before borrowing a receive buffer, so idle connections hold no buffer
+      if (req.idle()) {
+        co_await connection.async_wait_read(boost::asio::redirect_error(boost::asio::use_awaitable, ec));
+      }
+
+      // read
+      std::size_t length = 0;
+      if (!ec) {
+        const auto [data, size] = req.prepare();
+        const auto begin = eidos::trace::Begin();
+        length = co_await connection.async_read_some(boost::asio::buffer(data, size),
+                                                     boost::asio::redirect_error(boost::asio::use_awaitable, ec));
+        eidos::trace::End("read", "net", begin);
+      }
+      if (ec) {
+        if (client.killed()) {
+          EIDOS_LOG_TRACE << "client killed (peer: " << get_peer() << ")";
+        } else if (ec == boost::asio::error::eof || ec == boost::asio::error::connection_reset) {
+          EIDOS_LOG_TRACE << "connection closed by peer (peer: " << get_peer() << ")";
+        } else {
+          BOOST_LOG_TRIVIAL(error) << "read error: " << ec.message() << " (peer: " << get_peer() << ")";
+        }
+        co_return;
+      }
+      req.commit(length);
+      client.net_input += length;
+      client.touch();
+    }
+
+    // parse and execute. parsing stops while the output is over the backpressure threshold
+    auto status = eidos::RequestContext::Status::kComplete;
+    paused = false;
+    while (!paused && (status = req.parse(params)) == eidos::RequestContext::Status::kComplete) {
+      if (!params.empty()) {
+        Execute(*state, client, transaction, res, params, req.requestSize(), cmd, get_peer);
+      }
+      paused = res.buffer().size() >= eidos::ResponseContext::kPauseSize;
+    }
+    if (res.overflowed()) {
+      limit_reached("hard");
+      co_return;
+    }
+    if (status == eidos::RequestContext::Status::kError) {
+      BOOST_LOG_TRIVIAL(error) << "protocol error: " << req.error() << " (peer: " << get_peer() << ")";
+      res.begin();
+      res.err("Protocol error: " + req.error());
+    }
+
+    // flush. large output is written in chunks and the soft limit is checked between them
+    const auto& output = res.buffer();
+    for (std::size_t written = 0; written < output.size();) {
+      if (over_soft_limit(output.size() - written)) {
+        limit_reached("soft");
+        co_return;
+      }
+      const auto armed = soft_since.has_value();
+      if (armed) {
+        soft_timer.expires_at(soft_since.value() + soft_seconds);
+        soft_timer.async_wait([weak = std::weak_ptr(soft), &connection](const boost::system::error_code& error) {
+          if (const auto limit = weak.lock(); limit && limit->writing && !error) {
+            limit->expired = true;
+            connection.cancel();
+          }
+        });
+      }
+      const auto chunk = std::min(output.size() - written, eidos::ResponseContext::kPauseSize);
+      const auto begin = eidos::trace::Begin();
+      soft->writing = true;
+      co_await connection.async_write(boost::asio::buffer(output.data() + written, chunk),
+                                      boost::asio::redirect_error(boost::asio::use_awaitable, ec));
+      soft->writing = false;
+      if (armed) {
+        soft_timer.cancel();
+      }
+      eidos::trace::End("write", "net", begin);
+      if (ec) {
+        if (client.killed()) {
+          EIDOS_LOG_TRACE << "client killed (peer: " << get_peer() << ")";
+        } else if (soft->expired) {
+          limit_reached("soft");
+        } else {
+          BOOST_LOG_TRIVIAL(error) << "write error: " << ec.message() << " (peer: " << get_peer() << ")";
+        }
+        co_return;
+      }
+      written += chunk;
+    }
+    if (!output.empty()) {
+      EIDOS_LOG_TRACE << output.size() << " bytes wrote (peer: " << get_peer() << ")";
+    }
+    soft_since.reset();
+    client.net_output += output.size();
+    res.clear();
+    req.release(params);
+    client.output_memory = res.buffer().capacity();
+    client.query_buffer = req.buffered();
+    client.query_buffer_free = req.capacity() - req.buffered();
+    if (status == eidos::RequestContext::Status::kError || client.killed()) {
+      // the connection is closed when the session ends
+      co_return;
+    }
+  }
+}
+
+/// close clients idle longer than the timeout (checked every second)
+/// \param state server state
+boost::asio::awaitable<void> ReapIdleClients(std::shared_ptr<eidos::ServerState> state) {
+  const auto timeout = std::chrono::seconds(state->options.timeout);
+  boost::asio::steady_timer timer(co_await boost::asio::this_coro::executor);
+  for (;;) {
+    timer.expires_after(std::chrono::seconds(1));
+    co_await timer.async_wait(boost::asio::use_awaitable);
+    if (const auto killed = state->clients.killIdle(timeout); killed > 0) {
+      EIDOS_LOG_DEBUG << killed << " idle clients closed";
+    }
+  }
 }
 
 }  // namespace
 
 namespace eidos {
 
-void Serve(boost::asio::io_context& ioc, std::uint16_t port,
-           std::shared_ptr<eidos::storage::StorageEngineBase> engine) {
-  auto server =
-      std::make_shared<net::tcp::Server>(ioc, boost::asio::ip::tcp::endpoint(boost::asio::ip::tcp::v4(), port));
+eidos::result::Result<void, std::string> Serve(boost::asio::io_context& ioc, const ServerOptions& options,
+                                               std::shared_ptr<eidos::storage::StorageEngineBase> engine,
+                                               std::shared_ptr<keystats::BigKeys> bigkeys) {
+  using Result = eidos::result::Result<void, std::string>;
+  const auto port = options.port;
+  if (port == 0 && options.unixsocket.empty()) {
+    return Result::Err("no listener (port is 0 and no Unix domain socket is set)");
+  }
+  auto state = std::make_shared<ServerState>(std::move(engine), options, std::move(bigkeys));
+
+  const auto spawn = [&ioc, state](auto connection) {
+    boost::asio::co_spawn(ioc, Session(state, std::move(connection)), boost::asio::detached);
+  };
+
+  // Unix domain socket for co-located clients. served by the reactor with the same session as TCP
+  if (!options.unixsocket.empty()) {
+    if (auto result = net::local::Listen(ioc, options.unixsocket, options.unixsocketperm, spawn); result.is_err()) {
+      return Result::Err("failed to listen on Unix domain socket: " + result.err().value());
+    }
+    BOOST_LOG_TRIVIAL(info) << "listening on " << options.unixsocket;
+  }
 
-  server->listen([server, engine = std::move(engine)](const std::shared_ptr<net::tcp::Socket>& socket) {
-    auto context = std::make_shared<RequestContext>(socket);
-    const auto callback = [context, engine](const std::vector<std::vector<std::byte>>& params) {
-      OnParamsRead(engine, context, params);
+  if (port != 0) {
+    const boost::asio::ip::tcp::endpoint endpoint(boost::asio::ip::tcp::v4(), port);
+    const auto keepalive = static_cast<int>(options.tcp_keepalive);
+    const auto so_busy_poll = options.so_busy_poll;
+    const auto on_accept = [spawn, keepalive, so_busy_poll](auto connection) {
+      if (keepalive > 0) {
+        net::tcp::SetKeepAlive(connection.nativeHandle(), keepalive);
+      }
+      if (so_busy_poll > 0) {
+        busy_poll::SetSocketBusyPoll(connection.nativeHandle(), so_busy_poll);
+      }
+      spawn(std::move(connection));
     };
 
-    context->read(callback);
-  });
-  BOOST_LOG_TRIVIAL(info) << "listening on 0.0.0.0:" << port;
+    bool listening = false;
+#ifdef EIDOS_IO_URING
+    if (options.io_uring) {
+      if (auto ring = net::uring::Ring::Create(ioc); ring.is_ok()) {
+        net::uring::Listen(ring.unwrap(), endpoint, on_accept);
+        BOOST_LOG_TRIVIAL(info) << "listening on 0.0.0.0:" << port << " (io_uring)";
+        listening = true;
+      } else {
+        BOOST_LOG_TRIVIAL(warning) << "io_uring is not available, fallback to epoll: " << ring.err().value();
+      }
+    }
+#else
+    if (options.io_uring) {
+      BOOST_LOG_TRIVIAL(warning) << "io_uring support is not compiled in (EIDOS_IO_URING=OFF), fallback to epoll";
+    }
+#endif
+
+    if (!listening) {
+      net::tcp::Listen(ioc, endpoint, on_accept);
+      BOOST_LOG_TRIVIAL(info) << "listening on 0.0.0.0:" << port;
+    }
+  }
+
+  if (options.timeout != 0) {
+    boost::asio::co_spawn(ioc, ReapIdleClients(state), boost::asio::detached);
+  }
+
+  if (options.metrics_port != 0) {
+    ServeMetrics(ioc, options.metrics_port, state);
+  }
+  return Result::Ok();
 }
 
 }  // namespace eidos
@@ -14,16 +14,71 @@
 
 #pragma once
 
-#include <boost/asio.hpp>
+#include <eidos/result.hpp>
+#include <memory>
+#include <string>
 
+#include "asio.hpp"
+#include "clients.hpp"
+#include "keystats.hpp"
+#include "profile.hpp"
+#include "slowlog.hpp"
+#include "stats.hpp"
 #include "storage/storage_base.hpp"
 
 namespace eidos {
 
+/// server options
+struct ServerOptions {
+  std::uint16_t port = 6379;    // 0: no TCP listener
+  std::string unixsocket = {};  // Unix domain socket path, empty: disabled
+  unsigned unixsocketperm = 0;  // permission bits of the socket file, 0: umask default
+  std::int64_t slowlog_slower_than = 10000;  // us, negative: disabled
+  std::size_t slowlog_max_len = 128;
+  std::uint16_t metrics_port = 0;          // 0: disabled
+  std::uint32_t hotkeys_sample_rate = 16;  // 1 in N accesses, 0: disabled
+  bool profile_counters = false;
+  std::size_t client_output_buffer_hard_limit = 0;     // bytes, 0: disabled
+  std::size_t client_output_buffer_soft_limit = 0;     // bytes, 0: disabled
+  std::int64_t client_output_buffer_soft_seconds = 0;  // s
+  std::size_t maxclients = 10000;
+  std::int64_t timeout = 0;          // idle timeout (s), 0: disabled
+  std::int64_t tcp_keepalive = 300;  // s, 0: disabled
+  int so_busy_poll = 0;              // SO_BUSY_POLL of TCP connections (us), 0: disabled
+  bool io_uring = false;             // requires EIDOS_IO_URING build, falls back to epoll if unavailable
+};
+
+/// state shared by all client sessions of the server
+struct ServerState {
+  std::shared_ptr<eidos::storage::StorageEngineBase> engine;
+  ServerOptions options;
+  stats::Stats stats;
+  slowlog::SlowLog slowlog;
+  keystats::HotKeys hotkeys;
+  std::shared_ptr<keystats::BigKeys> bigkeys;  // fed by the keystats::BigKeysEngine wrapping the storage
+  profile::Profiler profiler;
+  clients::Registry clients;
+
+  ServerState(std::shared_ptr<eidos::storage::StorageEngineBase> engine, const ServerOptions& options,
+              std::shared_ptr<keystats::BigKeys> bigkeys)
+      : engine(std::move(engine)),
+        options(options),
+        stats(),
+        slowlog(options.slowlog_slower_than, options.slowlog_max_len),
+        hotkeys(options.hotkeys_sample_rate),
+        bigkeys(std::move(bigkeys)),
+        profiler(options.profile_counters),
+        clients() {}
+};
+
 /// listen and serve
 /// \param ioc reference to instance of io_context
-/// \param port listening port
+/// \param options server options
 /// \param engine storage engine
-void Serve(boost::asio::io_context& ioc, std::uint16_t port, std::shared_ptr<eidos::storage::StorageEngineBase> engine);
+/// \param bigkeys big key tracker recorded by the engine (keystats::BigKeysEngine)
+/// \return error message if no listener could be started
+eidos::result::Result<void, std::string> Serve(boost::asio::io_context& ioc, const ServerOptions& options,
+                                               std::shared_ptr<eidos::storage::StorageEngineBase> engine,
+                                               std::shared_ptr<keystats::BigKeys> bigkeys);
 
 }  // namespace eidos
@@ -0,0 +1,159 @@
+// Copyright 2021 SiLeader and Cerussite.
+//
+// Licensed under the Apache License, Version 2.0 (the “License”);
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an “AS IS” BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <sstream>
+#include <string>
+#include <vector>
+
+namespace eidos::slowlog {
+
+/// max number of arguments kept by an entry
+inline constexpr std::size_t kMaxArgs = 32;
+
+/// max length of an argument kept by an entry
+inline constexpr std::size_t kMaxArgLength = 128;
+
+/// slow log entry
+struct Entry {
+  std::uint64_t id = 0;
+  std::int64_t timestamp = 0;  // unix time (s)
+  std::uint64_t duration = 0;  // execution time (us)
+  std::vector<std::string> args = {};
+  std::string client = {};       // client address
+  std::string client_name = {};  // name set by CLIENT SETNAME
+};
+
+/// log of commands that exceeded the execution time threshold.
+/// entries are kept in a fixed size ring buffer and the oldest entry is overwritten.
+class SlowLog {
+ private:
+  std::atomic<std::int64_t> slower_than_;  // threshold (us), negative: disabled
+  mutable std::mutex mutex_;
+  std::vector<Entry> entries_;
+  std::size_t head_;  // next write position
+  std::size_t size_;
+  std::uint64_t next_id_;
+
+ public:
+  /// constructor
+  /// \param slower_than threshold of execution time (us). negative value disables the log
+  /// \param max_len max number of entries
+  SlowLog(std::int64_t slower_than, std::size_t max_len)
+      : slower_than_(slower_than), mutex_(), entries_(max_len), head_(0), size_(0), next_id_(0) {}
+
+ public:
+  /// record the command if it exceeded the threshold.
+  /// commands under the threshold return without taking the lock or allocating.
+  /// \tparam Args command arguments type (vector of bytes)
+  /// \tparam F client address provider type
+  /// \tparam G client name provider type
+  /// \param duration execution time
+  /// \param args command name and arguments
+  /// \param client client address provider (called only if the command is recorded)
+  /// \param client_name client name provider (called only if the command is recorded)
+  template <class Args, class F, class G>
+  void record(std::chrono::nanoseconds duration, const Args& args, F&& client, G&& client_name) {
+    const auto us = std::chrono::duration_cast<std::chrono::microseconds>(duration).count();
+    const auto slower_than = slower_than_.load(std::memory_order_relaxed);
+    if (slower_than < 0 || us < slower_than || entries_.empty()) {
+      return;
+    }
+
+    Entry entry{0, std::chrono::duration_cast<std::chrono::seconds>(
+                       std::chrono::system_clock::now().time_since_epoch())
+                       .count(),
+                static_cast<std::uint64_t>(us), {}, client(), client_name()};
+    const auto argc = std::min(args.size(), kMaxArgs);
+    for (std::size_t i = 0; i < argc; ++i) {
+      if (i + 1 == kMaxArgs && args.size() > kMaxArgs) {
+        entry.args.emplace_back("... (" + std::to_string(args.size() - kMaxArgs + 1) + " more arguments)");
+        break;
+      }
+      const auto& arg = args[i];
+      const auto length = std::min(arg.size(), kMaxArgLength);
+      std::string s(length, '\0');
+      std::transform(std::begin(arg), std::begin(arg) + static_cast<std::ptrdiff_t>(length), std::begin(s),
+                     [](std::byte b) { return static_cast<char>(b); });
+      if (arg.size() > kMaxArgLength) {
+        s += "... (" + std::to_string(arg.size() - kMaxArgLength) + " more bytes)";
+      }
+      entry.args.emplace_back(std::move(s));
+    }
+
+    std::lock_guard lock(mutex_);
+    entry.id = next_id_++;
+    entries_[head_] = std::move(entry);
+    head_ = (head_ + 1) % entries_.size();
+    size_ = std::min(size_ + 1, entries_.size());
+  }
+
+ public:
+  /// newest entries
+  /// \param count max number of entries
+  /// \return entries (newest first)
+  [[nodiscard]] std::vector<Entry> get(std::size_t count) const {
+    std::lock_guard lock(mutex_);
+    std::vector<Entry> entries;
+    for (std::size_t i = 0; i < std::min(count, size_); ++i) {
+      entries.push_back(entries_[(head_ + entries_.size() - 1 - i) % entries_.size()]);
+    }
+    return entries;
+  }
+
+  /// number of entries
+  /// \return number of entries
+  [[nodiscard]] std::size_t size() const {
+    std::lock_guard lock(mutex_);
+    return size_;
+  }
+
+  /// remove all entries
+  void reset() {
+    std::lock_guard lock(mutex_);
+    head_ = 0;
+    size_ = 0;
+  }
+};
+
+/// encode entries as SLOWLOG GET response
+/// \param entries entries
+/// \return RESP encoded response
+inline std::string Encode(const std::vector<Entry>& entries) {
+  static constexpr char NL[] = "\r\n";
+  std::stringstream ss;
+  ss << "*" << entries.size() << NL;
+  for (const auto& entry : entries) {
+    ss << "*6" << NL                          //
+       << ":" << entry.id << NL               // id
+       << ":" << entry.timestamp << NL        // unix time
+       << ":" << entry.duration << NL         // execution time (us)
+       << "*" << entry.args.size() << NL;     // arguments
+    for (const auto& arg : entry.args) {
+      ss << "$" << arg.size() << NL << arg << NL;
+    }
+    ss << "$" << entry.client.size() << NL << entry.client << NL              // client address
+       << "$" << entry.client_name.size() << NL << entry.client_name << NL;  // client name
+  }
+  return ss.str();
+}
+
+}  // namespace eidos::slowlog
@@ -0,0 +1,190 @@
+// Copyright 2021 SiLeader and Cerussite.
+//
+// Licensed under the Apache License, Version 2.0 (the “License”);
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an “AS IS” BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <eidos/histogram.hpp>
+#include <optional>
+#include <string>
+#include <string_view>
+
+#include "commands.hpp"
+#include "per_thread.hpp"
+
+namespace eidos::stats {
+
+/// commands that have statistics (names of commands::kTable, indexed by commands::Id)
+inline constexpr std::array<std::string_view, commands::kTable.size()> kCommands = [] {
+  std::array<std::string_view, commands::kTable.size()> names{};
+  for (std::size_t i = 0; i < names.size(); ++i) {
+    names[i] = commands::kTable[i].name;
+  }
+  return names;
+}();
+
+/// server statistics.
+/// counters are recorded to the shard owned by the calling thread and merged on read.
+class Stats {
+ private:
+  /// add to counter (single writer)
+  static void add(std::atomic<std::uint64_t>& counter, std::uint64_t n) {
+    counter.store(counter.load(std::memory_order_relaxed) + n, std::memory_order_relaxed);
+  }
+
+ public:
+  /// statistics of a command
+  struct Command {
+    histogram::Histogram latency{};  // execution time (ns)
+    std::atomic<std::uint64_t> failed{0};
+  };
+
+  /// statistics recorded by a thread
+  struct Shard {
+    std::array<Command, kCommands.size()> commands{};
+    std::atomic<std::uint64_t> net_input{0};
+    std::atomic<std::uint64_t> net_output{0};
+  };
+
+ private:
+  std::chrono::steady_clock::time_point started_;
+  std::atomic<std::uint64_t> connected_clients_;
+  std::atomic<std::uint64_t> total_connections_;
+  std::atomic<std::uint64_t> output_buffer_disconnections_;
+  std::atomic<std::uint64_t> rejected_connections_;
+  eidos::detail::PerThread<Shard> shards_;
+
+ public:
+  Stats()
+      : started_(std::chrono::steady_clock::now()),
+        connected_clients_(0),
+        total_connections_(0),
+        output_buffer_disconnections_(0),
+        rejected_connections_(0),
+        shards_() {}
+
+  Stats(const Stats&) = delete;
+  Stats& operator=(const Stats&) = delete;
+
+ public:
+  /// record an executed command
+  /// \param index command index (nullopt: unknown command)
+  /// \param latency execution time
+  /// \param failed true if error response was returned
+  /// \param input request size (bytes)
+  /// \param output response size (bytes)
+  void record(std::optional<std::size_t> index, std::chrono::nanoseconds latency, bool failed, std::uint64_t input,
+              std::uint64_t output) {
+    auto& shard = shards_.local();
+    add(shard.net_input, input);
+    add(shard.net_output, output);
+    if (index) {
+      auto& command = shard.commands[index.value()];
+      command.latency.record(static_cast<std::uint64_t>(latency.count()));
+      if (failed) {
+        add(command.failed, 1);
+      }
+    }
+  }
+
+  /// client connected
+  void connected() {
+    connected_clients_.fetch_add(1, std::memory_order_relaxed);
+    total_connections_.fetch_add(1, std::memory_order_relaxed);
+  }
+
+  /// client disconnected
+  void disconnected() { connected_clients_.fetch_sub(1, std::memory_order_relaxed); }
+
+  /// connection rejected by maxclients
+  void rejected() { rejected_connections_.fetch_add(1, std::memory_order_relaxed); }
+
+  /// client disconnected by the client output buffer limit
+  void outputBufferLimitReached() { output_buffer_disconnections_.fetch_add(1, std::memory_order_relaxed); }
+
+ public:
+  /// merge latency histograms of the command
+  /// \param index command index
+  /// \param latency merged histogram
+  /// \return number of failed calls
+  std::uint64_t command(std::size_t index, histogram::Histogram& latency) const {
+    std::uint64_t failed = 0;
+    shards_.forEach([&](const Shard& shard) {
+      latency.merge(shard.commands[index].latency);
+      failed += shard.commands[index].failed.load(std::memory_order_relaxed);
+    });
+    return failed;
+  }
+
+  /// total bytes read from clients
+  /// \return bytes
+  [[nodiscard]] std::uint64_t netInput() const {
+    std::uint64_t total = 0;
+    shards_.forEach([&total](const Shard& shard) { total += shard.net_input.load(std::memory_order_relaxed); });
+    return total;
+  }
+
+  /// total bytes written to clients
+  /// \return bytes
+  [[nodiscard]] std::uint64_t netOutput() const {
+    std::uint64_t total = 0;
+    shards_.forEach([&total](const Shard& shard) { total += shard.net_output.load(std::memory_order_relaxed); });
+    return total;
+  }
+
+  /// number of connected clients
+  /// \return number of clients
+  [[nodiscard]] std::uint64_t connectedClients() const { return connected_clients_.load(std::memory_order_relaxed); }
+
+  /// number of accepted connections since server started
+  /// \return number of connections
+  [[nodiscard]] std::uint64_t totalConnections() const { return total_connections_.load(std::memory_order_relaxed); }
+
+  /// number of connections rejected by maxclients
+  /// \return number of connections
+  [[nodiscard]] std::uint64_t rejectedConnections() const {
+    return rejected_connections_.load(std::memory_order_relaxed);
+  }
+
+  /// number of clients disconnected by the client output buffer limit
+  /// \return number of clients
+  [[nodiscard]] std::uint64_t outputBufferDisconnections() const {
+    return output_buffer_disconnections_.load(std::memory_order_relaxed);
+  }
+
+  /// elapsed time since server started
+  /// \return uptime
+  [[nodiscard]] std::chrono::seconds uptime() const {
+    return std::chrono::duration_cast<std::chrono::seconds>(std::chrono::steady_clock::now() - started_);
+  }
+};
+
+/// connected client counter (RAII)
+class ClientGuard {
+ private:
+  Stats& stats_;
+
+ public:
+  explicit ClientGuard(Stats& stats) : stats_(stats) { stats_.connected(); }
+  ~ClientGuard() { stats_.disconnected(); }
+
+  ClientGuard(const ClientGuard&) = delete;
+  ClientGuard& operator=(const ClientGuard&) = delete;
+};
+
+}  // namespace eidos::stats
@@ -0,0 +1,74 @@
+// Copyright 2021 SiLeader and Cerussite.
+//
+// Licensed under the Apache License, Version 2.0 (the “License”);
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an “AS IS” BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#pragma once
+
+#include <cstdint>
+#include <eidos/result.hpp>
+#include <string>
+#include <vector>
+
+namespace eidos::storage {
+
+/// cluster member information
+struct ServerInfo {
+  int id;
+  std::string endpoint;
+  bool leader;
+};
+
+/// Raft state of a group on this node
+struct RaftStatus {
+  int id;                       // id of this node
+  int leader;                   // id of the leader seen from this node (-1: unknown)
+  std::uint64_t term;           // current term
+  std::uint64_t committed;      // index of the last committed log entry
+  std::uint64_t log_start;      // index of the first log entry kept in the log store
+  std::uint64_t last_log;       // index of the last log entry
+  std::uint64_t snapshots;      // number of snapshots created or received
+  std::uint64_t last_snapshot;  // last log index of the newest snapshot (0: no snapshot)
+};
+
+///
+/// base class of storage engines that manage cluster membership
+///
+class ClusterBase {
+ public:
+  template <class T>
+  using Result = eidos::result::Result<T, std::string>;
+
+  virtual ~ClusterBase() = default;
+
+ public:
+  /// add server to cluster
+  /// \param id server id
+  /// \param endpoint server endpoint (host:port)
+  /// \return Result of operation
+  virtual Result<void> addServer(int id, const std::string& endpoint) = 0;
+
+  /// remove server from cluster
+  /// \param id server id
+  /// \return Result of operation
+  virtual Result<void> removeServer(int id) = 0;
+
+  /// get cluster members
+  /// \return cluster members or error
+  virtual Result<std::vector<ServerInfo>> servers() = 0;
+
+  /// get Raft state of each group on this node
+  /// \return Raft state of groups
+  virtual std::vector<RaftStatus> groups() = 0;
+};
+
+}  // namespace eidos::storage
@@ -15,7 +15,10 @@
 #pragma once
 
 #include <algorithm>
+#include <array>
+#include <atomic>
 #include <boost/algorithm/string.hpp>
+#include <cstdint>
 #include <list>
 #include <regex>
 #include <unordered_map>
@@ -31,13 +34,20 @@ class MemoryStorageEngine : public StorageEngineBase {
  private:
   using Container = std::list<std::tuple<Key, Value>>;
 
+  /// number of version stamps. keys are mapped by digest, so the stamps stay valid when the bucket is extended
+  static constexpr std::size_t kVersionStripes = 4096;
+
  private:
   std::size_t bucket_size_;
   Container* storage_;
   Allocator allocator_;
+  std::size_t size_;
+  std::array<std::atomic<std::uint64_t>, kVersionStripes> versions_;  // written on the commit thread under Raft
 
  public:
-  MemoryStorageEngine() : bucket_size_(1024), storage_(nullptr), allocator_() { extendAndRearrange(); }
+  MemoryStorageEngine() : bucket_size_(1024), storage_(nullptr), allocator_(), size_(0), versions_() {
+    extendAndRearrange();
+  }
 
   ~MemoryStorageEngine() override {
     for (auto itr = storage_; itr != storage_ + bucket_size_; ++itr) {
@@ -71,6 +81,10 @@ class MemoryStorageEngine : public StorageEngineBase {
     bucket_size_ = size;
   }
 
+  /// change the version stamp of the key
+  /// \param key written key
+  void touch(const Key& key) { versions_[key.digest() % kVersionStripes].fetch_add(1, std::memory_order_release); }
+
  public:
   Result<Value> get(const Key& key) override {
     const auto& l = storage_[key.digest() % bucket_size_];
@@ -79,7 +93,7 @@ class MemoryStorageEngine : public StorageEngineBase {
         return Result<Value>::Ok(v);
       }
     }
-    return Result<Value>::Err("key not found");
+    return Result<Value>::Err(Error::kNotFound);
   }
 
   Result<void> set(const Key& key, const Value& value) override {
@@ -87,10 +101,13 @@ class MemoryStorageEngine : public StorageEngineBase {
     for (auto& [k, v] : l) {
       if (key.bytes() == k.bytes()) {
         v = value;
+        touch(key);
         return Result<void>::Ok();
       }
     }
     l.emplace_back(key, value);
+    size_++;
+    touch(key);
     return Result<void>::Ok();
   }
 
@@ -99,10 +116,12 @@ class MemoryStorageEngine : public StorageEngineBase {
     for (auto itr = std::begin(l); itr != std::end(l); ++itr) {
       if (key.bytes() == std::get<0>(*itr).bytes()) {
         l.erase(itr);
+        size_--;
+        touch(key);
         return Result<void>::Ok();
       }
     }
-    return Result<void>::Err("key not found");
+    return Result<void>::Err(Error::kNotFound);
   }
 
   Result<bool> exists(const Key& key) override {
@@ -137,6 +156,35 @@ class MemoryStorageEngine : public StorageEngineBase {
     });
     return Result<std::vector<std::tuple<Key, Value>>>::Ok(kvps);
   }
+
+  Result<std::size_t> size() override { return Result<std::size_t>::Ok(size_); }
+
+  std::uint64_t version(const Key& key) override {
+    return versions_[key.digest() % kVersionStripes].load(std::memory_order_acquire);
+  }
+
+  Result<void> clear() override {
+    for (auto itr = storage_; itr != storage_ + bucket_size_; ++itr) {
+      itr->clear();
+    }
+    size_ = 0;
+    for (auto& version : versions_) {
+      version.fetch_add(1, std::memory_order_release);
+    }
+    return Result<void>::Ok();
+  }
+
+  Result<void> apply(const std::vector<Mutation>& mutations) override {
+    // requests are executed one at a time on the io thread, so no other client sees a partial batch
+    for (const auto& mutation : mutations) {
+      if (mutation.value) {
+        set(mutation.key, mutation.value.value());
+      } else {
+        del(mutation.key);
+      }
+    }
+    return Result<void>::Ok();
+  }
 };
 
 }  // namespace eidos::storage
@@ -0,0 +1,305 @@
+// Copyright 2021 SiLeader and Cerussite.
+//
+// Licensed under the Apache License, Version 2.0 (the “License”);
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an “AS IS” BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#pragma once
+
+#include <algorithm>
+#include <boost/log/trivial.hpp>
+#include <filesystem>
+#include <memory>
+#include <optional>
+#include <string>
+#include <vector>
+
+#include "cluster_base.hpp"
+#include "raft.hpp"
+#include "storage_base.hpp"
+
+namespace eidos::storage {
+
+namespace detail {
+
+/// shift port number of endpoint
+/// \param endpoint endpoint (host:port)
+/// \param offset port offset
+/// \return shifted endpoint or no value (invalid endpoint)
+inline std::optional<std::string> OffsetEndpoint(const std::string& endpoint, std::size_t offset) {
+  const auto colon = endpoint.rfind(':');
+  if (colon == std::string::npos) {
+    return std::nullopt;
+  }
+  try {
+    const auto port = std::stoul(endpoint.substr(colon + 1)) + offset;
+    return endpoint.substr(0, colon + 1) + std::to_string(port);
+  } catch (const std::logic_error&) {
+    return std::nullopt;
+  }
+}
+
+}  // namespace detail
+
+/// Multi-Raft storage engine.
+/// the keyspace is partitioned into Raft groups by key digest.
+/// each group has its own log and state machine, and all groups share the network transport.
+/// the preferred leader of each group is chosen round-robin over the cluster members,
+/// so that the leaders (and the write load) spread across nodes.
+class MultiRaftStorageEngine : public StorageEngineBase, public ClusterBase {
+ public:
+  template <class T>
+  using Result = StorageEngineBase::Result<T>;
+  template <class T>
+  using ClusterResult = ClusterBase::Result<T>;
+
+ private:
+  /// election priority of the preferred leader of a group
+  static constexpr int kPreferredPriority = 2;
+
+ private:
+  std::vector<std::shared_ptr<RaftStorageEngine>> groups_;
+
+ public:
+  /// constructor
+  /// \tparam F internal storage engine factory type (`std::shared_ptr<StorageEngineBase> make_engine()`)
+  /// \param group_count number of Raft groups
+  /// \param options Raft options. group N listens on `options.port + N` and so do the peers.
+  /// \param snapshot_dir snapshot directory. each group uses `group-N` sub-directory.
+  /// \param make_engine internal storage engine factory
+  template <class F>
+  MultiRaftStorageEngine(std::size_t group_count, const RaftOptions& options, const std::filesystem::path& snapshot_dir,
+                         F&& make_engine)
+      : groups_() {
+    std::vector<int> ids{options.node_id};
+    for (const auto& peer : options.peers) {
+      ids.emplace_back(peer.id);
+    }
+    std::sort(std::begin(ids), std::end(ids));
+
+    const auto transport = MakeRaftTransport();
+    groups_.reserve(group_count);
+    for (std::size_t i = 0; i < group_count; ++i) {
+      const auto preferred = ids[i % ids.size()];
+      const auto priority_of = [preferred](int id) { return id == preferred ? kPreferredPriority : 1; };
+
+      auto group_options = options;
+      group_options.port = static_cast<std::uint16_t>(options.port + i);
+      group_options.priority = priority_of(options.node_id);
+      for (auto& peer : group_options.peers) {
+        peer.port = static_cast<std::uint16_t>(peer.port + i);
+        peer.priority = priority_of(peer.id);
+      }
+
+      groups_.emplace_back(std::make_shared<RaftStorageEngine>(
+          make_engine(), group_options, snapshot_dir / ("group-" + std::to_string(i)), transport));
+    }
+  }
+
+ private:
+  /// select the Raft group that owns the key.
+  /// the digest is mixed before taking modulo because the internal engine also uses the low bits of it.
+  /// \param key key
+  /// \return Raft group
+  [[nodiscard]] const std::shared_ptr<RaftStorageEngine>& group(const Key& key) const {
+    const auto mixed = (static_cast<std::uint64_t>(key.digest()) * 0x9E3779B97F4A7C15ULL) >> 32U;
+    return groups_[static_cast<std::size_t>(mixed % groups_.size())];
+  }
+
+ public:
+  Result<void> set(const Key& key, const Value& value) override { return group(key)->set(key, value); }
+
+  Result<Value> get(const Key& key) override { return group(key)->get(key); }
+
+  Result<void> del(const Key& key) override { return group(key)->del(key); }
+
+  Result<bool> exists(const Key& key) override { return group(key)->exists(key); }
+
+  Result<std::vector<Key>> keys(const std::string& pattern) override {
+    std::vector<Key> keys;
+    for (const auto& g : groups_) {
+      const auto res = g->keys(pattern);
+      if (res.is_err()) {
+        return res;
+      }
+      const auto group_keys = res.unwrap();
+      keys.insert(std::end(keys), std::begin(group_keys), std::end(group_keys));
+    }
+    return Result<std::vector<Key>>::Ok(keys);
+  }
+
+  Result<std::vector<std::tuple<Key, Value>>> dump() override {
+    std::vector<std::tuple<Key, Value>> kvps;
+    for (const auto& g : groups_) {
+      const auto res = g->dump();
+      if (res.is_err()) {
+        return res;
+      }
+      const auto group_kvps = res.unwrap();
+      kvps.insert(std::end(kvps), std::begin(group_kvps), std::end(group_kvps));
+    }
+    return Result<std::vector<std::tuple<Key, Value>>>::Ok(kvps);
+  }
+
+  Result<std::size_t> size() override {
+    std::size_t size = 0;
+    for (const auto& g : groups_) {
+      const auto res = g->size();
+      if (res.is_err()) {
+        return res;
+      }
+      size += res.unwrap();
+    }
+    return Result<std::size_t>::Ok(size);
+  }
+
+  std::uint64_t version(const Key& key) override { return group(key)->version(key); }
+
+  Result<void> clear() override {
+    for (const auto& g : groups_) {
+      if (const auto res = g->clear(); res.is_err()) {
+        return res;
+      }
+    }
+    return Result<void>::Ok();
+  }
+
+  Result<void> apply(const std::vector<Mutation>& mutations) override {
+    // a batch is one log entry of one group, so all keys must belong to the same group
+    if (mutations.empty()) {
+      return Result<void>::Ok();
+    }
+    const auto& target = group(mutations.front().key);
+    if (std::any_of(std::begin(mutations), std::end(mutations),
+                    [&](const Mutation& mutation) { return group(mutation.key) != target; })) {
+      return Result<void>::Err(Error::kCrossGroup);
+    }
+    return target->apply(mutations);
+  }
+
+  Result<void> applyIfUnchanged(const std::vector<Mutation>& mutations, const std::vector<Watch>& watched) override {
+    // the stamps are checked by the group that applies the batch, so the watched keys must belong to it too
+    if (mutations.empty() || watched.empty()) {
+      return StorageEngineBase::applyIfUnchanged(mutations, watched);
+    }
+    const auto& target = group(mutations.front().key);
+    if (std::any_of(std::begin(mutations), std::end(mutations),
+                    [&](const Mutation& mutation) { return group(mutation.key) != target; }) ||
+        std::any_of(std::begin(watched), std::end(watched),
+                    [&](const Watch& watch) { return group(watch.key) != target; })) {
+      return Result<void>::Err(Error::kCrossGroup);
+    }
+    return target->applyIfUnchanged(mutations, watched);
+  }
+
+ private:
+  /// endpoint of the server in the group
+  /// \param index group index
+  /// \param id server id
+  /// \return endpoint or std::nullopt if the server is not a member of the group
+  std::optional<std::string> endpointOf(std::size_t index, int id) {
+    const auto res = groups_[index]->servers();
+    if (res.is_err()) {
+      return std::nullopt;
+    }
+    for (const auto& server : res.unwrap()) {
+      if (server.id == id) {
+        return server.endpoint;
+      }
+    }
+    return std::nullopt;
+  }
+
+ public:
+  /// add the server to all groups.
+  /// if a group rejects the server, the groups that already added it remove it again.
+  ClusterResult<void> addServer(int id, const std::string& endpoint) override {
+    for (std::size_t i = 0; i < groups_.size(); ++i) {
+      if (!detail::OffsetEndpoint(endpoint, i)) {
+        return ClusterResult<void>::Err("invalid endpoint: " + endpoint);
+      }
+    }
+    for (std::size_t i = 0; i < groups_.size(); ++i) {
+      const auto res = groups_[i]->addServer(id, detail::OffsetEndpoint(endpoint, i).value());
+      if (res.is_ok()) {
+        continue;
+      }
+      for (std::size_t j = 0; j < i; ++j) {
+        if (const auto rollback = groups_[j]->removeServer(id); rollback.is_err()) {
+          BOOST_LOG_TRIVIAL(error) << "group " << j << ": cannot roll back adding server " << id << ": "
+                                   << rollback.err().value();
+        }
+      }
+      return ClusterResult<void>::Err("group " + std::to_string(i) + ": " + res.err().value());
+    }
+    return ClusterResult<void>::Ok();
+  }
+
+  /// remove the server from all groups.
+  /// if a group cannot remove the server, the groups that already removed it add it again.
+  ClusterResult<void> removeServer(int id) override {
+    std::vector<std::optional<std::string>> endpoints;
+    endpoints.reserve(groups_.size());
+    for (std::size_t i = 0; i < groups_.size(); ++i) {
+      endpoints.push_back(endpointOf(i, id));
+    }
+    for (std::size_t i = 0; i < groups_.size(); ++i) {
+      const auto res = groups_[i]->removeServer(id);
+      if (res.is_ok()) {
+        continue;
+      }
+      for (std::size_t j = 0; j < i; ++j) {
+        if (!endpoints[j]) {
+          continue;
+        }
+        if (const auto rollback = groups_[j]->addServer(id, endpoints[j].value()); rollback.is_err()) {
+          BOOST_LOG_TRIVIAL(error) << "group " << j << ": cannot roll back removing server " << id << ": "
+                                   << rollback.err().value();
+        }
+      }
+      return ClusterResult<void>::Err("group " + std::to_string(i) + ": " + res.err().value());
+    }
+    return ClusterResult<void>::Ok();
+  }
+
+  /// members of the cluster. each server is listed once with the endpoint of the first group,
+  /// and is marked as the leader if it leads any group.
+  ClusterResult<std::vector<ServerInfo>> servers() override {
+    std::vector<ServerInfo> servers;
+    for (const auto& g : groups_) {
+      const auto res = g->servers();
+      if (res.is_err()) {
+        return res;
+      }
+      for (const auto& server : res.unwrap()) {
+        const auto itr = std::find_if(std::begin(servers), std::end(servers),
+                                      [&server](const ServerInfo& s) { return s.id == server.id; });
+        if (itr == std::end(servers)) {
+          servers.push_back(server);
+        } else {
+          itr->leader = itr->leader || server.leader;
+        }
+      }
+    }
+    return ClusterResult<std::vector<ServerInfo>>::Ok(servers);
+  }
+
+  std::vector<RaftStatus> groups() override {
+    std::vector<RaftStatus> groups;
+    groups.reserve(groups_.size());
+    for (const auto& g : groups_) {
+      groups.push_back(g->status());
+    }
+    return groups;
+  }
+};
+
+}  // namespace eidos::storage
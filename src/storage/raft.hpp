@@ -14,8 +14,13 @@
 
 #pragma once
 
+#include <algorithm>
+#include <array>
+#include <atomic>
 #include <boost/log/trivial.hpp>
-#include <random>
+#include <filesystem>
+#include <fstream>
+#include <thread>
 
 #pragma GCC diagnostic ignored "-Wunused-parameter"
 #pragma GCC diagnostic ignored "-Wimplicit-int-conversion"
@@ -23,6 +28,10 @@
 #pragma GCC diagnostic warning "-Wimplicit-int-conversion"
 #pragma GCC diagnostic warning "-Wunused-parameter"
 
+#include "../log.hpp"
+#include "../trace.hpp"
+#include "cluster_base.hpp"
+#include "ring_log_store.hpp"
 #include "storage_base.hpp"
 
 namespace eidos::storage {
@@ -34,10 +43,92 @@ inline void EncodeMessage(nuraft::buffer_serializer& bs, const BytesMessage& mes
   bs.put_bytes(static_cast<const void*>(mb.data()), mb.size());
 }
 
+/// encode SET instruction
+/// \param key key
+/// \param value value
+/// \return encoded instruction
+inline nuraft::ptr<nuraft::buffer> EncodeSet(const Key& key, const Value& value) {
+  auto buf = nuraft::buffer::alloc(2 + 4 + key.bytes().size() + 8 + 4 + value.bytes().size());
+  nuraft::buffer_serializer bs(buf);
+  bs.put_u16(2);  // SET
+  EncodeMessage(bs, key);
+  bs.put_u64(key.digest());
+  EncodeMessage(bs, value);
+  return buf;
+}
+
+/// encode DEL instruction
+/// \param key key
+/// \return encoded instruction
+inline nuraft::ptr<nuraft::buffer> EncodeDel(const Key& key) {
+  auto buf = nuraft::buffer::alloc(2 + 4 + key.bytes().size() + 8);
+  nuraft::buffer_serializer bs(buf);
+  bs.put_u16(3);  // DEL
+  EncodeMessage(bs, key);
+  bs.put_u64(key.digest());
+  return buf;
+}
+
+/// encode batch instruction (SET and DEL instructions applied by one log entry)
+/// \param mutations writes in order
+/// \return encoded instruction
+inline nuraft::ptr<nuraft::buffer> EncodeBatch(const std::vector<Mutation>& mutations) {
+  std::size_t size = 2 + 4;
+  for (const auto& mutation : mutations) {
+    size += 2 + 4 + mutation.key.bytes().size() + 8 + (mutation.value ? 4 + mutation.value->bytes().size() : 0);
+  }
+  auto buf = nuraft::buffer::alloc(size);
+  nuraft::buffer_serializer bs(buf);
+  bs.put_u16(6);  // BATCH
+  bs.put_u32(static_cast<std::uint32_t>(mutations.size()));
+  for (const auto& mutation : mutations) {
+    bs.put_u16(mutation.value ? 2 : 3);
+    EncodeMessage(bs, mutation.key);
+    bs.put_u64(mutation.key.digest());
+    if (mutation.value) {
+      EncodeMessage(bs, mutation.value.value());
+    }
+  }
+  return buf;
+}
+
+/// encode batch instruction that is applied only if the watched keys are not written after their stamps (EXEC)
+/// \param mutations writes in order
+/// \param watched watched keys and their stamps (log index of the last write)
+/// \return encoded instruction
+inline nuraft::ptr<nuraft::buffer> EncodeWatchedBatch(const std::vector<Mutation>& mutations,
+                                                      const std::vector<Watch>& watched) {
+  const auto batch = EncodeBatch(mutations);
+  auto buf = nuraft::buffer::alloc(2 + 4 + watched.size() * (8 + 8) + batch->size());
+  nuraft::buffer_serializer bs(buf);
+  bs.put_u16(7);  // WATCHED BATCH
+  bs.put_u32(static_cast<std::uint32_t>(watched.size()));
+  for (const auto& watch : watched) {
+    bs.put_u64(watch.key.digest());
+    bs.put_u64(watch.version);
+  }
+  bs.put_raw(batch->data_begin(), batch->size());
+  return buf;
+}
+
+/// encode stamps record of the snapshot
+/// \param stamps stamp of each stripe
+/// \return encoded record
+inline nuraft::ptr<nuraft::buffer> EncodeStamps(const std::vector<std::uint64_t>& stamps) {
+  auto buf = nuraft::buffer::alloc(2 + 4 + stamps.size() * 8);
+  nuraft::buffer_serializer bs(buf);
+  bs.put_u16(8);  // STAMPS
+  bs.put_u32(static_cast<std::uint32_t>(stamps.size()));
+  for (const auto stamp : stamps) {
+    bs.put_u64(stamp);
+  }
+  return buf;
+}
+
 class Logger : public nuraft::logger {
  public:
-  void trace(const std::string& log_line) { BOOST_LOG_TRIVIAL(trace) << log_line; }
-  void debug(const std::string& log_line) override { BOOST_LOG_TRIVIAL(debug) << log_line; }
+  void trace(const std::string& log_line) { EIDOS_LOG_TRACE << log_line; }
+  void debug(const std::string& log_line) override { EIDOS_LOG_DEBUG << log_line; }
   void info(const std::string& log_line) override { BOOST_LOG_TRIVIAL(info) << log_line; }
   void warn(const std::string& log_line) override { BOOST_LOG_TRIVIAL(warning) << log_line; }
   void err(const std::string& log_line) override { BOOST_LOG_TRIVIAL(error) << log_line; }
@@ -292,9 +383,9 @@ class InMemoryLogStore : public nuraft::log_store {
 
 class InMemoryStateManager : public nuraft::state_mgr {
  public:
-  InMemoryStateManager(int srv_id, const std::string& endpoint)
-      : my_id_(srv_id), cur_log_store_(nuraft::cs_new<InMemoryLogStore>()) {
-    my_srv_config_ = nuraft::cs_new<nuraft::srv_config>(srv_id, endpoint);
+  InMemoryStateManager(int srv_id, const std::string& endpoint, int priority, nuraft::ptr<nuraft::log_store> log_store)
+      : my_id_(srv_id), cur_log_store_(std::move(log_store)) {
+    my_srv_config_ = nuraft::cs_new<nuraft::srv_config>(srv_id, 0, endpoint, "", false, priority);
 
     // Initial cluster config: contains only one server (myself).
     saved_config_ = nuraft::cs_new<nuraft::cluster_config>();
@@ -337,7 +428,7 @@ class InMemoryStateManager : public nuraft::state_mgr {
 
  private:
   int my_id_;
-  nuraft::ptr<InMemoryLogStore> cur_log_store_;
+  nuraft::ptr<nuraft::log_store> cur_log_store_;
   nuraft::ptr<nuraft::srv_config> my_srv_config_;
   nuraft::ptr<nuraft::cluster_config> saved_config_;
   nuraft::ptr<nuraft::srv_state> saved_state_;
@@ -345,47 +436,124 @@ class InMemoryStateManager : public nuraft::state_mgr {
 
 class StateMachine : public nuraft::state_machine {
  private:
-  struct Context {
-    nuraft::ptr<nuraft::snapshot> snapshot;
-    nuraft::ptr<nuraft::buffer> value;
+  /// size of a chunk that is sent to the follower at once
+  static constexpr std::size_t kSnapshotChunkSize = 4 * 1024 * 1024;
+
+  /// number of snapshots kept in the snapshot directory
+  static constexpr std::size_t kSnapshotsKept = 3;
 
-    Context(nuraft::ptr<nuraft::snapshot> snapshot, nuraft::ptr<nuraft::buffer> value)
-        : snapshot(std::move(snapshot)), value(std::move(value)) {}
-    Context() = default;
-  };
+  /// number of write stamps. keys share a stamp by digest
+  static constexpr std::size_t kStampStripes = 4096;
 
  private:
   std::atomic<uint64_t> last_committed_idx_;
   std::shared_ptr<StorageEngineBase> internal_engine_;
+  std::filesystem::path snapshot_dir_;
+
+  // log index of the last write of each stripe. identical on all nodes since it only depends on the log,
+  // so a watched batch is accepted or rejected by every node alike
+  std::array<std::atomic<std::uint64_t>, kStampStripes> stamps_;
 
   std::mutex snapshots_mutex_;
-  std::map<uint64_t, nuraft::ptr<Context>> snapshots_;
+  std::map<uint64_t, nuraft::ptr<nuraft::snapshot>> snapshots_;
+  std::atomic<std::uint64_t> snapshot_count_;
+  std::thread snapshot_thread_;
+  std::atomic<bool> snapshot_in_progress_;  // cleared by the snapshot writer thread
+
+  nuraft::int64 batch_size_hint_;
 
  public:
-  explicit StateMachine(std::shared_ptr<StorageEngineBase> engine)
-      : last_committed_idx_(0), internal_engine_(std::move(engine)) {}
+  StateMachine(std::shared_ptr<StorageEngineBase> engine, std::filesystem::path snapshot_dir,
+               nuraft::int64 batch_size_hint)
+      : last_committed_idx_(0),
+        internal_engine_(std::move(engine)),
+        snapshot_dir_(std::move(snapshot_dir)),
+        stamps_(),
+        snapshots_mutex_(),
+        snapshots_(),
+        snapshot_count_(0),
+        snapshot_thread_(),
+        snapshot_in_progress_(false),
+        batch_size_hint_(batch_size_hint) {
+    std::filesystem::create_directories(snapshot_dir_);
+  }
+
+  ~StateMachine() override {
+    if (snapshot_thread_.joinable()) {
+      snapshot_thread_.join();
+    }
+  }
 
  private:
-  void commit(nuraft::buffer_serializer& bs) {
+  /// stamp of the key
+  /// \param digest key digest
+  /// \return stamp
+  std::atomic<std::uint64_t>& stamp(std::uint64_t digest) { return stamps_[digest % kStampStripes]; }
+
+  /// apply the instruction
+  /// \param bs serializer of the instruction
+  /// \param log_idx log index of the instruction (0: replaying a snapshot, stamps are not changed)
+  /// \return false if a watched batch is rejected
+  bool commit(nuraft::buffer_serializer& bs, nuraft::ulong log_idx) {
     const auto get_bytes = [&bs]() -> std::vector<std::byte> {
       std::size_t size = 0;
       const auto bytes = static_cast<const std::byte*>(bs.get_bytes(size));
       return std::vector<std::byte>(bytes, bytes + size);
     };
+    const auto touch = [this, log_idx](std::uint64_t digest) {
+      if (log_idx != 0) {
+        stamp(digest).store(log_idx, std::memory_order_release);
+      }
+    };
     const auto instruction = bs.get_u16();
     switch (instruction) {
       case 2: {  // SET
-        BOOST_LOG_TRIVIAL(trace) << "do commit: SET";
+        EIDOS_LOG_TRACE << "do commit: SET";
         const auto kb = get_bytes();
         const auto digest = bs.get_u64();
         const auto vb = get_bytes();
         internal_engine_->set(Key(kb, digest), Value(vb));
+        touch(digest);
+        break;
+      }
+      case 3: {  // DEL
+        EIDOS_LOG_TRACE << "do commit: DEL";
+        const auto kb = get_bytes();
+        const auto digest = bs.get_u64();
+        internal_engine_->del(Key(kb, digest));
+        touch(digest);
+        break;
+      }
+      case 6: {  // BATCH
+        const auto count = bs.get_u32();
+        EIDOS_LOG_TRACE << "do commit: BATCH (" << count << " instructions)";
+        for (std::uint32_t i = 0; i < count; ++i) {
+          commit(bs, log_idx);
+        }
         break;
       }
-      case 3:  // DEL
-        BOOST_LOG_TRIVIAL(trace) << "do commit: DEL";
-        internal_engine_->del(Key(get_bytes(), bs.get_u64()));
+      case 7: {  // WATCHED BATCH
+        // every node applies the same log, so all nodes see the same stamps here
+        const auto count = bs.get_u32();
+        bool changed = false;
+        for (std::uint32_t i = 0; i < count; ++i) {
+          const auto digest = bs.get_u64();
+          const auto watched = bs.get_u64();
+          changed = changed || stamp(digest).load(std::memory_order_relaxed) != watched;
+        }
+        if (changed) {
+          EIDOS_LOG_TRACE << "do commit: WATCHED BATCH rejected";
+          return false;
+        }
+        return commit(bs, log_idx);
+      }
+      case 8: {  // STAMPS (snapshot)
+        const auto count = bs.get_u32();
+        for (std::uint32_t i = 0; i < count && i < kStampStripes; ++i) {
+          stamps_[i].store(bs.get_u64(), std::memory_order_release);
+        }
         break;
+      }
 
       case 0:  // not assigned
       case 1:  // GET
@@ -395,167 +563,645 @@ class StateMachine : public nuraft::state_machine {
         BOOST_LOG_TRIVIAL(error) << "unknown commit instruction: other: " << instruction;
         break;
     }
+    return true;
   }
 
-  nuraft::ptr<nuraft::buffer> dumpStorage() const {
-    const auto dumped_res = internal_engine_->dump();
-    if (dumped_res.is_err()) {
-      return nullptr;
-    }
-    std::vector<nuraft::ptr<nuraft::buffer>> buffers;
+ private:
+  /// path of the snapshot file
+  /// \param idx last log index of the snapshot
+  /// \return snapshot file path
+  [[nodiscard]] std::filesystem::path snapshotPath(uint64_t idx) const {
+    return snapshot_dir_ / ("snapshot-" + std::to_string(idx) + ".bin");
+  }
 
-    std::size_t whole_size = 0;
-    const auto dumped = dumped_res.unwrap();
-    for (const auto& [k, v] : dumped) {
-      const auto size = 2 + 4 + k.bytes().size() + 8 + 4 + v.bytes().size();
-      auto buffer = nuraft::buffer::alloc(size);
-      whole_size += size;
+  /// path of the snapshot file that is being received from the leader
+  /// \param idx last log index of the snapshot
+  /// \return temporary snapshot file path
+  [[nodiscard]] std::filesystem::path receivingPath(uint64_t idx) const {
+    return snapshot_dir_ / ("receiving-" + std::to_string(idx) + ".bin");
+  }
 
-      nuraft::buffer_serializer bs(buffer);
-      bs.put_u16(2);  // SET
-      EncodeMessage(bs, k);
-      bs.put_u64(k.digest());
-      EncodeMessage(bs, v);
-      buffers.emplace_back(buffer);
+  /// register snapshot and remove old snapshot files.
+  /// `snapshots_mutex_` must be locked.
+  /// \param s snapshot
+  void registerSnapshot(const nuraft::ptr<nuraft::snapshot>& s) {
+    snapshots_[s->get_last_log_idx()] = s;
+    snapshot_count_++;
+    while (snapshots_.size() > kSnapshotsKept) {
+      const auto entry = std::begin(snapshots_);
+      std::error_code ec;
+      std::filesystem::remove(snapshotPath(entry->first), ec);
+      snapshots_.erase(entry);
     }
+  }
 
-    auto buffer = nuraft::buffer::alloc(whole_size);
-    for (const auto& b : buffers) {
-      buffer->put(*b);
+  /// write the stamps and key value pairs to the snapshot file.
+  /// each record is the STAMPS or SET instruction prefixed by its length.
+  /// \param path snapshot file path
+  /// \param stamps write stamps
+  /// \param kvps key value pairs
+  /// \return true: success, false: failure
+  static bool writeSnapshot(const std::filesystem::path& path, const std::vector<std::uint64_t>& stamps,
+                            const std::vector<std::tuple<Key, Value>>& kvps) {
+    const auto tmp = path.string() + ".tmp";
+    {
+      std::ofstream ofs(tmp, std::ios::binary | std::ios::trunc);
+      const auto write = [&ofs](const nuraft::ptr<nuraft::buffer>& record) {
+        const auto size = static_cast<std::uint32_t>(record->size());
+        ofs.write(static_cast<const char*>(static_cast<const void*>(&size)), sizeof(std::uint32_t));
+        ofs.write(static_cast<const char*>(static_cast<const void*>(record->data_begin())), size);
+      };
+      write(EncodeStamps(stamps));
+      for (const auto& [k, v] : kvps) {
+        write(EncodeSet(k, v));
+      }
+      ofs.close();
+      if (!ofs) {
+        std::error_code ec;
+        std::filesystem::remove(tmp, ec);
+        return false;
+      }
+    }
+    std::error_code ec;
+    std::filesystem::rename(tmp, path, ec);
+    if (ec) {
+      std::filesystem::remove(tmp, ec);
+      return false;
     }
-    return buffer;
+    return true;
   }
 
- private:
-  void createSnapshot(nuraft::snapshot& s) {
-    const auto snapshot_buffer = s.serialize();
-    const auto ss = nuraft::snapshot::deserialize(*snapshot_buffer);
+  /// read the records of the snapshot file
+  /// \tparam F callback type
+  /// \param path snapshot file path
+  /// \param f callback called with the serializer of each record. returns false if the record is invalid
+  /// \return true: all records are read and accepted, false: failure
+  template <class F>
+  static bool forEachRecord(const std::filesystem::path& path, F&& f) {
+    std::ifstream ifs(path, std::ios::binary);
+    if (!ifs) {
+      return false;
+    }
 
-    const auto dumped = dumpStorage();
-    if (!dumped) {
-      return;
+    std::uint32_t size = 0;
+    while (ifs.read(static_cast<char*>(static_cast<void*>(&size)), sizeof(std::uint32_t))) {
+      auto record = nuraft::buffer::alloc(size);
+      if (!ifs.read(static_cast<char*>(static_cast<void*>(record->data_begin())), size)) {
+        BOOST_LOG_TRIVIAL(error) << "truncated snapshot file: " << path;
+        return false;
+      }
+      nuraft::buffer_serializer bs(record);
+      if (!f(bs, size)) {
+        BOOST_LOG_TRIVIAL(error) << "corrupt snapshot file: " << path;
+        return false;
+      }
     }
-    const auto context = nuraft::cs_new<Context>(ss, dumped);
-    snapshots_[s.get_last_log_idx()] = context;
+    // a partially read size is a truncated file
+    return ifs.gcount() == 0;
+  }
 
-    auto entry = std::begin(snapshots_);
-    for (std::size_t i = 0, count = snapshots_.size(); i < (count - 3); ++i) {
-      if (entry == std::end(snapshots_)) {
-        break;
+  /// read the snapshot file and replace the state with its records.
+  /// the whole file is validated first, so a corrupt snapshot leaves the state untouched.
+  /// \param path snapshot file path
+  /// \param last_log_idx last log index of the snapshot
+  /// \return true: success, false: failure
+  bool readSnapshot(const std::filesystem::path& path, nuraft::ulong last_log_idx) {
+    const auto valid = forEachRecord(path, [](nuraft::buffer_serializer& bs, std::uint32_t size) {
+      try {
+        const auto instruction = bs.get_u16();
+        if (instruction == 8) {  // STAMPS
+          if (bs.get_u32() != kStampStripes) {
+            return false;
+          }
+          for (std::size_t i = 0; i < kStampStripes; ++i) {
+            bs.get_u64();
+          }
+          return bs.pos() == size;
+        }
+        if (instruction != 2) {  // SET
+          return false;
+        }
+        std::size_t length = 0;
+        bs.get_bytes(length);
+        bs.get_u64();
+        bs.get_bytes(length);
+      } catch (const std::exception&) {
+        return false;
       }
-      entry = snapshots_.erase(entry);
+      return bs.pos() == size;
+    });
+    if (!valid) {
+      return false;
+    }
+
+    // the snapshot replaces the whole state
+    if (internal_engine_->clear().is_err()) {
+      return false;
     }
+    // a snapshot without the STAMPS record treats all keys as written at its last index
+    for (auto& stamp : stamps_) {
+      stamp.store(last_log_idx, std::memory_order_release);
+    }
+    return forEachRecord(path, [this](nuraft::buffer_serializer& bs, std::uint32_t) {
+      commit(bs, 0);
+      return true;
+    });
   }
 
  public:
   nuraft::ptr<nuraft::buffer> pre_commit(const nuraft::ulong, nuraft::buffer&) override { return nullptr; }
 
   nuraft::ptr<nuraft::buffer> commit(const nuraft::ulong log_idx, nuraft::buffer& data) override {
-    BOOST_LOG_TRIVIAL(trace) << "commit";
+    EIDOS_LOG_TRACE << "commit";
+    trace::Scope span("raft.commit", "raft");
     nuraft::buffer_serializer bs(data);
-    commit(bs);
+    const auto applied = commit(bs, log_idx);
     last_committed_idx_ = log_idx;
 
-    nuraft::ptr<nuraft::buffer> ret = nuraft::buffer::alloc(sizeof(log_idx));
+    // log index and whether the entry was applied (false: a watched key was written)
+    nuraft::ptr<nuraft::buffer> ret = nuraft::buffer::alloc(sizeof(log_idx) + 1);
     nuraft::buffer_serializer rbs(ret);
     rbs.put_u64(log_idx);
+    rbs.put_u8(applied ? 1 : 0);
     return ret;
   }
 
+  int read_logical_snp_obj(nuraft::snapshot& s, void*& user_snp_ctx, nuraft::ulong obj_id,
+                           nuraft::ptr<nuraft::buffer>& data_out, bool& is_last_obj) override {
+    EIDOS_LOG_TRACE << "read snapshot object " << obj_id;
+    if (user_snp_ctx == nullptr) {
+      auto ifs = std::make_unique<std::ifstream>(snapshotPath(s.get_last_log_idx()), std::ios::binary);
+      if (!*ifs) {
+        BOOST_LOG_TRIVIAL(error) << "snapshot not found: " << s.get_last_log_idx();
+        return -1;
+      }
+      user_snp_ctx = ifs.release();
+    }
+    auto& ifs = *static_cast<std::ifstream*>(user_snp_ctx);
+
+    // obj_id is the chunk number. the chunk is read into `data_out` directly
+    ifs.clear();
+    ifs.seekg(0, std::ios::end);
+    const auto file_size = static_cast<std::size_t>(ifs.tellg());
+    const auto offset = std::min(static_cast<std::size_t>(obj_id * kSnapshotChunkSize), file_size);
+    const auto size = std::min(kSnapshotChunkSize, file_size - offset);
+    ifs.seekg(static_cast<std::streamoff>(offset));
+
+    data_out = nuraft::buffer::alloc(size);
+    if (!ifs.read(static_cast<char*>(static_cast<void*>(data_out->data_begin())),
+                  static_cast<std::streamsize>(size))) {
+      BOOST_LOG_TRIVIAL(error) << "cannot read snapshot object " << obj_id << ": " << s.get_last_log_idx();
+      return -1;
+    }
+    is_last_obj = offset + size >= file_size;
+    data_out->pos(0);
+    return 0;
+  }
+
+  void save_logical_snp_obj(nuraft::snapshot& s, nuraft::ulong& obj_id, nuraft::buffer& data, bool is_first_obj,
+                            bool is_last_obj) override {
+    EIDOS_LOG_TRACE << "save snapshot object " << obj_id;
+    const auto path = receivingPath(s.get_last_log_idx());
+    std::ofstream ofs(path, std::ios::binary | (is_first_obj ? std::ios::trunc : std::ios::app));
+    ofs.write(static_cast<const char*>(static_cast<const void*>(data.data_begin())),
+              static_cast<std::streamsize>(data.size()));
+    ofs.close();
+    if (!ofs) {
+      // the leader sends the first object again for obj_id 0, so the transfer restarts from an empty file
+      BOOST_LOG_TRIVIAL(error) << "cannot write snapshot object " << obj_id << ": " << s.get_last_log_idx();
+      std::error_code ec;
+      std::filesystem::remove(path, ec);
+      obj_id = 0;
+      return;
+    }
+    obj_id++;
+
+    if (is_last_obj) {
+      std::error_code ec;
+      std::filesystem::rename(path, snapshotPath(s.get_last_log_idx()), ec);
+      if (ec) {
+        BOOST_LOG_TRIVIAL(error) << "cannot save received snapshot: " << ec.message();
+        std::filesystem::remove(path, ec);
+        return;
+      }
+      std::lock_guard lg(snapshots_mutex_);
+      registerSnapshot(nuraft::snapshot::deserialize(*s.serialize()));
+    }
+  }
+
+  void free_user_snp_ctx(void*& user_snp_ctx) override {
+    delete static_cast<std::ifstream*>(user_snp_ctx);
+    user_snp_ctx = nullptr;
+  }
+
   bool apply_snapshot(nuraft::snapshot& s) override {
-    BOOST_LOG_TRIVIAL(trace) << "apply snapshot";
-    auto entry = snapshots_.find(s.get_last_log_idx());
-    if (entry == std::end(snapshots_)) {
+    EIDOS_LOG_TRACE << "apply snapshot";
+    if (!readSnapshot(snapshotPath(s.get_last_log_idx()), s.get_last_log_idx())) {
       return false;
     }
-    auto buffer = entry->second->value;
-    nuraft::buffer_serializer bs(buffer);
-    while (bs.pos() < bs.size()) {
-      commit(bs);
-    }
+    last_committed_idx_ = s.get_last_log_idx();
     return true;
   }
 
   nuraft::ptr<nuraft::snapshot> last_snapshot() override {
-    BOOST_LOG_TRIVIAL(trace) << "last snapshot";
+    EIDOS_LOG_TRACE << "last snapshot";
     std::lock_guard<std::mutex> lg(snapshots_mutex_);
     auto entry = std::rbegin(snapshots_);
     if (entry == std::rend(snapshots_)) return nullptr;
 
-    return entry->second->snapshot;
+    return entry->second;
   }
 
   nuraft::ulong last_commit_index() override { return last_committed_idx_; }
 
+  /// number of snapshots created or received
+  /// \return number of snapshots
+  [[nodiscard]] std::uint64_t snapshotCount() const { return snapshot_count_; }
+
+  /// write stamp of the key
+  /// \param key key
+  /// \return log index of the last write of the key (or a key that shares the stamp)
+  [[nodiscard]] std::uint64_t stamp(const Key& key) const {
+    return stamps_[key.digest() % kStampStripes].load(std::memory_order_acquire);
+  }
+
+  nuraft::int64 get_next_batch_size_hint_in_bytes() override { return batch_size_hint_; }
+
   void create_snapshot(nuraft::snapshot& s, nuraft::async_result<bool>::handler_type& when_done) override {
-    BOOST_LOG_TRIVIAL(trace) << "create snapshot";
-    {
-      std::lock_guard lg(snapshots_mutex_);
-      createSnapshot(s);
+    EIDOS_LOG_TRACE << "create snapshot";
+    // `create_snapshot` is called on the commit thread, so it must not wait for the previous writer.
+    // while a snapshot is being written, the new one is skipped and NuRaft retries at the next distance.
+    if (bool expected = false; !snapshot_in_progress_.compare_exchange_strong(expected, true)) {
+      BOOST_LOG_TRIVIAL(info) << "snapshot skipped, previous one is in progress: " << s.get_last_log_idx();
+      bool res = false;
+      nuraft::ptr<std::exception> e = nullptr;
+      when_done(res, e);
+      return;
     }
 
-    bool res = true;
-    nuraft::ptr<std::exception> e = nullptr;
-    when_done(res, e);
+    // the dumped pairs are consistent with `s`.
+    // `dump` copies every pair on the commit thread, so the peak memory is one extra copy of the dataset
+    // until the background writer has written the file and released the copy.
+    auto dumped = internal_engine_->dump();
+    if (dumped.is_err()) {
+      snapshot_in_progress_ = false;
+      bool res = false;
+      nuraft::ptr<std::exception> e = nullptr;
+      when_done(res, e);
+      return;
+    }
+    std::vector<std::uint64_t> stamps(kStampStripes);
+    for (std::size_t i = 0; i < kStampStripes; ++i) {
+      stamps[i] = stamps_[i].load(std::memory_order_relaxed);
+    }
+    auto ss = nuraft::snapshot::deserialize(*s.serialize());
+
+    // the previous writer has cleared the flag, so it is finishing and this does not block
+    if (snapshot_thread_.joinable()) {
+      snapshot_thread_.join();
+    }
+    snapshot_thread_ = std::thread([this, ss, stamps = std::move(stamps), kvps = dumped.unwrap(), when_done]() mutable {
+      bool res = writeSnapshot(snapshotPath(ss->get_last_log_idx()), stamps, kvps);
+      kvps.clear();
+      if (res) {
+        std::lock_guard lg(snapshots_mutex_);
+        registerSnapshot(ss);
+      } else {
+        BOOST_LOG_TRIVIAL(error) << "cannot write snapshot: " << ss->get_last_log_idx();
+      }
+      nuraft::ptr<std::exception> e = nullptr;
+      when_done(res, e);
+      snapshot_in_progress_ = false;
+    });
   }
 };
 
 }  // namespace detail
 
-class RaftStorageEngine : public StorageEngineBase {
+/// Raft cluster member
+struct RaftPeer {
+  int id;
+  std::string host;
+  std::uint16_t port;
+  int priority;
+};
+
+/// Raft log store implementation
+enum class RaftLogStore {
+  /// `std::map` based log store
+  kMap,
+  /// ring buffer based log store (readers don't take the writer lock)
+  kRing,
+};
+
+/// Raft node and replication options
+struct RaftOptions {
+  /// id of this node
+  int node_id = 1;
+  /// advertised host name of this node
+  std::string host = "127.0.0.1";
+  /// listening port of this node
+  std::uint16_t port = 16379;
+  /// election priority of this node
+  int priority = 1;
+  /// other cluster members. the node that has the smallest id adds them to the cluster.
+  std::vector<RaftPeer> peers = {};
+
+  /// heartbeat interval (ms)
+  int heartbeat_interval = 125;
+  /// lower bound of election timeout (ms)
+  int election_timeout_lower = 250;
+  /// upper bound of election timeout (ms)
+  int election_timeout_upper = 500;
+  /// number of log entries between snapshots (0: disabled)
+  int snapshot_distance = 0;
+  /// number of log entries kept behind the newest snapshot. older entries are compacted
+  int reserved_log_items = 100000;
+  /// max number of log entries in an append entries request
+  int max_append_size = 100;
+  /// batch size hint of append entries requests sent to this node (bytes, 0: no hint)
+  std::int64_t batch_size_hint = 0;
+  /// log sync policy. true: wait for commit, false: return when the leader accepted the entry.
+  bool wait_for_commit = true;
+  /// log store implementation
+  RaftLogStore log_store = RaftLogStore::kRing;
+};
+
+/// create Raft log store
+/// \param type log store implementation
+/// \return log store
+inline nuraft::ptr<nuraft::log_store> MakeRaftLogStore(RaftLogStore type) {
+  switch (type) {
+    case RaftLogStore::kMap:
+      return nuraft::cs_new<detail::InMemoryLogStore>();
+    case RaftLogStore::kRing:
+    default:
+      return nuraft::cs_new<detail::RingBufferLogStore>();
+  }
+}
+
+/// create Raft network transport.
+/// the transport can be shared by several Raft groups.
+/// \return network transport
+inline nuraft::ptr<nuraft::asio_service> MakeRaftTransport() {
+  return nuraft::cs_new<nuraft::asio_service>(nuraft::asio_service::options{}, nuraft::cs_new<detail::Logger>());
+}
+
+class RaftStorageEngine : public StorageEngineBase, public ClusterBase {
+ public:
+  template <class T>
+  using Result = StorageEngineBase::Result<T>;
+  template <class T>
+  using ClusterResult = ClusterBase::Result<T>;
+
+ private:
+  /// number of connections used for forwarding writes from follower to leader
+  static constexpr nuraft::int32 kForwardingConnections = 4;
+
+  /// number of attempts to add a peer to the cluster
+  static constexpr std::size_t kJoinAttempts = 100;
+
  private:
-  nuraft::ptr<nuraft::state_machine> state_machine_;
+  RaftOptions options_;
+  nuraft::ptr<detail::StateMachine> state_machine_;
   nuraft::ptr<nuraft::state_mgr> state_manager_;
-  nuraft::raft_launcher launcher_;
+  nuraft::ptr<nuraft::logger> logger_;
+  nuraft::ptr<nuraft::asio_service> transport_;
+  nuraft::ptr<nuraft::rpc_listener> listener_;
   nuraft::ptr<nuraft::raft_server> raft_server_;
   std::shared_ptr<StorageEngineBase> internal_engine_;
 
+  std::atomic<bool> stopping_;
+  std::thread join_thread_;
+
  public:
-  explicit RaftStorageEngine(const std::shared_ptr<StorageEngineBase>& engine, std::uint16_t raft_port)
-      : state_machine_(nuraft::cs_new<detail::StateMachine>(engine)),
-        state_manager_(nuraft::cs_new<detail::InMemoryStateManager>(std::random_device{}(),
-                                                                    "0.0.0.0:" + std::to_string(raft_port))),
-        internal_engine_(engine) {
-    raft_server_ = launcher_.init(state_machine_, state_manager_, nuraft::cs_new<detail::Logger>(), raft_port,
-                                  nuraft::asio_service::options{}, nuraft::raft_params{});
+  RaftStorageEngine(const std::shared_ptr<StorageEngineBase>& engine, const RaftOptions& options,
+                    const std::filesystem::path& snapshot_dir)
+      : RaftStorageEngine(engine, options, snapshot_dir, MakeRaftTransport()) {}
+
+  /// constructor
+  /// \param engine internal storage engine
+  /// \param options Raft node and replication options of this Raft group
+  /// \param snapshot_dir snapshot directory of this Raft group
+  /// \param transport network transport (shared by Raft groups)
+  RaftStorageEngine(const std::shared_ptr<StorageEngineBase>& engine, const RaftOptions& options,
+                    const std::filesystem::path& snapshot_dir, nuraft::ptr<nuraft::asio_service> transport)
+      : options_(options),
+        state_machine_(nuraft::cs_new<detail::StateMachine>(engine, snapshot_dir, options.batch_size_hint)),
+        state_manager_(nuraft::cs_new<detail::InMemoryStateManager>(
+            options.node_id, options.host + ":" + std::to_string(options.port), options.priority,
+            MakeRaftLogStore(options.log_store))),
+        logger_(nuraft::cs_new<detail::Logger>()),
+        transport_(std::move(transport)),
+        listener_(),
+        raft_server_(),
+        internal_engine_(engine),
+        stopping_(false),
+        join_thread_() {
+    nuraft::raft_params params{};
+    params.heart_beat_interval_ = options.heartbeat_interval;
+    params.election_timeout_lower_bound_ = options.election_timeout_lower;
+    params.election_timeout_upper_bound_ = options.election_timeout_upper;
+    params.snapshot_distance_ = options.snapshot_distance;
+    params.reserved_log_items_ = options.reserved_log_items;
+    params.max_append_size_ = options.max_append_size;
+    params.return_method_ =
+        options.wait_for_commit ? nuraft::raft_params::blocking : nuraft::raft_params::async_handler;
+    // followers forward client writes to the current leader over a pooled, persistent rpc connection
+    // so that clients do not need to know which node is the leader
+    params.auto_forwarding_ = true;
+    params.auto_forwarding_max_connections_ = kForwardingConnections;
+
+    listener_ = transport_->create_rpc_listener(options.port, logger_);
+    if (!listener_) {
+      throw std::runtime_error("cannot listen on raft port " + std::to_string(options.port));
+    }
+    nuraft::ptr<nuraft::delayed_task_scheduler> scheduler = transport_;
+    nuraft::ptr<nuraft::rpc_client_factory> rpc_client_factory = transport_;
+    nuraft::ptr<nuraft::state_machine> state_machine = state_machine_;
+    auto ctx = new nuraft::context(state_manager_, state_machine, listener_, logger_, rpc_client_factory, scheduler,
+                                   params);
+    raft_server_ = nuraft::cs_new<nuraft::raft_server>(ctx);
+    listener_->listen(raft_server_);
+
     while (!raft_server_->is_initialized()) {
       std::this_thread::sleep_for(std::chrono::milliseconds(10));
     }
-  }
 
-  ~RaftStorageEngine() override { raft_server_->shutdown(); }
+    const auto bootstrap = std::all_of(std::begin(options_.peers), std::end(options_.peers),
+                                       [this](const RaftPeer& peer) { return options_.node_id < peer.id; });
+    if (bootstrap && !options_.peers.empty()) {
+      join_thread_ = std::thread([this] { joinPeers(); });
+    }
+  }
 
- public:
-  Result<void> set(const Key& key, const Value& value) override {
-    auto buf = nuraft::buffer::alloc(2 + 4 + key.bytes().size() + 8 + 4 + value.bytes().size());
-    nuraft::buffer_serializer bs(buf);
-    bs.put_u16(2);
-    detail::EncodeMessage(bs, key);
-    bs.put_u64(key.digest());
-    detail::EncodeMessage(bs, value);
-
-    const auto res = raft_server_->append_entries({buf});
-    return Result<void>::Ok();
+  ~RaftStorageEngine() override {
+    stopping_ = true;
+    if (join_thread_.joinable()) {
+      join_thread_.join();
+    }
+    raft_server_->shutdown();
+    raft_server_.reset();
+    listener_->stop();
+    listener_->shutdown();
   }
 
-  Result<Value> get(const Key& key) override { return internal_engine_->get(key); }
+ private:
+  /// add all peers to the cluster.
+  /// peers may not be started yet, so adding is retried.
+  void joinPeers() {
+    while (!stopping_ && !raft_server_->is_leader()) {
+      std::this_thread::sleep_for(std::chrono::milliseconds(options_.heartbeat_interval));
+    }
+    for (const auto& peer : options_.peers) {
+      const auto endpoint = peer.host + ":" + std::to_string(peer.port);
+      for (std::size_t i = 0; i < kJoinAttempts && !stopping_; ++i) {
+        if (raft_server_->get_srv_config(peer.id)) {
+          break;
+        }
+        const auto res = raft_server_->add_srv(nuraft::srv_config(peer.id, 0, endpoint, "", false, peer.priority));
+        if (!res->get_accepted() || res->get_result_code() != nuraft::cmd_result_code::OK) {
+          EIDOS_LOG_DEBUG << "cannot add peer " << peer.id << " (" << endpoint << "): " << res->get_result_str();
+        }
+        std::this_thread::sleep_for(std::chrono::milliseconds(options_.election_timeout_upper));
+      }
+      if (raft_server_->get_srv_config(peer.id)) {
+        BOOST_LOG_TRIVIAL(info) << "peer " << peer.id << " (" << endpoint << ") joined";
+      } else {
+        BOOST_LOG_TRIVIAL(error) << "peer " << peer.id << " (" << endpoint << ") cannot join";
+      }
+    }
 
-  Result<void> del(const Key& key) override {
-    auto buf = nuraft::buffer::alloc(2 + 4 + key.bytes().size() + 8);
-    nuraft::buffer_serializer bs(buf);
-    bs.put_u16(3);
-    detail::EncodeMessage(bs, key);
-    bs.put_u64(key.digest());
+    // hand over the leadership to the member that has the highest priority
+    const auto preferred =
+        std::max_element(std::begin(options_.peers), std::end(options_.peers),
+                         [](const RaftPeer& a, const RaftPeer& b) { return a.priority < b.priority; });
+    if (!stopping_ && preferred->priority > options_.priority && raft_server_->get_srv_config(preferred->id)) {
+      BOOST_LOG_TRIVIAL(info) << "yield leadership to " << preferred->id;
+      raft_server_->yield_leadership(false, preferred->id);
+    }
+  }
 
-    raft_server_->append_entries({buf});
+ private:
+  /// check result of Raft operation
+  /// \param res result of Raft operation
+  /// \return Result of operation
+  Result<void> check(const nuraft::ptr<nuraft::cmd_result<nuraft::ptr<nuraft::buffer>>>& res) const {
+    if (!res->get_accepted()) {
+      BOOST_LOG_TRIVIAL(error) << "raft request not accepted: " << res->get_result_str();
+      return Result<void>::Err(Error::kNotAccepted);
+    }
+    if (options_.wait_for_commit && res->get_result_code() != nuraft::cmd_result_code::OK) {
+      BOOST_LOG_TRIVIAL(error) << "raft request failed: " << res->get_result_str();
+      return Result<void>::Err(Error::kReplicationFailed);
+    }
     return Result<void>::Ok();
   }
 
+  /// check result of Raft membership change
+  /// \param res result of Raft operation
+  /// \return Result of operation (with the reason reported by Raft)
+  ClusterResult<void> checkMembership(const nuraft::ptr<nuraft::cmd_result<nuraft::ptr<nuraft::buffer>>>& res) const {
+    if (const auto result = check(res); result.is_err()) {
+      return ClusterResult<void>::Err(std::string(Message(result.err().value())) + ": " + res->get_result_str());
+    }
+    return ClusterResult<void>::Ok();
+  }
+
+ private:
+  /// append log entry to Raft cluster and wait for commit (unless the log sync policy says otherwise).
+  /// when this node is a follower, the entry is forwarded to the leader.
+  /// \param buf encoded instruction
+  /// \return Result of operation
+  Result<void> replicate(const nuraft::ptr<nuraft::buffer>& buf) {
+    trace::Scope span("raft.replicate", "raft");
+    return check(raft_server_->append_entries({buf}));
+  }
+
+ public:
+  Result<void> set(const Key& key, const Value& value) override { return replicate(detail::EncodeSet(key, value)); }
+
+  Result<Value> get(const Key& key) override { return internal_engine_->get(key); }
+
+  Result<void> del(const Key& key) override { return replicate(detail::EncodeDel(key)); }
+
   Result<bool> exists(const Key& key) override { return internal_engine_->exists(key); }
 
   Result<std::vector<Key>> keys(const std::string& pattern) override { return internal_engine_->keys(pattern); }
 
   Result<std::vector<std::tuple<Key, Value>>> dump() override { return internal_engine_->dump(); }
+
+  Result<std::size_t> size() override { return internal_engine_->size(); }
+
+  /// log index of the last write of the key, which is the same on all nodes
+  std::uint64_t version(const Key& key) override { return state_machine_->stamp(key); }
+
+  Result<void> apply(const std::vector<Mutation>& mutations) override {
+    if (mutations.empty()) {
+      return Result<void>::Ok();
+    }
+    return replicate(detail::EncodeBatch(mutations));
+  }
+
+  /// the stamps are checked by the state machine when the batch is committed, so a write committed through
+  /// another node (or not applied on this node yet) rejects the batch.
+  /// the result is waited for regardless of the log sync policy.
+  Result<void> applyIfUnchanged(const std::vector<Mutation>& mutations, const std::vector<Watch>& watched) override {
+    if (mutations.empty() || watched.empty()) {
+      return StorageEngineBase::applyIfUnchanged(mutations, watched);
+    }
+    trace::Scope span("raft.replicate", "raft");
+    const auto res = raft_server_->append_entries({detail::EncodeWatchedBatch(mutations, watched)});
+    if (!res->get_accepted()) {
+      BOOST_LOG_TRIVIAL(error) << "raft request not accepted: " << res->get_result_str();
+      return Result<void>::Err(Error::kNotAccepted);
+    }
+    const auto ret = res->get();
+    if (res->get_result_code() != nuraft::cmd_result_code::OK || !ret || ret->size() < sizeof(std::uint64_t) + 1) {
+      BOOST_LOG_TRIVIAL(error) << "raft request failed: " << res->get_result_str();
+      return Result<void>::Err(Error::kReplicationFailed);
+    }
+    nuraft::buffer_serializer bs(*ret);
+    bs.get_u64();  // log index
+    return bs.get_u8() != 0 ? Result<void>::Ok() : Result<void>::Err(Error::kWatchConflict);
+  }
+
+ public:
+  ClusterResult<void> addServer(int id, const std::string& endpoint) override {
+    return checkMembership(raft_server_->add_srv(nuraft::srv_config(id, endpoint)));
+  }
+
+  ClusterResult<void> removeServer(int id) override { return checkMembership(raft_server_->remove_srv(id)); }
+
+  ClusterResult<std::vector<ServerInfo>> servers() override {
+    std::vector<nuraft::ptr<nuraft::srv_config>> configs;
+    raft_server_->get_srv_config_all(configs);
+
+    const auto leader = raft_server_->get_leader();
+    std::vector<ServerInfo> servers;
+    servers.reserve(configs.size());
+    for (const auto& config : configs) {
+      servers.push_back({config->get_id(), config->get_endpoint(), config->get_id() == leader});
+    }
+    return ClusterResult<std::vector<ServerInfo>>::Ok(servers);
+  }
+
+ public:
+  /// Raft state of this node
+  /// \return Raft state
+  [[nodiscard]] RaftStatus status() const {
+    const auto snapshot = state_machine_->last_snapshot();
+    return {options_.node_id,
+            raft_server_->get_leader(),
+            raft_server_->get_term(),
+            raft_server_->get_committed_log_idx(),
+            state_manager_->load_log_store()->start_index(),
+            raft_server_->get_last_log_idx(),
+            state_machine_->snapshotCount(),
+            snapshot ? snapshot->get_last_log_idx() : 0};
+  }
+
+  std::vector<RaftStatus> groups() override { return {status()}; }
 };
 
 }  // namespace eidos::storage
\ No newline at end of file
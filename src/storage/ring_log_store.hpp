@@ -0,0 +1,291 @@
+// Copyright 2021 SiLeader and Cerussite.
+//
+// Licensed under the Apache License, Version 2.0 (the “License”);
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an “AS IS” BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#pragma once
+
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+#pragma GCC diagnostic ignored "-Wunused-parameter"
+#pragma GCC diagnostic ignored "-Wimplicit-int-conversion"
+#include <libnuraft/nuraft.hxx>
+#pragma GCC diagnostic warning "-Wimplicit-int-conversion"
+#pragma GCC diagnostic warning "-Wunused-parameter"
+
+namespace eidos::storage::detail {
+
+/// shared pointer that can be loaded and stored atomically.
+/// this is not lock-free: libstdc++ implements both `std::atomic<std::shared_ptr>` and the `std::atomic_load`
+/// overloads with an internal spin lock pool. it only keeps readers off the writer lock of the log store.
+/// \tparam T element type
+template <class T>
+class AtomicSharedPtr {
+ private:
+#if defined(__cpp_lib_atomic_shared_ptr)
+  std::atomic<std::shared_ptr<T>> ptr_;
+#else
+  std::shared_ptr<T> ptr_;
+#endif
+
+ public:
+  AtomicSharedPtr() : ptr_() {}
+
+ public:
+  [[nodiscard]] std::shared_ptr<T> load() const {
+#if defined(__cpp_lib_atomic_shared_ptr)
+    return ptr_.load(std::memory_order_acquire);
+#else
+    return std::atomic_load_explicit(&ptr_, std::memory_order_acquire);
+#endif
+  }
+
+  void store(std::shared_ptr<T> p) {
+#if defined(__cpp_lib_atomic_shared_ptr)
+    ptr_.store(std::move(p), std::memory_order_release);
+#else
+    std::atomic_store_explicit(&ptr_, std::move(p), std::memory_order_release);
+#endif
+  }
+};
+
+/// in-memory Raft log store backed by a contiguous ring buffer.
+/// the entry of index `idx` is stored at `idx & mask` in the ring, which holds at least `[start_idx, next_idx)`.
+/// readers don't take the writer lock. writers (append, write_at, compact, apply_pack) are serialized by NuRaft
+/// and additionally by `write_lock_`.
+/// entries are shared with NuRaft instead of being cloned.
+class RingBufferLogStore : public nuraft::log_store {
+ private:
+  using EntrySlot = AtomicSharedPtr<nuraft::log_entry>;
+
+  struct Ring {
+    std::unique_ptr<EntrySlot[]> slots;
+    std::size_t mask;
+
+    explicit Ring(std::size_t capacity) : slots(std::make_unique<EntrySlot[]>(capacity)), mask(capacity - 1) {}
+
+    [[nodiscard]] std::size_t capacity() const { return mask + 1; }
+    [[nodiscard]] EntrySlot& at(nuraft::ulong idx) const { return slots[static_cast<std::size_t>(idx) & mask]; }
+  };
+
+  /// initial capacity of the ring (must be power of 2)
+  static constexpr std::size_t kInitialCapacity = 1024;
+
+ private:
+  AtomicSharedPtr<Ring> ring_;
+  std::atomic<nuraft::ulong> start_idx_;
+  std::atomic<nuraft::ulong> next_idx_;
+  std::mutex write_lock_;
+  nuraft::ptr<nuraft::log_entry> dummy_;
+
+ public:
+  RingBufferLogStore()
+      : ring_(),
+        start_idx_(1),
+        next_idx_(1),
+        write_lock_(),
+        dummy_(nuraft::cs_new<nuraft::log_entry>(0, nuraft::buffer::alloc(2))) {
+    ring_.store(std::make_shared<Ring>(kInitialCapacity));
+  }
+
+  ~RingBufferLogStore() override = default;
+
+  __nocopy__(RingBufferLogStore);
+
+ private:
+  /// get entry without the writer lock
+  /// \param idx log index
+  /// \return entry or nullptr (not in the log store)
+  [[nodiscard]] nuraft::ptr<nuraft::log_entry> get(nuraft::ulong idx) const {
+    // `next_idx_` is published after the ring and the slot have been written,
+    // so the ring loaded after it contains the entry.
+    if (idx >= next_idx_.load(std::memory_order_acquire)) {
+      return nullptr;
+    }
+    const auto ring = ring_.load();
+    auto entry = ring->at(idx).load();
+    // the slot can be reused only after the index is compacted
+    if (idx < start_idx_.load(std::memory_order_acquire)) {
+      return nullptr;
+    }
+    return entry;
+  }
+
+  /// get entry or dummy entry
+  /// \param idx log index
+  /// \return entry or dummy entry (not in the log store)
+  [[nodiscard]] nuraft::ptr<nuraft::log_entry> getOrDummy(nuraft::ulong idx) const {
+    auto entry = get(idx);
+    return entry ? entry : dummy_;
+  }
+
+  /// ensure the ring can hold entries up to [idx].
+  /// `write_lock_` must be locked.
+  /// \param idx log index
+  void reserve(nuraft::ulong idx) {
+    const auto ring = ring_.load();
+    const auto start = start_idx_.load(std::memory_order_relaxed);
+    if (idx < start || idx - start < ring->capacity()) {
+      return;
+    }
+
+    auto capacity = ring->capacity() * 2;
+    while (idx - start >= capacity) {
+      capacity *= 2;
+    }
+    auto extended = std::make_shared<Ring>(capacity);
+    const auto next = next_idx_.load(std::memory_order_relaxed);
+    for (auto i = start; i < next; ++i) {
+      extended->at(i).store(ring->at(i).load());
+    }
+    ring_.store(std::move(extended));
+  }
+
+ public:
+  nuraft::ulong next_slot() const override { return next_idx_.load(std::memory_order_acquire); }
+
+  nuraft::ulong start_index() const override { return start_idx_.load(std::memory_order_acquire); }
+
+  nuraft::ptr<nuraft::log_entry> last_entry() const override { return getOrDummy(next_slot() - 1); }
+
+  nuraft::ulong append(nuraft::ptr<nuraft::log_entry>& entry) override {
+    std::lock_guard lg(write_lock_);
+    const auto idx = next_idx_.load(std::memory_order_relaxed);
+    reserve(idx);
+    ring_.load()->at(idx).store(entry);
+    next_idx_.store(idx + 1, std::memory_order_release);
+    return idx;
+  }
+
+  void write_at(nuraft::ulong index, nuraft::ptr<nuraft::log_entry>& entry) override {
+    std::lock_guard lg(write_lock_);
+    reserve(index);
+    const auto ring = ring_.load();
+
+    // Discard all logs equal to or greater than `index`.
+    const auto next = next_idx_.load(std::memory_order_relaxed);
+    if (index + 1 < next) {
+      next_idx_.store(index + 1, std::memory_order_release);
+      for (auto i = index + 1; i < next; ++i) {
+        ring->at(i).store(nullptr);
+      }
+    }
+    ring->at(index).store(entry);
+    next_idx_.store(index + 1, std::memory_order_release);
+  }
+
+  nuraft::ptr<std::vector<nuraft::ptr<nuraft::log_entry>>> log_entries(nuraft::ulong start,
+                                                                       nuraft::ulong end) override {
+    auto ret = nuraft::cs_new<std::vector<nuraft::ptr<nuraft::log_entry>>>();
+    ret->reserve(static_cast<std::size_t>(end - start));
+    for (auto i = start; i < end; ++i) {
+      ret->emplace_back(getOrDummy(i));
+    }
+    return ret;
+  }
+
+  nuraft::ptr<std::vector<nuraft::ptr<nuraft::log_entry>>> log_entries_ext(
+      nuraft::ulong start, nuraft::ulong end, nuraft::int64 batch_size_hint_in_bytes) override {
+    auto ret = nuraft::cs_new<std::vector<nuraft::ptr<nuraft::log_entry>>>();
+    if (batch_size_hint_in_bytes < 0) {
+      return ret;
+    }
+
+    ret->reserve(static_cast<std::size_t>(end - start));
+    const auto limit = static_cast<std::size_t>(batch_size_hint_in_bytes);
+    std::size_t accum_size = 0;
+    for (auto i = start; i < end; ++i) {
+      auto entry = getOrDummy(i);
+      accum_size += entry->get_buf().size();
+      ret->emplace_back(std::move(entry));
+      if (limit != 0 && accum_size >= limit) {
+        break;
+      }
+    }
+    return ret;
+  }
+
+  nuraft::ptr<nuraft::log_entry> entry_at(nuraft::ulong index) override { return getOrDummy(index); }
+
+  nuraft::ulong term_at(nuraft::ulong index) override { return getOrDummy(index)->get_term(); }
+
+  nuraft::ptr<nuraft::buffer> pack(nuraft::ulong index, nuraft::int32 cnt) override {
+    const auto count = static_cast<std::size_t>(cnt);
+    std::vector<nuraft::ptr<nuraft::buffer>> logs;
+    logs.reserve(count);
+
+    std::size_t size_total = 0;
+    for (auto i = index; i < index + count; ++i) {
+      auto buf = getOrDummy(i)->serialize();
+      size_total += buf->size();
+      logs.emplace_back(std::move(buf));
+    }
+
+    auto buf_out = nuraft::buffer::alloc(sizeof(nuraft::int32) + count * sizeof(nuraft::int32) + size_total);
+    buf_out->pos(0);
+    buf_out->put(cnt);
+    for (const auto& buf : logs) {
+      buf_out->put(static_cast<nuraft::int32>(buf->size()));
+      buf_out->put(*buf);
+    }
+    return buf_out;
+  }
+
+  void apply_pack(nuraft::ulong index, nuraft::buffer& pack) override {
+    pack.pos(0);
+    const auto num_logs = static_cast<std::size_t>(pack.get_int());
+
+    std::lock_guard lg(write_lock_);
+    // the pack replaces the whole log
+    auto ring = std::make_shared<Ring>(kInitialCapacity);
+    while (ring->capacity() < num_logs) {
+      ring = std::make_shared<Ring>(ring->capacity() * 2);
+    }
+    for (std::size_t i = 0; i < num_logs; ++i) {
+      const auto buf_size = static_cast<std::size_t>(pack.get_int());
+      auto buf = nuraft::buffer::alloc(buf_size);
+      pack.get(buf);
+      ring->at(index + i).store(nuraft::log_entry::deserialize(*buf));
+    }
+
+    next_idx_.store(index, std::memory_order_release);
+    start_idx_.store(index, std::memory_order_release);
+    ring_.store(std::move(ring));
+    next_idx_.store(index + num_logs, std::memory_order_release);
+  }
+
+  bool compact(nuraft::ulong last_log_index) override {
+    std::lock_guard lg(write_lock_);
+    const auto ring = ring_.load();
+    const auto start = start_idx_.load(std::memory_order_relaxed);
+    const auto next = next_idx_.load(std::memory_order_relaxed);
+
+    // WARNING:
+    //   Even though nothing has been erased,
+    //   we should set `start_idx_` to new index.
+    start_idx_.store(last_log_index + 1, std::memory_order_release);
+    if (next < last_log_index + 1) {
+      next_idx_.store(last_log_index + 1, std::memory_order_release);
+    }
+    for (auto i = start; i < std::min(next, last_log_index + 1); ++i) {
+      ring->at(i).store(nullptr);
+    }
+    return true;
+  }
+
+  bool flush() override { return true; }
+};
+
+}  // namespace eidos::storage::detail
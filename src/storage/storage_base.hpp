@@ -14,18 +14,67 @@
 
 #pragma once
 
+#include <algorithm>
+#include <cstdint>
 #include <eidos/result.hpp>
 #include <eidos/types.hpp>
+#include <optional>
+#include <ostream>
+#include <string_view>
+#include <vector>
 
 namespace eidos::storage {
 
+/// storage engine error.
+/// errors are codes with static messages, so a failed operation (e.g. a missing key) does not allocate.
+enum class Error : std::uint8_t {
+  kNotFound,           // key does not exist
+  kNotAccepted,        // not accepted by the Raft cluster (e.g. no leader)
+  kReplicationFailed,  // accepted but not committed
+  kCrossGroup,         // keys of a batch belong to different Raft groups
+  kWatchConflict,      // a watched key was written before the batch was applied
+};
+
+/// message of the error
+/// \param error error code
+/// \return static message
+constexpr std::string_view Message(Error error) {
+  switch (error) {
+    case Error::kNotFound:
+      return "key not found";
+    case Error::kNotAccepted:
+      return "not accepted by raft cluster";
+    case Error::kReplicationFailed:
+      return "replication failed";
+    case Error::kCrossGroup:
+      return "keys of the transaction belong to different raft groups";
+    case Error::kWatchConflict:
+      return "watched key was modified";
+  }
+  return "unknown error";
+}
+
+inline std::ostream& operator<<(std::ostream& os, Error error) { return os << Message(error); }
+
+/// write of a batch ([StorageEngineBase::apply])
+struct Mutation {
+  Key key;
+  std::optional<Value> value;  // nullopt: delete
+};
+
+/// version stamp of a key read by WATCH ([StorageEngineBase::applyIfUnchanged])
+struct Watch {
+  Key key;
+  std::uint64_t version;
+};
+
 ///
 /// base class of storage engines
 ///
 class StorageEngineBase {
  public:
   template <class T>
-  using Result = eidos::result::Result<T, std::string>;
+  using Result = eidos::result::Result<T, Error>;
 
   virtual ~StorageEngineBase() = default;
 
@@ -59,6 +108,52 @@ class StorageEngineBase {
   /// dump all key value pairs
   /// \return key value pairs or error
   virtual Result<std::vector<std::tuple<Key, Value>>> dump() = 0;
+
+  /// get number of stored keys
+  /// \return Result of operation
+  virtual Result<std::size_t> size() = 0;
+
+  /// get version stamp of the key.
+  /// the stamp changes whenever the key is written. keys may share a stamp, so a change means that the key may
+  /// have been written (WATCH).
+  /// \param key key
+  /// \return version stamp
+  virtual std::uint64_t version(const Key& key) = 0;
+
+  /// apply writes atomically (EXEC).
+  /// deleting a key that does not exist is not an error.
+  /// \param mutations writes in order
+  /// \return Result of operation
+  virtual Result<void> apply(const std::vector<Mutation>& mutations) = 0;
+
+  /// apply writes atomically if no watched key has been written since its stamp was read (EXEC after WATCH).
+  /// the default implementation compares the stamps and applies the writes on the calling thread, which is
+  /// atomic for engines that are only written by that thread.
+  /// \param mutations writes in order
+  /// \param watched watched keys and their stamps
+  /// \return Result of operation (Error::kWatchConflict if a watched key was written)
+  virtual Result<void> applyIfUnchanged(const std::vector<Mutation>& mutations, const std::vector<Watch>& watched) {
+    if (std::any_of(std::begin(watched), std::end(watched),
+                    [this](const Watch& watch) { return version(watch.key) != watch.version; })) {
+      return Result<void>::Err(Error::kWatchConflict);
+    }
+    return apply(mutations);
+  }
+
+  /// delete all keys.
+  /// the default implementation deletes the stored keys by one [apply].
+  /// \return Result of operation
+  virtual Result<void> clear() {
+    auto keys = this->keys("*");
+    if (keys.is_err()) {
+      return Result<void>::Err(keys.err().value());
+    }
+    std::vector<Mutation> mutations;
+    for (auto& key : keys.unwrap()) {
+      mutations.push_back({std::move(key), std::nullopt});
+    }
+    return apply(mutations);
+  }
 };
 
 }  // namespace eidos::storage
@@ -14,170 +14,152 @@
 
 #pragma once
 
-#include <boost/asio.hpp>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+
+#include <algorithm>
 #include <boost/log/trivial.hpp>
-#include <cstddef>
+#include <cerrno>
+#include <chrono>
+#include <cstring>
 #include <string>
-#include <vector>
+#include <utility>
+
+#include "asio.hpp"
+#include "log.hpp"
+#include "trace.hpp"
 
 namespace eidos::net::tcp {
 
-/// TCP socket wrapper
-class Socket {
+/// address of the peer (IP:PORT)
+/// \param socket connected socket
+/// \return peer address or empty string if the socket is not connected
+inline std::string PeerAddress(const boost::asio::ip::tcp::socket& socket) {
+  boost::system::error_code ec;
+  const auto endpoint = socket.remote_endpoint(ec);
+  if (ec) {
+    return "";
+  }
+  return endpoint.address().to_string() + ":" + std::to_string(endpoint.port());
+}
+
+/// enable TCP keepalive.
+/// the connection is dropped after three unanswered probes sent every [seconds] / 3 after [seconds] idle.
+/// \param fd connected socket
+/// \param seconds idle time before the first probe
+inline void SetKeepAlive(int fd, int seconds) {
+  const int enable = 1;
+  const int interval = std::max(seconds / 3, 1);
+  const int count = 3;
+  if (::setsockopt(fd, SOL_SOCKET, SO_KEEPALIVE, &enable, sizeof(enable)) != 0 ||
+      ::setsockopt(fd, IPPROTO_TCP, TCP_KEEPIDLE, &seconds, sizeof(seconds)) != 0 ||
+      ::setsockopt(fd, IPPROTO_TCP, TCP_KEEPINTVL, &interval, sizeof(interval)) != 0 ||
+      ::setsockopt(fd, IPPROTO_TCP, TCP_KEEPCNT, &count, sizeof(count)) != 0) {
+    EIDOS_LOG_DEBUG << "failed to set TCP keepalive: " << std::strerror(errno);
+  }
+}
+
+/// accept failed by lack of resources (file descriptors or memory).
+/// the listener waits [kAcceptBackoff] before the next accept instead of spinning on the error.
+/// \param ec accept error
+/// \return true if the error is a resource error
+inline bool IsResourceError(const boost::system::error_code& ec) {
+  return ec == boost::asio::error::no_descriptors || ec == boost::asio::error::no_buffer_space ||
+         ec == boost::asio::error::no_memory ||
+         (ec.category() == boost::system::system_category() && ec.value() == ENFILE);
+}
+
+/// wait time after an accept error caused by lack of resources
+inline constexpr std::chrono::milliseconds kAcceptBackoff(100);
+
+/// connection accepted by [Listen] (asio reactor transport).
+/// has the same interface as uring::Connection so the session is independent of the transport.
+class Connection {
  private:
   boost::asio::ip::tcp::socket socket_;
-  boost::asio::streambuf buffer_;
-
- public:
-  explicit Socket(boost::asio::io_context& ioc) : socket_(ioc) {}
 
  public:
-  /// socket getter
-  /// \return reference of socket
-  [[nodiscard]] boost::asio::ip::tcp::socket& socket() { return socket_; }
+  explicit Connection(boost::asio::ip::tcp::socket socket) : socket_(std::move(socket)) {}
 
  public:
-  /// read bytes until pattern appeared
-  /// \tparam F read event callback type
-  /// \param pattern pattern
-  /// \param on_read read event handler
-  template <class F>
-  void readBytes(const std::string& pattern, F&& on_read) {
-    const auto endpoint = socket_.remote_endpoint();
-
-    boost::asio::async_read_until(
-        socket_, buffer_, pattern,
-        [this, on_read = std::forward<F>(on_read), endpoint](const boost::system::error_code& ec, std::size_t length) {
-          if (ec) {
-            if (ec.value() == boost::asio::error::eof) {
-              BOOST_LOG_TRIVIAL(trace) << "connection closed by peer (peer: " << endpoint << ")";
-            } else {
-              BOOST_LOG_TRIVIAL(error) << "read bytes error: " << ec << " (peer: " << endpoint << ")";
-            }
-            return;
-          }
-          BOOST_LOG_TRIVIAL(trace) << "read successful (" << length << " bytes) (peer: " << endpoint << ")";
-          auto data = boost::asio::buffer_cast<const std::byte*>(buffer_.data());
-          std::vector<std::byte> bytes(data, data + length);
-          buffer_.consume(length);
-          on_read(bytes);
-        });
+  /// wait until bytes can be read
+  /// \tparam Token completion token type
+  /// \param token completion token
+  template <class Token>
+  auto async_wait_read(Token&& token) {
+    return socket_.async_wait(boost::asio::ip::tcp::socket::wait_read, std::forward<Token>(token));
   }
 
-  /// read [length] bytes
-  /// \tparam F read event callback type
-  /// \param length bytes length
-  /// \param on_read read event handler
-  template <class F>
-  void readBytes(std::size_t length, F&& on_read) {
-    const auto endpoint = socket_.remote_endpoint();
-
-    const auto callback = [this, on_read = std::forward<F>(on_read), endpoint](const boost::system::error_code& ec,
-                                                                               std::size_t length) {
-      if (ec) {
-        if (ec.value() == boost::asio::error::eof) {
-          BOOST_LOG_TRIVIAL(trace) << "connection closed by peer (peer: " << endpoint << ")";
-        } else {
-          BOOST_LOG_TRIVIAL(error) << "read bytes error: " << ec << " (peer: " << endpoint << ")";
-        }
-        return;
-      }
-      BOOST_LOG_TRIVIAL(trace) << "read successful (" << length << " bytes) (peer: " << endpoint << ")";
-      auto data = boost::asio::buffer_cast<const std::byte*>(buffer_.data());
-      std::vector<std::byte> bytes(data, data + length);
-      buffer_.consume(length);
-      on_read(bytes);
-    };
-
-    if (buffer_.size() >= length) {
-      // already read
-      callback(boost::system::error_code{}, length);
-      return;
-    }
-    boost::asio::async_read(socket_, buffer_, boost::asio::transfer_exactly(length), callback);
+  /// read some bytes
+  /// \tparam Token completion token type
+  /// \param buffer read buffer
+  /// \param token completion token
+  template <class Token>
+  auto async_read_some(boost::asio::mutable_buffer buffer, Token&& token) {
+    return socket_.async_read_some(buffer, std::forward<Token>(token));
   }
 
-  /// read string until patter appeared
-  /// \tparam F read event callback type
-  /// \param pattern pattern
-  /// \param on_read read event handler
-  template <class F>
-  void readString(const std::string& pattern, F&& on_read) {
-    const auto endpoint = socket_.remote_endpoint();
-
-    boost::asio::async_read_until(
-        socket_, buffer_, pattern,
-        [this, on_read = std::forward<F>(on_read), endpoint](const boost::system::error_code& ec, std::size_t length) {
-          if (ec) {
-            if (ec.value() == boost::asio::error::eof) {
-              BOOST_LOG_TRIVIAL(trace) << "connection closed by peer (peer: " << endpoint << ")";
-            } else {
-              BOOST_LOG_TRIVIAL(error) << "read string error: " << ec << " (peer: " << endpoint << ")";
-            }
-            return;
-          }
-          BOOST_LOG_TRIVIAL(trace) << "read successful (" << length << " bytes) (peer: " << endpoint << ")";
-          auto data = boost::asio::buffer_cast<const std::byte*>(buffer_.data());
-          std::string str = eidos::BytesToString(data, data + length);
-          buffer_.consume(length);
-          on_read(str);
-        });
+  /// write all bytes
+  /// \tparam Token completion token type
+  /// \param buffer data (must be valid until the completion)
+  /// \param token completion token
+  template <class Token>
+  auto async_write(boost::asio::const_buffer buffer, Token&& token) {
+    return boost::asio::async_write(socket_, buffer, std::forward<Token>(token));
   }
 
- public:
-  /// write to socket
-  /// \tparam F wrote event handler type
-  /// \param s value to write
-  /// \param on_write wrote event handler
-  template <class F>
-  void write(const std::string& s, F&& on_write) {
-    const auto endpoint = socket_.remote_endpoint();
-
-    boost::asio::async_write(
-        socket_, boost::asio::buffer(s),
-        [on_write = std::forward<F>(on_write), endpoint](const boost::system::error_code& ec, std::size_t length) {
-          if (ec) {
-            BOOST_LOG_TRIVIAL(error) << "write error: " << ec << " (peer: " << endpoint << ")";
-          } else {
-            BOOST_LOG_TRIVIAL(trace) << length << " bytes wrote (peer: " << endpoint << ")";
-          }
-          on_write(!ec.failed());
-        });
-  }
-};
+  /// native socket
+  /// \return file descriptor
+  int nativeHandle() { return socket_.native_handle(); }
 
-/// TCP server (acceptor)
-class Server {
- private:
-  boost::asio::io_context& ioc_;
-  boost::asio::ip::tcp::acceptor acceptor_;
-  std::function<void(std::shared_ptr<Socket>)> on_accept_;
-
- public:
-  explicit Server(boost::asio::io_context& ioc, const boost::asio::ip::tcp::endpoint& ep)
-      : ioc_(ioc), acceptor_(ioc, ep) {}
-
- private:
-  /// start accept socket
-  void accept() {
-    auto sock = std::make_shared<Socket>(ioc_);
-    acceptor_.async_accept(sock->socket(), [this, sock](const boost::system::error_code&) {
-      const auto endpoint = sock->socket().remote_endpoint();
-      BOOST_LOG_TRIVIAL(trace) << "client connected: " << endpoint;
-      on_accept_(sock);
-      ioc_.post([this] { accept(); });
-    });
+  /// cancel pending operations (completed with operation_aborted)
+  void cancel() {
+    boost::system::error_code ec;
+    socket_.cancel(ec);
   }
 
- public:
-  /// start listen
-  /// \tparam F on accept event handler type
-  /// \param on_accept on accept event handler
-  template <class F>
-  void listen(F&& on_accept) {
-    on_accept_ = std::forward<F>(on_accept);
-    accept();
-  }
+  /// address of the peer
+  /// \return peer address (IP:PORT)
+  [[nodiscard]] std::string peer() const { return PeerAddress(socket_); }
 };
 
+/// accept loop.
+/// the acceptor is owned by the coroutine frame.
+/// \tparam F on accept event handler type
+/// \param acceptor listening acceptor
+/// \param on_accept on accept event handler (called with the accepted [Connection])
+template <class F>
+boost::asio::awaitable<void> Accept(boost::asio::ip::tcp::acceptor acceptor, F on_accept) {
+  for (;;) {
+    boost::system::error_code ec;
+    auto socket = co_await acceptor.async_accept(boost::asio::redirect_error(boost::asio::use_awaitable, ec));
+    if (ec) {
+      if (ec == boost::asio::error::operation_aborted) {
+        co_return;
+      }
+      BOOST_LOG_TRIVIAL(error) << "accept error: " << ec.message();
+      if (IsResourceError(ec)) {
+        boost::asio::steady_timer backoff(acceptor.get_executor(), kAcceptBackoff);
+        co_await backoff.async_wait(boost::asio::redirect_error(boost::asio::use_awaitable, ec));
+      }
+      continue;
+    }
+    EIDOS_LOG_TRACE << "client connected: " << PeerAddress(socket);
+    trace::Scope span("accept", "net");
+    on_accept(Connection(std::move(socket)));
+  }
+}
+
+/// start listen
+/// \tparam F on accept event handler type
+/// \param ioc io_context
+/// \param endpoint listen endpoint
+/// \param on_accept on accept event handler (called with the accepted [Connection])
+template <class F>
+void Listen(boost::asio::io_context& ioc, const boost::asio::ip::tcp::endpoint& endpoint, F&& on_accept) {
+  boost::asio::co_spawn(ioc, Accept(boost::asio::ip::tcp::acceptor(ioc, endpoint), std::forward<F>(on_accept)),
+                        boost::asio::detached);
+}
+
 }  // namespace eidos::net::tcp
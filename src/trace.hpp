@@ -0,0 +1,216 @@
+// Copyright 2021 SiLeader and Cerussite.
+//
+// Licensed under the Apache License, Version 2.0 (the “License”);
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an “AS IS” BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#pragma once
+
+#include <unistd.h>
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <iomanip>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <string_view>
+
+#include "per_thread.hpp"
+
+namespace eidos::trace {
+
+/// max number of spans recorded by a thread between START and STOP
+inline constexpr std::size_t kBufferSpans = 1U << 16U;
+
+/// recorded span
+struct Span {
+  std::string_view name{};      // must be a static string
+  std::string_view category{};  // must be a static string
+  std::string_view arg{};       // must be a static string (may be empty)
+  std::uint64_t start = 0;      // ns
+  std::uint64_t duration = 0;   // ns
+};
+
+/// request lifecycle tracer.
+/// spans are appended to a buffer owned by the recording thread without locks and are collected
+/// as Chrome trace JSON (chrome://tracing, Perfetto) when tracing is stopped.
+class Tracer {
+ private:
+  /// spans of a thread (single writer)
+  struct Buffer {
+    std::uint64_t tid;
+    std::atomic<std::uint64_t> generation;
+    std::atomic<std::size_t> size;
+    std::atomic<std::uint64_t> dropped;
+    std::unique_ptr<Span[]> spans;
+
+    /// \param index creation order of the buffer (the thread id in the trace is 1, 2, ...)
+    explicit Buffer(std::size_t index)
+        : tid(index + 1), generation(0), size(0), dropped(0), spans(std::make_unique<Span[]>(kBufferSpans)) {}
+  };
+
+ private:
+  std::atomic<bool> active_;
+  std::atomic<std::uint64_t> generation_;  // incremented by every START
+  eidos::detail::PerThread<Buffer> buffers_;
+
+ public:
+  Tracer() : active_(false), generation_(0), buffers_() {}
+
+  Tracer(const Tracer&) = delete;
+  Tracer& operator=(const Tracer&) = delete;
+
+ public:
+  /// process wide tracer
+  /// \return tracer
+  static Tracer& Global() {
+    static Tracer tracer;
+    return tracer;
+  }
+
+  /// current time
+  /// \return monotonic time (ns)
+  static std::uint64_t Now() {
+    return static_cast<std::uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+                                          std::chrono::steady_clock::now().time_since_epoch())
+                                          .count());
+  }
+
+ private:
+  /// escape JSON string
+  /// \param s string
+  /// \return escaped string
+  static std::string Escape(std::string_view s) {
+    std::string escaped;
+    for (const auto c : s) {
+      if (c == '"' || c == '\\') {
+        escaped += '\\';
+      }
+      escaped += static_cast<unsigned char>(c) < 0x20 ? ' ' : c;
+    }
+    return escaped;
+  }
+
+ public:
+  /// tracing is active
+  /// \return true if spans are recorded
+  [[nodiscard]] bool active() const { return active_.load(std::memory_order_relaxed); }
+
+  /// start tracing. spans recorded by the previous session are discarded.
+  void start() {
+    generation_.fetch_add(1, std::memory_order_relaxed);
+    active_.store(true, std::memory_order_release);
+  }
+
+  /// record a span
+  /// \param name span name
+  /// \param category span category
+  /// \param start start time (ns, [Now])
+  /// \param end end time (ns, [Now])
+  /// \param arg additional argument
+  void record(std::string_view name, std::string_view category, std::uint64_t start, std::uint64_t end,
+              std::string_view arg = {}) {
+    if (!active()) {
+      return;
+    }
+    auto& buffer = buffers_.local();
+    const auto generation = generation_.load(std::memory_order_relaxed);
+    if (buffer.generation.load(std::memory_order_relaxed) != generation) {
+      // first span of this session on this thread
+      buffer.size.store(0, std::memory_order_relaxed);
+      buffer.dropped.store(0, std::memory_order_relaxed);
+      buffer.generation.store(generation, std::memory_order_release);
+    }
+    const auto size = buffer.size.load(std::memory_order_relaxed);
+    if (size >= kBufferSpans) {
+      buffer.dropped.store(buffer.dropped.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+      return;
+    }
+    buffer.spans[size] = Span{name, category, arg, start, end - start};
+    buffer.size.store(size + 1, std::memory_order_release);
+  }
+
+  /// stop tracing and collect spans
+  /// \return Chrome trace JSON
+  std::string stop() {
+    active_.store(false, std::memory_order_release);
+    const auto generation = generation_.load(std::memory_order_relaxed);
+    const auto pid = ::getpid();
+
+    std::stringstream ss;
+    ss << std::fixed << std::setprecision(3) << R"({"displayTimeUnit":"ns","traceEvents":[)";
+    bool first = true;
+    std::uint64_t dropped = 0;
+    buffers_.forEach([&](const Buffer& buffer) {
+      if (buffer.generation.load(std::memory_order_acquire) != generation) {
+        return;
+      }
+      const auto size = buffer.size.load(std::memory_order_acquire);
+      dropped += buffer.dropped.load(std::memory_order_relaxed);
+      for (std::size_t i = 0; i < size; ++i) {
+        const auto& span = buffer.spans[i];
+        ss << (first ? "" : ",") << R"({"name":")" << Escape(span.name) << R"(","cat":")" << Escape(span.category)
+           << R"(","ph":"X","ts":)" << static_cast<double>(span.start) / 1000.0
+           << R"(,"dur":)" << static_cast<double>(span.duration) / 1000.0 << R"(,"pid":)" << pid
+           << R"(,"tid":)" << buffer.tid;
+        if (!span.arg.empty()) {
+          ss << R"(,"args":{"arg":")" << Escape(span.arg) << R"("})";
+        }
+        ss << "}";
+        first = false;
+      }
+    });
+    ss << R"(],"otherData":{"dropped_spans":)" << dropped << "}}";
+    return ss.str();
+  }
+};
+
+/// start time of a span
+/// \return current time (ns) or 0 if tracing is not active
+inline std::uint64_t Begin() { return Tracer::Global().active() ? Tracer::Now() : 0; }
+
+/// record a span started by [Begin]
+/// \param name span name (static string)
+/// \param category span category (static string)
+/// \param begin value returned by [Begin]
+/// \param arg additional argument (static string)
+inline void End(std::string_view name, std::string_view category, std::uint64_t begin, std::string_view arg = {}) {
+  if (begin != 0) {
+    Tracer::Global().record(name, category, begin, Tracer::Now(), arg);
+  }
+}
+
+/// span of the current scope
+class Scope {
+ private:
+  std::string_view name_;
+  std::string_view category_;
+  std::string_view arg_;
+  std::uint64_t begin_;
+
+ public:
+  /// constructor
+  /// \param name span name (static string)
+  /// \param category span category (static string)
+  /// \param arg additional argument (static string)
+  Scope(std::string_view name, std::string_view category, std::string_view arg = {})
+      : name_(name), category_(category), arg_(arg), begin_(Begin()) {}
+
+  ~Scope() { End(name_, category_, begin_, arg_); }
+
+  Scope(const Scope&) = delete;
+  Scope& operator=(const Scope&) = delete;
+};
+
+}  // namespace eidos::trace
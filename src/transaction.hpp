@@ -0,0 +1,212 @@
+// Copyright 2021 SiLeader and Cerussite.
+//
+// Licensed under the Apache License, Version 2.0 (the “License”);
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an “AS IS” BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <eidos/types.hpp>
+#include <span>
+#include <string>
+#include <tuple>
+#include <utility>
+#include <vector>
+
+#include "commands.hpp"
+#include "storage/storage_base.hpp"
+
+// transactions (MULTI, EXEC, DISCARD and WATCH).
+// commands are queued by the session until EXEC and executed against [BufferedEngine], so the writes of a
+// transaction reach the storage engine as one batch (one log entry under the Raft engine).
+// WATCH uses the version stamps of the engine (optimistic locking).
+namespace eidos::transaction {
+
+/// storage engine view of a transaction being executed.
+/// writes are buffered until [commit] and reads see the writes buffered before them.
+/// KEYS, the dump and the number of keys see the stored keys only.
+class BufferedEngine : public storage::StorageEngineBase {
+ private:
+  storage::StorageEngineBase& engine_;
+  std::vector<storage::Mutation> mutations_;
+
+ public:
+  /// constructor
+  /// \param engine storage engine that the writes are applied to
+  explicit BufferedEngine(storage::StorageEngineBase& engine) : engine_(engine), mutations_() {}
+
+ private:
+  /// last buffered write of the key
+  /// \param key key
+  /// \return write or nullptr if the key is not written by the transaction
+  [[nodiscard]] const storage::Mutation* find(const Key& key) const {
+    const auto itr = std::find_if(std::rbegin(mutations_), std::rend(mutations_),
+                                  [&key](const storage::Mutation& m) { return m.key.bytes() == key.bytes(); });
+    return itr == std::rend(mutations_) ? nullptr : &*itr;
+  }
+
+ public:
+  Result<void> set(const Key& key, const Value& value) override {
+    mutations_.push_back({key, value});
+    return Result<void>::Ok();
+  }
+
+  Result<Value> get(const Key& key) override {
+    if (const auto* mutation = find(key); mutation != nullptr) {
+      return mutation->value ? Result<Value>::Ok(mutation->value.value())
+                             : Result<Value>::Err(storage::Error::kNotFound);
+    }
+    return engine_.get(key);
+  }
+
+  Result<void> del(const Key& key) override {
+    const auto exists = this->exists(key);
+    if (exists.is_err()) {
+      return Result<void>::Err(exists.err().value());
+    }
+    if (!exists.unwrap()) {
+      return Result<void>::Err(storage::Error::kNotFound);
+    }
+    mutations_.push_back({key, std::nullopt});
+    return Result<void>::Ok();
+  }
+
+  Result<bool> exists(const Key& key) override {
+    if (const auto* mutation = find(key); mutation != nullptr) {
+      return Result<bool>::Ok(mutation->value.has_value());
+    }
+    return engine_.exists(key);
+  }
+
+  Result<std::vector<Key>> keys(const std::string& pattern) override { return engine_.keys(pattern); }
+
+  Result<std::vector<std::tuple<Key, Value>>> dump() override { return engine_.dump(); }
+
+  Result<std::size_t> size() override { return engine_.size(); }
+
+  std::uint64_t version(const Key& key) override { return engine_.version(key); }
+
+  Result<void> clear() override {
+    auto keys = engine_.keys("*");
+    if (keys.is_err()) {
+      return Result<void>::Err(keys.err().value());
+    }
+    auto cleared = keys.unwrap();
+    for (const auto& mutation : mutations_) {
+      cleared.push_back(mutation.key);
+    }
+    for (auto& key : cleared) {
+      if (exists(key).unwrap_or(false)) {
+        mutations_.push_back({std::move(key), std::nullopt});
+      }
+    }
+    return Result<void>::Ok();
+  }
+
+  Result<void> apply(const std::vector<storage::Mutation>& mutations) override {
+    mutations_.insert(std::end(mutations_), std::begin(mutations), std::end(mutations));
+    return Result<void>::Ok();
+  }
+
+ public:
+  /// apply the buffered writes to the engine at once
+  /// \param watched watched keys. the writes are discarded if one of them has been written
+  /// \return Result of operation
+  Result<void> commit(const std::vector<storage::Watch>& watched = {}) {
+    return engine_.applyIfUnchanged(mutations_, watched);
+  }
+
+  /// buffered writes
+  /// \return writes in order
+  [[nodiscard]] const std::vector<storage::Mutation>& mutations() const { return mutations_; }
+};
+
+/// command queued by MULTI
+struct Command {
+  const commands::Spec* spec;
+  std::vector<std::vector<std::byte>> args;
+};
+
+/// transaction state of a client session
+class Transaction {
+ private:
+  bool active_;   // in MULTI
+  bool aborted_;  // a command was rejected while queueing
+  std::vector<Command> queue_;
+  std::vector<storage::Watch> watched_;  // key and version stamp at WATCH
+
+ public:
+  Transaction() : active_(false), aborted_(false), queue_(), watched_() {}
+
+ public:
+  /// start queueing commands (MULTI)
+  void begin() {
+    active_ = true;
+    aborted_ = false;
+  }
+
+  /// queue a command
+  /// \param spec command metadata
+  /// \param args command arguments
+  void queue(const commands::Spec& spec, std::span<const std::vector<std::byte>> args) {
+    queue_.push_back({&spec, std::vector<std::vector<std::byte>>(std::begin(args), std::end(args))});
+  }
+
+  /// mark the transaction as failed, so EXEC discards it. no effect outside of MULTI
+  void abort() { aborted_ = active_; }
+
+  /// watch the key. EXEC fails if the key is written before it
+  /// \param engine storage engine
+  /// \param key key
+  void watch(storage::StorageEngineBase& engine, const Key& key) { watched_.push_back({key, engine.version(key)}); }
+
+  /// forget all watched keys (UNWATCH)
+  void unwatch() { watched_.clear(); }
+
+  /// end the transaction (EXEC or DISCARD). watched keys are forgotten
+  /// \return queued commands
+  std::vector<Command> finish() {
+    active_ = false;
+    aborted_ = false;
+    watched_.clear();
+    return std::exchange(queue_, {});
+  }
+
+ public:
+  /// in MULTI
+  /// \return true if commands are queued
+  [[nodiscard]] bool active() const { return active_; }
+
+  /// a command was rejected while queueing
+  /// \return true if EXEC must discard the transaction
+  [[nodiscard]] bool aborted() const { return aborted_; }
+
+  /// number of queued commands
+  /// \return number of commands
+  [[nodiscard]] std::size_t queued() const { return queue_.size(); }
+
+  /// check the watched keys
+  /// \param engine storage engine
+  /// \return true if a watched key may have been written since WATCH
+  [[nodiscard]] bool changed(storage::StorageEngineBase& engine) const {
+    return std::any_of(std::begin(watched_), std::end(watched_),
+                       [&engine](const auto& watched) { return engine.version(watched.key) != watched.version; });
+  }
+
+  /// watched keys
+  /// \return keys and their version stamps at WATCH
+  [[nodiscard]] const std::vector<storage::Watch>& watched() const { return watched_; }
+};
+
+}  // namespace eidos::transaction
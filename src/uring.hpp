@@ -0,0 +1,740 @@
+// Copyright 2021 SiLeader and Cerussite.
+//
+// Licensed under the Apache License, Version 2.0 (the “License”);
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an “AS IS” BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#pragma once
+
+#include <arpa/inet.h>
+#include <linux/io_uring.h>
+#include <netinet/in.h>
+#include <sys/eventfd.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <boost/log/trivial.hpp>
+#include <cerrno>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <eidos/result.hpp>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "asio.hpp"
+#include "log.hpp"
+#include "tcp.hpp"
+#include "trace.hpp"
+
+// io_uring network backend.
+// the kernel interface is used directly (no liburing). requires Linux 6.0 or later
+// (multishot accept and multishot receive with provided buffers).
+namespace eidos::net::uring {
+
+namespace detail {
+
+/// move-only type erased completion handler
+class Completion {
+ private:
+  struct Base {
+    virtual ~Base() = default;
+    virtual void operator()(const boost::system::error_code& ec, std::size_t size) = 0;
+  };
+
+  template <class H>
+  struct Impl : Base {
+    H handler;
+    explicit Impl(H h) : handler(std::move(h)) {}
+    void operator()(const boost::system::error_code& ec, std::size_t size) override { handler(ec, size); }
+  };
+
+  std::unique_ptr<Base> impl_;
+
+ public:
+  Completion() : impl_() {}
+
+  template <class H>
+  explicit Completion(H handler) : impl_(std::make_unique<Impl<H>>(std::move(handler))) {}
+
+  explicit operator bool() const { return static_cast<bool>(impl_); }
+
+  /// post the completion to the executor
+  /// \param executor executor
+  /// \param ec error
+  /// \param size transferred bytes
+  template <class Executor>
+  void post(const Executor& executor, const boost::system::error_code& ec, std::size_t size) {
+    boost::asio::post(executor, [impl = std::move(impl_), ec, size]() mutable { (*impl)(ec, size); });
+  }
+};
+
+/// error code from negative errno
+/// \param res negative errno
+/// \return error code
+inline boost::system::error_code Error(int res) { return {-res, boost::system::system_category()}; }
+
+}  // namespace detail
+
+/// receiver of completion queue entries.
+/// the address of the receiver and a tag are stored in user_data of the submission.
+class Operation {
+ public:
+  virtual ~Operation() = default;
+
+  /// completion queue entry arrived
+  /// \param tag tag given to the submission
+  /// \param res result
+  /// \param flags completion flags
+  virtual void complete(unsigned tag, int res, unsigned flags) = 0;
+};
+
+/// io_uring instance driven by an io_context.
+/// completions are announced by an eventfd waited by the io_context and submissions queued while handlers run are
+/// flushed together by one io_uring_enter.
+class Ring final : public Operation, public std::enable_shared_from_this<Ring> {
+ public:
+  template <class T>
+  using Result = eidos::result::Result<T, std::string>;
+
+  static constexpr unsigned kEntries = 4096;
+  static constexpr unsigned kBufferCount = 1024;
+  static constexpr std::size_t kBufferSize = 16 * 1024;  // same as RequestContext::kReadSize
+  static constexpr unsigned short kBufferGroup = 0;
+
+ private:
+  boost::asio::io_context& ioc_;
+  int fd_;
+  io_uring_params params_;
+
+  // submission queue
+  void* sq_ptr_;
+  std::size_t sq_size_;
+  unsigned* sq_head_;
+  unsigned* sq_tail_;
+  unsigned* sq_flags_;
+  unsigned sq_mask_;
+  unsigned* sq_array_;
+  io_uring_sqe* sqes_;
+  unsigned sq_local_tail_;
+  unsigned pending_;
+  bool flush_scheduled_;
+
+  // completion queue
+  void* cq_ptr_;
+  std::size_t cq_size_;
+  unsigned* cq_head_;
+  unsigned* cq_tail_;
+  unsigned cq_mask_;
+  io_uring_cqe* cqes_;
+
+  // provided buffers
+  std::unique_ptr<char[]> buffers_;
+
+  boost::asio::posix::stream_descriptor event_;
+
+ public:
+  explicit Ring(boost::asio::io_context& ioc)
+      : ioc_(ioc),
+        fd_(-1),
+        params_(),
+        sq_ptr_(MAP_FAILED),
+        sq_size_(0),
+        sq_head_(nullptr),
+        sq_tail_(nullptr),
+        sq_flags_(nullptr),
+        sq_mask_(0),
+        sq_array_(nullptr),
+        sqes_(static_cast<io_uring_sqe*>(MAP_FAILED)),
+        sq_local_tail_(0),
+        pending_(0),
+        flush_scheduled_(false),
+        cq_ptr_(MAP_FAILED),
+        cq_size_(0),
+        cq_head_(nullptr),
+        cq_tail_(nullptr),
+        cq_mask_(0),
+        cqes_(nullptr),
+        buffers_(),
+        event_(ioc) {}
+
+  ~Ring() {
+    if (sqes_ != MAP_FAILED) {
+      ::munmap(sqes_, params_.sq_entries * sizeof(io_uring_sqe));
+    }
+    if (cq_ptr_ != MAP_FAILED && cq_ptr_ != sq_ptr_) {
+      ::munmap(cq_ptr_, cq_size_);
+    }
+    if (sq_ptr_ != MAP_FAILED) {
+      ::munmap(sq_ptr_, sq_size_);
+    }
+    if (fd_ >= 0) {
+      ::close(fd_);
+    }
+  }
+
+  Ring(const Ring&) = delete;
+  Ring& operator=(const Ring&) = delete;
+
+ private:
+  /// set up the ring, the provided buffers and the eventfd
+  /// \return Result of setup
+  Result<void> setup() {
+    // COOP_TASKRUN is not used: completions must be posted (and the eventfd signaled) while the io_context blocks
+    // in epoll_wait
+    params_.flags = IORING_SETUP_SINGLE_ISSUER;
+    fd_ = static_cast<int>(::syscall(__NR_io_uring_setup, kEntries, &params_));
+    if (fd_ < 0 && errno == EINVAL) {
+      params_ = io_uring_params{};
+      fd_ = static_cast<int>(::syscall(__NR_io_uring_setup, kEntries, &params_));
+    }
+    if (fd_ < 0) {
+      return Result<void>::Err(std::string("io_uring_setup: ") + std::strerror(errno));
+    }
+
+    // rings
+    sq_size_ = params_.sq_off.array + params_.sq_entries * sizeof(unsigned);
+    cq_size_ = params_.cq_off.cqes + params_.cq_entries * sizeof(io_uring_cqe);
+    const bool single = (params_.features & IORING_FEAT_SINGLE_MMAP) != 0;
+    if (single) {
+      sq_size_ = cq_size_ = std::max(sq_size_, cq_size_);
+    }
+    sq_ptr_ = ::mmap(nullptr, sq_size_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd_, IORING_OFF_SQ_RING);
+    if (sq_ptr_ == MAP_FAILED) {
+      return Result<void>::Err(std::string("mmap (SQ): ") + std::strerror(errno));
+    }
+    cq_ptr_ = single ? sq_ptr_
+                     : ::mmap(nullptr, cq_size_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd_,
+                              IORING_OFF_CQ_RING);
+    if (cq_ptr_ == MAP_FAILED) {
+      return Result<void>::Err(std::string("mmap (CQ): ") + std::strerror(errno));
+    }
+    sqes_ = static_cast<io_uring_sqe*>(::mmap(nullptr, params_.sq_entries * sizeof(io_uring_sqe),
+                                              PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd_,
+                                              IORING_OFF_SQES));
+    if (sqes_ == MAP_FAILED) {
+      return Result<void>::Err(std::string("mmap (SQE): ") + std::strerror(errno));
+    }
+    auto* sq = static_cast<char*>(sq_ptr_);
+    sq_head_ = reinterpret_cast<unsigned*>(sq + params_.sq_off.head);
+    sq_tail_ = reinterpret_cast<unsigned*>(sq + params_.sq_off.tail);
+    sq_flags_ = reinterpret_cast<unsigned*>(sq + params_.sq_off.flags);
+    sq_mask_ = *reinterpret_cast<unsigned*>(sq + params_.sq_off.ring_mask);
+    sq_array_ = reinterpret_cast<unsigned*>(sq + params_.sq_off.array);
+    sq_local_tail_ = *sq_tail_;
+    auto* cq = static_cast<char*>(cq_ptr_);
+    cq_head_ = reinterpret_cast<unsigned*>(cq + params_.cq_off.head);
+    cq_tail_ = reinterpret_cast<unsigned*>(cq + params_.cq_off.tail);
+    cq_mask_ = *reinterpret_cast<unsigned*>(cq + params_.cq_off.ring_mask);
+    cqes_ = reinterpret_cast<io_uring_cqe*>(cq + params_.cq_off.cqes);
+
+    // provided buffers.
+    // the buffers are given by IORING_OP_PROVIDE_BUFFERS instead of a registered buffer ring
+    // (IORING_REGISTER_PBUF_RING). this is a deliberate deviation: the buffer ring was not working in this
+    // implementation (receives got no buffer), so it is not used. the cost is one extra SQE for each batch of buffers
+    // given back to the kernel.
+    buffers_ = std::make_unique<char[]>(kBufferCount * kBufferSize);
+    provide(0, kBufferCount);
+
+    // completion notification
+    const auto efd = ::eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (efd < 0) {
+      return Result<void>::Err(std::string("eventfd: ") + std::strerror(errno));
+    }
+    event_.assign(efd);
+    if (::syscall(__NR_io_uring_register, fd_, IORING_REGISTER_EVENTFD, &efd, 1) < 0) {
+      return Result<void>::Err(std::string("register eventfd: ") + std::strerror(errno));
+    }
+    return Result<void>::Ok();
+  }
+
+  /// give buffers to the kernel
+  /// \param id first buffer id
+  /// \param count number of buffers
+  void provide(unsigned short id, unsigned count) {
+    auto& sqe = prepare(this, 0);
+    sqe.opcode = IORING_OP_PROVIDE_BUFFERS;
+    sqe.fd = static_cast<std::int32_t>(count);
+    sqe.addr = reinterpret_cast<std::uint64_t>(buffer(id));
+    sqe.len = kBufferSize;
+    sqe.off = id;
+    sqe.buf_group = kBufferGroup;
+    sqe.flags = IOSQE_CQE_SKIP_SUCCESS;
+  }
+
+  /// wait for completions and dispatch them
+  void wait() {
+    event_.async_wait(boost::asio::posix::stream_descriptor::wait_read,
+                      [self = shared_from_this()](const boost::system::error_code& ec) {
+                        if (ec) {
+                          return;
+                        }
+                        std::uint64_t count = 0;
+                        [[maybe_unused]] const auto n = ::read(self->event_.native_handle(), &count, sizeof(count));
+                        self->reap();
+                        self->wait();
+                      });
+  }
+
+  /// dispatch all completion queue entries
+  void reap() {
+    for (;;) {
+      auto head = *cq_head_;
+      const auto tail = std::atomic_ref(*cq_tail_).load(std::memory_order_acquire);
+      if (head == tail) {
+        break;
+      }
+      for (; head != tail; ++head) {
+        const auto cqe = cqes_[head & cq_mask_];
+        std::atomic_ref(*cq_head_).store(head + 1, std::memory_order_release);
+        auto* operation = reinterpret_cast<Operation*>(cqe.user_data & ~std::uint64_t{7});
+        operation->complete(static_cast<unsigned>(cqe.user_data & 7), cqe.res, cqe.flags);
+      }
+    }
+    if ((std::atomic_ref(*sq_flags_).load(std::memory_order_relaxed) & IORING_SQ_CQ_OVERFLOW) != 0) {
+      // flush overflowed completions to the ring (they are announced by the eventfd)
+      ::syscall(__NR_io_uring_enter, fd_, 0, 0, IORING_ENTER_GETEVENTS, nullptr, 0);
+    }
+  }
+
+ public:
+  /// create io_uring instance
+  /// \param ioc io_context
+  /// \return ring or error message if io_uring is not available
+  static Result<std::shared_ptr<Ring>> Create(boost::asio::io_context& ioc) {
+    auto ring = std::make_shared<Ring>(ioc);
+    if (const auto result = ring->setup(); result.is_err()) {
+      return Result<std::shared_ptr<Ring>>::Err(result.err().value());
+    }
+    ring->wait();
+    return Result<std::shared_ptr<Ring>>::Ok(ring);
+  }
+
+  /// io_context executor
+  /// \return executor
+  boost::asio::io_context::executor_type executor() { return ioc_.get_executor(); }
+
+  /// get a submission queue entry. queued entries are submitted after the running handlers.
+  /// \param operation receiver of the completion
+  /// \param tag tag of the submission (0-7)
+  /// \return zero filled submission queue entry
+  io_uring_sqe& prepare(Operation* operation, unsigned tag) {
+    if (sq_local_tail_ - std::atomic_ref(*sq_head_).load(std::memory_order_acquire) >= params_.sq_entries) {
+      submit();
+    }
+    const auto index = sq_local_tail_ & sq_mask_;
+    auto& sqe = sqes_[index];
+    std::memset(&sqe, 0, sizeof(sqe));
+    sqe.user_data = reinterpret_cast<std::uint64_t>(operation) | tag;
+    sq_array_[index] = index;
+    sq_local_tail_++;
+    pending_++;
+    if (!flush_scheduled_) {
+      flush_scheduled_ = true;
+      boost::asio::post(ioc_, [self = shared_from_this()] {
+        self->flush_scheduled_ = false;
+        self->submit();
+      });
+    }
+    return sqe;
+  }
+
+  /// submit queued entries
+  void submit() {
+    if (pending_ == 0) {
+      return;
+    }
+    std::atomic_ref(*sq_tail_).store(sq_local_tail_, std::memory_order_release);
+    const auto n = ::syscall(__NR_io_uring_enter, fd_, pending_, 0, 0, nullptr, 0);
+    if (n < 0) {
+      BOOST_LOG_TRIVIAL(error) << "io_uring_enter: " << std::strerror(errno);
+      return;
+    }
+    pending_ -= static_cast<unsigned>(n);
+  }
+
+  /// provided buffer
+  /// \param id buffer id
+  /// \return address of the buffer
+  const char* buffer(unsigned short id) const { return buffers_.get() + static_cast<std::size_t>(id) * kBufferSize; }
+
+  /// give the buffer back to the kernel
+  /// \param id buffer id
+  void recycle(unsigned short id) { provide(id, 1); }
+
+  void complete(unsigned, int res, unsigned) override {
+    // successful PROVIDE_BUFFERS do not post completions
+    BOOST_LOG_TRIVIAL(error) << "provide buffers: " << detail::Error(res).message();
+  }
+};
+
+/// connection accepted by [Listen].
+/// data is received by a multishot receive into provided buffers and copied to the read buffer of the session.
+class Connection {
+ private:
+  /// socket state shared with in-flight submissions. deleted when the connection is closed and all submissions
+  /// are completed.
+  class Socket : public Operation {
+   private:
+    enum Tag : unsigned { kRecv = 1, kSend = 2, kCancel = 3 };
+
+    struct Chunk {
+      unsigned short id;
+      std::size_t offset;
+      std::size_t size;
+    };
+
+   private:
+    std::shared_ptr<Ring> ring_;
+    int fd_;
+    unsigned outstanding_;  // submissions waiting for the final completion
+    bool receiving_;        // multishot receive is armed
+    bool closed_;
+    boost::system::error_code read_error_;
+    std::vector<Chunk> chunks_;
+    std::size_t chunk_head_;
+    boost::asio::mutable_buffer read_buffer_;
+    detail::Completion read_;
+    const char* send_data_;
+    std::size_t send_size_;
+    std::size_t sent_;
+    detail::Completion send_;
+
+   public:
+    Socket(std::shared_ptr<Ring> ring, int fd)
+        : ring_(std::move(ring)),
+          fd_(fd),
+          outstanding_(0),
+          receiving_(false),
+          closed_(false),
+          read_error_(),
+          chunks_(),
+          chunk_head_(0),
+          read_buffer_(),
+          read_(),
+          send_data_(nullptr),
+          send_size_(0),
+          sent_(0),
+          send_() {}
+
+    Socket(const Socket&) = delete;
+    Socket& operator=(const Socket&) = delete;
+
+   private:
+    /// arm multishot receive
+    void receive() {
+      auto& sqe = ring_->prepare(this, kRecv);
+      sqe.opcode = IORING_OP_RECV;
+      sqe.fd = fd_;
+      sqe.ioprio = IORING_RECV_MULTISHOT;
+      sqe.flags = IOSQE_BUFFER_SELECT;
+      sqe.buf_group = Ring::kBufferGroup;
+      receiving_ = true;
+      outstanding_++;
+    }
+
+    /// send the rest of the write buffer
+    void sendRest() {
+      auto& sqe = ring_->prepare(this, kSend);
+      sqe.opcode = IORING_OP_SEND;
+      sqe.fd = fd_;
+      sqe.addr = reinterpret_cast<std::uint64_t>(send_data_ + sent_);
+      sqe.len = static_cast<std::uint32_t>(std::min<std::size_t>(send_size_ - sent_, 1U << 30U));
+      sqe.msg_flags = MSG_NOSIGNAL;
+      outstanding_++;
+    }
+
+    /// copy received chunks to the read buffer and complete the read
+    void fill() {
+      auto* out = static_cast<char*>(read_buffer_.data());
+      std::size_t copied = 0;
+      while (chunk_head_ < chunks_.size() && copied < read_buffer_.size()) {
+        auto& chunk = chunks_[chunk_head_];
+        const auto n = std::min(chunk.size, read_buffer_.size() - copied);
+        std::memcpy(out + copied, ring_->buffer(chunk.id) + chunk.offset, n);
+        copied += n;
+        chunk.offset += n;
+        chunk.size -= n;
+        if (chunk.size == 0) {
+          ring_->recycle(chunk.id);
+          chunk_head_++;
+        }
+      }
+      if (chunk_head_ == chunks_.size()) {
+        chunks_.clear();
+        chunk_head_ = 0;
+      }
+      read_.post(ring_->executor(), copied > 0 ? boost::system::error_code{} : read_error_, copied);
+    }
+
+    /// delete this if closed and no submission is in flight
+    void release() {
+      if (closed_ && outstanding_ == 0) {
+        delete this;
+      }
+    }
+
+   public:
+    void complete(unsigned tag, int res, unsigned flags) override {
+      if ((flags & IORING_CQE_F_MORE) == 0) {
+        outstanding_--;
+      }
+      if (tag == kRecv) {
+        if ((flags & IORING_CQE_F_MORE) == 0) {
+          receiving_ = false;
+        }
+        if (res > 0) {
+          const auto id = static_cast<unsigned short>(flags >> IORING_CQE_BUFFER_SHIFT);
+          if (closed_) {
+            ring_->recycle(id);
+          } else {
+            chunks_.push_back({id, 0, static_cast<std::size_t>(res)});
+          }
+        } else if (res == 0) {
+          read_error_ = boost::asio::error::eof;
+        } else if (res != -ENOBUFS && res != -ECANCELED) {
+          read_error_ = detail::Error(res);
+        }
+        if (read_ && (chunk_head_ < chunks_.size() || read_error_)) {
+          fill();
+        } else if (read_ && !receiving_) {
+          // ran out of provided buffers. the buffers are given back by other connections
+          receive();
+        }
+      } else if (tag == kSend && !closed_) {
+        if (res < 0) {
+          send_.post(ring_->executor(), detail::Error(res), sent_);
+        } else {
+          sent_ += static_cast<std::size_t>(res);
+          if (sent_ < send_size_) {
+            sendRest();
+          } else {
+            send_.post(ring_->executor(), {}, sent_);
+          }
+        }
+      }
+      release();
+    }
+
+    /// read received data
+    /// \param buffer read buffer
+    /// \param completion completion handler
+    void read(boost::asio::mutable_buffer buffer, detail::Completion completion) {
+      read_buffer_ = buffer;
+      read_ = std::move(completion);
+      if (chunk_head_ < chunks_.size() || read_error_) {
+        fill();
+      } else if (!receiving_) {
+        receive();
+      }
+    }
+
+    /// write all data
+    /// \param buffer data (must be valid until the completion)
+    /// \param completion completion handler
+    void write(boost::asio::const_buffer buffer, detail::Completion completion) {
+      send_data_ = static_cast<const char*>(buffer.data());
+      send_size_ = buffer.size();
+      sent_ = 0;
+      send_ = std::move(completion);
+      sendRest();
+    }
+
+    /// address of the peer
+    /// \return peer address (IP:PORT)
+    [[nodiscard]] std::string peer() const {
+      sockaddr_storage storage{};
+      socklen_t length = sizeof(storage);
+      if (::getpeername(fd_, reinterpret_cast<sockaddr*>(&storage), &length) != 0 || storage.ss_family != AF_INET) {
+        return "";
+      }
+      const auto& addr = reinterpret_cast<const sockaddr_in&>(storage);
+      char host[INET_ADDRSTRLEN] = {};
+      ::inet_ntop(AF_INET, &addr.sin_addr, host, sizeof(host));
+      return std::string(host) + ":" + std::to_string(ntohs(addr.sin_port));
+    }
+
+    /// cancel the pending send
+    void cancelWrite() {
+      if (!send_) {
+        return;
+      }
+      auto& sqe = ring_->prepare(this, kCancel);
+      sqe.opcode = IORING_OP_ASYNC_CANCEL;
+      sqe.addr = reinterpret_cast<std::uint64_t>(this) | kSend;
+      outstanding_++;
+    }
+
+    /// complete the pending read with operation_aborted. the multishot receive stays armed
+    void cancelRead() {
+      if (read_) {
+        read_.post(ring_->executor(), boost::asio::error::operation_aborted, 0);
+      }
+    }
+
+    /// socket
+    /// \return file descriptor
+    [[nodiscard]] int fd() const { return fd_; }
+
+    /// cancel the receive, close the socket and delete this when all submissions are completed
+    void close() {
+      for (std::size_t i = chunk_head_; i < chunks_.size(); ++i) {
+        ring_->recycle(chunks_[i].id);
+      }
+      chunks_.clear();
+      if (receiving_) {
+        auto& sqe = ring_->prepare(this, kCancel);
+        sqe.opcode = IORING_OP_ASYNC_CANCEL;
+        sqe.addr = reinterpret_cast<std::uint64_t>(this) | kRecv;
+        outstanding_++;
+      }
+      // in-flight submissions keep their own reference to the file
+      ::close(fd_);
+      closed_ = true;
+      release();
+    }
+  };
+
+ private:
+  Socket* socket_;
+
+ public:
+  /// constructor
+  /// \param ring io_uring instance
+  /// \param fd accepted socket
+  Connection(std::shared_ptr<Ring> ring, int fd) : socket_(new Socket(std::move(ring), fd)) {}
+
+  ~Connection() {
+    if (socket_ != nullptr) {
+      socket_->close();
+    }
+  }
+
+  Connection(Connection&& other) noexcept : socket_(std::exchange(other.socket_, nullptr)) {}
+  Connection& operator=(Connection&&) = delete;
+  Connection(const Connection&) = delete;
+  Connection& operator=(const Connection&) = delete;
+
+ public:
+  /// wait until received bytes are available
+  /// \tparam Token completion token type
+  /// \param token completion token
+  template <class Token>
+  auto async_wait_read(Token&& token) {
+    return boost::asio::async_initiate<Token, void(boost::system::error_code)>(
+        [this](auto handler) {
+          // an empty read completes when the receive has data without consuming it
+          socket_->read(boost::asio::mutable_buffer(),
+                        detail::Completion([handler = std::move(handler)](const boost::system::error_code& ec,
+                                                                          std::size_t) mutable { handler(ec); }));
+        },
+        token);
+  }
+
+  /// read some bytes
+  /// \tparam Token completion token type
+  /// \param buffer read buffer
+  /// \param token completion token
+  template <class Token>
+  auto async_read_some(boost::asio::mutable_buffer buffer, Token&& token) {
+    return boost::asio::async_initiate<Token, void(boost::system::error_code, std::size_t)>(
+        [this, buffer](auto handler) { socket_->read(buffer, detail::Completion(std::move(handler))); }, token);
+  }
+
+  /// write all bytes
+  /// \tparam Token completion token type
+  /// \param buffer data (must be valid until the completion)
+  /// \param token completion token
+  template <class Token>
+  auto async_write(boost::asio::const_buffer buffer, Token&& token) {
+    return boost::asio::async_initiate<Token, void(boost::system::error_code, std::size_t)>(
+        [this, buffer](auto handler) { socket_->write(buffer, detail::Completion(std::move(handler))); }, token);
+  }
+
+  /// native socket
+  /// \return file descriptor
+  int nativeHandle() { return socket_->fd(); }
+
+  /// cancel pending operations (completed with operation_aborted)
+  void cancel() {
+    socket_->cancelRead();
+    socket_->cancelWrite();
+  }
+
+  /// address of the peer
+  /// \return peer address (IP:PORT)
+  [[nodiscard]] std::string peer() const { return socket_->peer(); }
+};
+
+/// multishot accept on a listening socket
+template <class F>
+class Listener : public Operation {
+ private:
+  std::shared_ptr<Ring> ring_;
+  boost::asio::ip::tcp::acceptor acceptor_;
+  boost::asio::steady_timer backoff_;
+  F on_accept_;
+
+ public:
+  Listener(std::shared_ptr<Ring> ring, boost::asio::ip::tcp::acceptor acceptor, F on_accept)
+      : ring_(std::move(ring)),
+        acceptor_(std::move(acceptor)),
+        backoff_(ring_->executor()),
+        on_accept_(std::move(on_accept)) {}
+
+  /// arm multishot accept
+  void accept() {
+    auto& sqe = ring_->prepare(this, 0);
+    sqe.opcode = IORING_OP_ACCEPT;
+    sqe.fd = acceptor_.native_handle();
+    sqe.ioprio = IORING_ACCEPT_MULTISHOT;
+    sqe.accept_flags = SOCK_CLOEXEC;
+  }
+
+  void complete(unsigned, int res, unsigned flags) override {
+    if (res >= 0) {
+      EIDOS_LOG_TRACE << "client connected (fd: " << res << ")";
+      trace::Scope span("accept", "net");
+      on_accept_(Connection(ring_, res));
+    } else {
+      BOOST_LOG_TRIVIAL(error) << "accept error: " << detail::Error(res).message();
+    }
+    if ((flags & IORING_CQE_F_MORE) != 0) {
+      return;
+    }
+    if (res < 0 && tcp::IsResourceError(detail::Error(res))) {
+      backoff_.expires_after(tcp::kAcceptBackoff);
+      backoff_.async_wait([this](const boost::system::error_code&) { accept(); });
+    } else {
+      accept();
+    }
+  }
+};
+
+/// start listen with io_uring. the listener lives as long as the process.
+/// \tparam F on accept event handler type
+/// \param ring io_uring instance
+/// \param endpoint listen endpoint
+/// \param on_accept on accept event handler (called with the accepted [Connection])
+template <class F>
+void Listen(const std::shared_ptr<Ring>& ring, const boost::asio::ip::tcp::endpoint& endpoint, F&& on_accept) {
+  auto* listener = new Listener<std::decay_t<F>>(
+      ring, boost::asio::ip::tcp::acceptor(ring->executor(), endpoint), std::forward<F>(on_accept));
+  listener->accept();
+}
+
+}  // namespace eidos::net::uring
@@ -0,0 +1,56 @@
+// Copyright 2021 SiLeader and Cerussite.
+//
+// Licensed under the Apache License, Version 2.0 (the “License”);
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an “AS IS” BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <gtest/gtest.h>
+
+#include "buffer_pool.hpp"
+
+using eidos::buffer::Pool;
+
+TEST(EidosBufferPool, Sizes_are_rounded_up_to_size_classes) {
+  EXPECT_EQ(eidos::buffer::SizeClass(1), 0);
+  EXPECT_EQ(eidos::buffer::SizeClass(16 * 1024), 0);
+  EXPECT_EQ(eidos::buffer::SizeClass(16 * 1024 + 1), 1);
+  EXPECT_EQ(eidos::buffer::SizeClass(1024 * 1024), 6);
+  EXPECT_EQ(eidos::buffer::SizeClass(1024 * 1024 + 1), eidos::buffer::kClasses);
+
+  Pool pool;
+  EXPECT_EQ(pool.acquire(100).capacity(), 16 * 1024);
+  EXPECT_EQ(pool.acquire(20 * 1024).capacity(), 32 * 1024);
+  EXPECT_EQ(pool.acquire(3 * 1024 * 1024).capacity(), 3 * 1024 * 1024);
+}
+
+TEST(EidosBufferPool, Released_buffers_are_reused) {
+  Pool pool;
+  const char* data = nullptr;
+  {
+    auto buffer = pool.acquire(100);
+    data = buffer.data();
+    EXPECT_EQ(pool.used(), 16 * 1024);
+    EXPECT_EQ(pool.cached(), 0);
+  }
+  EXPECT_EQ(pool.used(), 0);
+  EXPECT_EQ(pool.cached(), 16 * 1024);
+
+  const auto buffer = pool.acquire(200);
+  EXPECT_EQ(buffer.data(), data);
+  EXPECT_EQ(pool.cached(), 0);
+}
+
+TEST(EidosBufferPool, Unpooled_buffers_are_freed) {
+  Pool pool;
+  pool.acquire(3 * 1024 * 1024);
+  EXPECT_EQ(pool.used(), 0);
+  EXPECT_EQ(pool.cached(), 0);
+}
@@ -0,0 +1,50 @@
+// Copyright 2021 SiLeader and Cerussite.
+//
+// Licensed under the Apache License, Version 2.0 (the “License”);
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an “AS IS” BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <gtest/gtest.h>
+
+#include <vector>
+
+#include "busy_poll.hpp"
+
+using eidos::busy_poll::ParseCpuList;
+
+TEST(EidosBusyPoll, Cpu_lists_are_parsed) {
+  EXPECT_EQ(ParseCpuList("2"), std::vector<int>({2}));
+  EXPECT_EQ(ParseCpuList("0-3,6"), std::vector<int>({0, 1, 2, 3, 6}));
+  EXPECT_EQ(ParseCpuList("1,1-2"), std::vector<int>({1, 1, 2}));
+
+  EXPECT_FALSE(ParseCpuList(""));
+  EXPECT_FALSE(ParseCpuList("a"));
+  EXPECT_FALSE(ParseCpuList("3-1"));
+  EXPECT_FALSE(ParseCpuList("1,,2"));
+  EXPECT_FALSE(ParseCpuList("-1"));
+  EXPECT_FALSE(ParseCpuList("1-"));
+}
+
+TEST(EidosBusyPoll, Current_thread_can_be_pinned) {
+  cpu_set_t set;
+  CPU_ZERO(&set);
+  ASSERT_EQ(::pthread_getaffinity_np(::pthread_self(), sizeof(set), &set), 0);
+  std::vector<int> cpus;
+  for (int cpu = 0; cpu < CPU_SETSIZE; ++cpu) {
+    if (CPU_ISSET(cpu, &set)) {
+      cpus.push_back(cpu);
+    }
+  }
+  ASSERT_FALSE(cpus.empty());
+  EXPECT_TRUE(eidos::busy_poll::PinCurrentThread({cpus.front()}).is_ok());
+  EXPECT_TRUE(eidos::busy_poll::PinCurrentThread(cpus).is_ok());  // restore
+  EXPECT_TRUE(eidos::busy_poll::PinCurrentThread({CPU_SETSIZE}).is_err());
+}
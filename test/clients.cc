@@ -0,0 +1,77 @@
+// Copyright 2021 SiLeader and Cerussite.
+//
+// Licensed under the Apache License, Version 2.0 (the “License”);
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an “AS IS” BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <gtest/gtest.h>
+
+#include <chrono>
+#include <optional>
+
+#include "clients.hpp"
+
+using eidos::clients::Client;
+using eidos::clients::Registry;
+
+TEST(EidosClients, Clients_are_registered_while_alive) {
+  Registry registry;
+  Client first(registry, "127.0.0.1:1000");
+  {
+    Client second(registry, "127.0.0.1:1001");
+    EXPECT_EQ(registry.size(), 2);
+    EXPECT_LT(first.id(), second.id());
+  }
+  EXPECT_EQ(registry.size(), 1);
+
+  std::optional<Client> third;
+  third.emplace(registry, "127.0.0.1:1002");
+  third->name = "worker";
+  third->last_command = "GET";
+  third->commands = 3;
+  EXPECT_EQ(registry.list(),
+            "id=1 addr=127.0.0.1:1000 name= age=0 idle=0 qbuf=0 qbuf-free=0 omem=0 tot-net-in=0 tot-net-out=0 "
+            "tot-cmds=0 cmd=NULL\n"
+            "id=3 addr=127.0.0.1:1002 name=worker age=0 idle=0 qbuf=0 qbuf-free=0 omem=0 tot-net-in=0 "
+            "tot-net-out=0 tot-cmds=3 cmd=get\n");
+  third.reset();
+  EXPECT_EQ(registry.size(), 1);
+}
+
+TEST(EidosClients, Kill_calls_the_handler_of_matching_clients) {
+  Registry registry;
+  Client first(registry, "127.0.0.1:1000");
+  Client second(registry, "127.0.0.1:1001");
+  int canceled = 0;
+  first.onKill([&canceled] { canceled++; });
+  second.onKill([&canceled] { canceled++; });
+
+  EXPECT_EQ(registry.killById(second.id()), 1);
+  EXPECT_TRUE(second.killed());
+  EXPECT_FALSE(first.killed());
+  EXPECT_EQ(registry.killById(second.id()), 0);  // already killed
+  EXPECT_EQ(registry.killByAddr("127.0.0.1:9999"), 0);
+  EXPECT_EQ(registry.killByAddr("127.0.0.1:1000"), 1);
+  EXPECT_EQ(canceled, 2);
+  EXPECT_EQ(registry.size(), 2);  // removed when the session ends
+}
+
+TEST(EidosClients, Idle_clients_are_killed) {
+  Registry registry;
+  Client idle(registry, "127.0.0.1:1000");
+  Client active(registry, "127.0.0.1:1001");
+  idle.last_interaction -= std::chrono::seconds(10);
+  active.touch();
+
+  EXPECT_EQ(registry.killIdle(std::chrono::seconds(5)), 1);
+  EXPECT_TRUE(idle.killed());
+  EXPECT_FALSE(active.killed());
+}
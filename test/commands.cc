@@ -0,0 +1,70 @@
+// Copyright 2021 SiLeader and Cerussite.
+//
+// Licensed under the Apache License, Version 2.0 (the “License”);
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an “AS IS” BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <gtest/gtest.h>
+
+#include <string>
+
+#include "commands.hpp"
+
+namespace commands = eidos::commands;
+
+TEST(EidosCommands, Names_are_looked_up_case_insensitively) {
+  for (const auto& spec : commands::kTable) {
+    ASSERT_EQ(commands::Lookup(spec.name), &spec);
+    std::string lower(spec.name);
+    for (auto& c : lower) {
+      c = static_cast<char>(c - 'A' + 'a');
+    }
+    EXPECT_EQ(commands::Lookup(lower), &spec);
+  }
+  EXPECT_EQ(commands::Lookup("gEt")->id, commands::Id::kGet);
+  static_assert(commands::Lookup("SET")->id == commands::Id::kSet);
+
+  EXPECT_EQ(commands::Lookup(""), nullptr);
+  EXPECT_EQ(commands::Lookup("GE"), nullptr);
+  EXPECT_EQ(commands::Lookup("GETS"), nullptr);
+  EXPECT_EQ(commands::Lookup("UNKNOWN"), nullptr);
+  EXPECT_EQ(commands::Lookup("VERYLONGCOMMANDNAMETHATDOESNOTEXIST"), nullptr);
+}
+
+TEST(EidosCommands, Arity_is_checked) {
+  const auto& get = commands::Get(commands::Id::kGet);
+  EXPECT_FALSE(commands::CheckArity(get, 1));
+  EXPECT_TRUE(commands::CheckArity(get, 2));
+  EXPECT_FALSE(commands::CheckArity(get, 3));
+
+  const auto& info = commands::Get(commands::Id::kInfo);
+  EXPECT_TRUE(commands::CheckArity(info, 1));
+  EXPECT_TRUE(commands::CheckArity(info, 4));
+
+  const auto& client = commands::Get(commands::Id::kClient);
+  EXPECT_FALSE(commands::CheckArity(client, 1));
+  EXPECT_TRUE(commands::CheckArity(client, 2));
+}
+
+TEST(EidosCommands, Replies_are_built_from_the_table) {
+  const auto& replies = commands::Replies::Global();
+  EXPECT_EQ(replies.count(), ":" + std::to_string(commands::kTable.size()) + "\r\n");
+  EXPECT_EQ(replies.entry(commands::Id::kSet),
+            "*7\r\n$3\r\nset\r\n:3\r\n*2\r\n+write\r\n+denyoom\r\n:1\r\n:1\r\n:1\r\n*0\r\n");
+  EXPECT_EQ(replies.command().rfind("*" + std::to_string(commands::kTable.size()) + "\r\n*7\r\n$3\r\nget\r\n", 0), 0);
+  EXPECT_EQ(replies.arityError(commands::Id::kGet), "wrong number of arguments for 'get' command");
+}
+
+TEST(EidosCommands, Upper_case_is_ascii_only) {
+  std::string name = "cOnFig-\xe9\xff";
+  commands::ToUpper(name);
+  EXPECT_EQ(name, "CONFIG-\xe9\xff");
+}
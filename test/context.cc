@@ -0,0 +1,164 @@
+// Copyright 2021 SiLeader and Cerussite.
+//
+// Licensed under the Apache License, Version 2.0 (the “License”);
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an “AS IS” BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <gtest/gtest.h>
+
+#include <cstddef>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include "context.hpp"
+
+using eidos::RequestContext;
+using eidos::buffer::Pool;
+using eidos::ResponseContext;
+using Status = eidos::RequestContext::Status;
+
+namespace {
+
+void Receive(RequestContext& context, const std::string& bytes) {
+  const auto [data, size] = context.prepare();
+  ASSERT_GE(size, bytes.size());
+  std::memcpy(data, bytes.data(), bytes.size());
+  context.commit(bytes.size());
+}
+
+std::vector<std::string> Strings(const std::vector<std::vector<std::byte>>& params) {
+  std::vector<std::string> strings;
+  for (const auto& param : params) {
+    strings.emplace_back(eidos::BytesToString(param));
+  }
+  return strings;
+}
+
+}  // namespace
+
+TEST(EidosContext, Pipelined_requests_are_parsed_in_order) {
+  RequestContext context;
+  std::vector<std::vector<std::byte>> params;
+  Receive(context, "*2\r\n$3\r\nGET\r\n$1\r\na\r\n*3\r\n$3\r\nSET\r\n$1\r\nb\r\n$0\r\n\r\n");
+
+  ASSERT_EQ(context.parse(params), Status::kComplete);
+  EXPECT_EQ(Strings(params), (std::vector<std::string>{"GET", "a"}));
+  EXPECT_EQ(context.requestSize(), 20);
+  ASSERT_EQ(context.parse(params), Status::kComplete);
+  EXPECT_EQ(Strings(params), (std::vector<std::string>{"SET", "b", ""}));
+  EXPECT_EQ(context.parse(params), Status::kIncomplete);
+}
+
+TEST(EidosContext, Partial_request_waits_for_more_bytes) {
+  RequestContext context;
+  std::vector<std::vector<std::byte>> params;
+  Receive(context, "*2\r\n$3\r\nGET\r\n$5\r\nhel");
+  EXPECT_EQ(context.parse(params), Status::kIncomplete);
+  Receive(context, "lo\r");
+  EXPECT_EQ(context.parse(params), Status::kIncomplete);
+  Receive(context, "\n");
+  ASSERT_EQ(context.parse(params), Status::kComplete);
+  EXPECT_EQ(Strings(params), (std::vector<std::string>{"GET", "hello"}));
+}
+
+TEST(EidosContext, Malformed_request_is_protocol_error) {
+  std::vector<std::vector<std::byte>> params;
+  {
+    RequestContext context;
+    Receive(context, "GET a\r\n");
+    EXPECT_EQ(context.parse(params), Status::kError);
+    EXPECT_EQ(context.error(), "expected '*', got 'G'");
+  }
+  {
+    RequestContext context;
+    Receive(context, "*1\r\n$x\r\n");
+    EXPECT_EQ(context.parse(params), Status::kError);
+  }
+  {
+    RequestContext context;
+    Receive(context, "*1\r\n$1\r\nab\r\n");
+    EXPECT_EQ(context.parse(params), Status::kError);
+  }
+}
+
+TEST(EidosContext, Responses_are_appended_to_the_output_buffer) {
+  ResponseContext response;
+  response.begin();
+  response.ok();
+  EXPECT_EQ(response.written(), 5);
+  response.begin();
+  response.ok(std::vector<std::byte>{std::byte{'v'}});
+  response.begin();
+  response.err("failed");
+  EXPECT_TRUE(response.failed());
+  response.begin();
+  response.nil();
+  EXPECT_EQ(response.buffer(), "+OK\r\n$1\r\nv\r\n-ERR failed\r\n$-1\r\n");
+
+  response.clear();
+  EXPECT_TRUE(response.buffer().empty());
+}
+
+TEST(EidosContext, Receive_buffer_is_borrowed_only_while_receiving) {
+  Pool pool;
+  RequestContext context(pool);
+  std::vector<std::vector<std::byte>> params;
+  EXPECT_EQ(pool.used(), 0);
+
+  Receive(context, "*1\r\n$4\r\nPI");
+  EXPECT_EQ(pool.used(), RequestContext::kReadSize);
+  ASSERT_EQ(context.parse(params), Status::kIncomplete);
+  context.release(params);
+  EXPECT_FALSE(context.idle());
+  EXPECT_EQ(pool.used(), RequestContext::kReadSize);
+
+  Receive(context, "NG\r\n");
+  ASSERT_EQ(context.parse(params), Status::kComplete);
+  context.release(params);
+  EXPECT_TRUE(context.idle());
+  EXPECT_EQ(pool.used(), 0);
+}
+
+TEST(EidosContext, Receive_buffer_grows_to_the_bulk_length_and_shrinks_back) {
+  Pool pool;
+  RequestContext context(pool);
+  std::vector<std::vector<std::byte>> params;
+  const std::string value(100 * 1024, 'v');
+
+  Receive(context, "*3\r\n$3\r\nSET\r\n$1\r\nk\r\n$" + std::to_string(value.size()) + "\r\n");
+  ASSERT_EQ(context.parse(params), Status::kIncomplete);
+  const auto [data, size] = context.prepare();
+  EXPECT_GE(size, value.size() + 2);
+  std::memcpy(data, value.data(), value.size());
+  std::memcpy(data + value.size(), "\r\n", 2);
+  context.commit(value.size() + 2);
+  ASSERT_EQ(context.parse(params), Status::kComplete);
+  EXPECT_EQ(params[2].size(), value.size());
+
+  context.release(params);
+  EXPECT_EQ(pool.used(), 0);
+  EXPECT_EQ(params[2].capacity(), 0);
+  EXPECT_EQ(context.prepare().second, RequestContext::kReadSize);
+}
+
+TEST(EidosContext, Responses_over_the_limit_are_dropped) {
+  ResponseContext response;
+  response.setLimit(32);
+  response.begin();
+  response.ok(std::vector<std::byte>(8, std::byte{'v'}));
+  EXPECT_FALSE(response.overflowed());
+
+  response.begin();
+  response.ok(std::vector<std::vector<std::byte>>(4, std::vector<std::byte>(8, std::byte{'v'})));
+  EXPECT_TRUE(response.overflowed());
+  EXPECT_LE(response.buffer().size(), 32);
+}
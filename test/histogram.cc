@@ -0,0 +1,56 @@
+// Copyright 2021 SiLeader and Cerussite.
+//
+// Licensed under the Apache License, Version 2.0 (the “License”);
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an “AS IS” BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <gtest/gtest.h>
+
+#include <eidos/histogram.hpp>
+
+using eidos::histogram::Histogram;
+
+TEST(EidosHistogram, Bucket_contains_value) {
+  for (const std::uint64_t v : {0ULL, 1ULL, 255ULL, 256ULL, 257ULL, 1000ULL, 123456789ULL, 1ULL << 63U}) {
+    const auto index = Histogram::IndexOf(v);
+    EXPECT_LE(Histogram::LowestOf(index), v);
+    EXPECT_GE(Histogram::HighestOf(index), v);
+  }
+}
+
+TEST(EidosHistogram, Empty_percentile) {
+  const Histogram h;
+  EXPECT_EQ(h.count(), 0);
+  EXPECT_EQ(h.percentile(99), 0);
+}
+
+TEST(EidosHistogram, Percentile_relative_error) {
+  Histogram h;
+  for (std::uint64_t i = 1; i <= 1000; ++i) {
+    h.record(i * 1000);
+  }
+  EXPECT_EQ(h.count(), 1000);
+  EXPECT_EQ(h.max(), 1000000);
+  EXPECT_NEAR(static_cast<double>(h.percentile(50)), 500000.0, 500000.0 / 128);
+  EXPECT_NEAR(static_cast<double>(h.percentile(99)), 990000.0, 990000.0 / 128);
+  EXPECT_EQ(h.percentile(100), 1000000);
+}
+
+TEST(EidosHistogram, Merge) {
+  Histogram a;
+  Histogram b;
+  a.record(10);
+  b.record(20, 3);
+  a.merge(b);
+  EXPECT_EQ(a.count(), 4);
+  EXPECT_EQ(a.sum(), 70);
+  EXPECT_EQ(a.max(), 20);
+}
@@ -0,0 +1,104 @@
+// Copyright 2021 SiLeader and Cerussite.
+//
+// Licensed under the Apache License, Version 2.0 (the “License”);
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an “AS IS” BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <gtest/gtest.h>
+
+#include <algorithm>
+#include <cstddef>
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "keystats.hpp"
+#include "storage/memstore.hpp"
+
+using eidos::keystats::BigKeys;
+using eidos::keystats::BigKeysEngine;
+using eidos::keystats::HotKeys;
+
+namespace {
+
+eidos::Key MakeKey(const std::string& name) {
+  std::vector<std::byte> bytes(name.size());
+  std::transform(std::begin(name), std::end(name), std::begin(bytes), [](char c) { return static_cast<std::byte>(c); });
+  return eidos::Key(std::move(bytes), std::hash<std::string>()(name));
+}
+
+eidos::Value MakeValue(std::size_t size) { return eidos::Value(std::vector<std::byte>(size)); }
+
+}  // namespace
+
+TEST(EidosKeyStats, Hot_key_is_found_among_noise) {
+  HotKeys hotkeys(1);
+  const auto hot = MakeKey("hot");
+  for (int i = 0; i < 10000; ++i) {
+    hotkeys.record(MakeKey("key:" + std::to_string(i)));
+    if (i % 4 == 0) {
+      hotkeys.record(hot);
+    }
+  }
+  const auto top = hotkeys.top(1);
+  ASSERT_EQ(top.size(), 1);
+  EXPECT_EQ(top[0].first, "hot");
+  EXPECT_GE(top[0].second, 2500);
+}
+
+TEST(EidosKeyStats, Disabled_hot_key_tracker_records_nothing) {
+  HotKeys hotkeys(0);
+  hotkeys.record(MakeKey("key"));
+  EXPECT_TRUE(hotkeys.top(10).empty());
+}
+
+TEST(EidosKeyStats, Big_keys_are_replaced_and_removed) {
+  BigKeys bigkeys(100);
+  bigkeys.record(MakeKey("small"), 10);
+  bigkeys.record(MakeKey("a"), 200);
+  bigkeys.record(MakeKey("b"), 300);
+  auto top = bigkeys.top(10);
+  ASSERT_EQ(top.size(), 2);
+  EXPECT_EQ(top[0].first, "b");
+  EXPECT_EQ(top[1].first, "a");
+
+  // overwritten by a small value
+  bigkeys.record(MakeKey("b"), 1);
+  bigkeys.remove(MakeKey("a"));
+  EXPECT_TRUE(bigkeys.top(10).empty());
+}
+
+TEST(EidosKeyStats, Big_keys_engine_records_every_applied_write) {
+  const auto bigkeys = std::make_shared<BigKeys>(100);
+  const auto memory = std::make_shared<eidos::storage::MemoryStorageEngine<>>();
+  BigKeysEngine engine(memory, bigkeys);
+
+  ASSERT_TRUE(engine.set(MakeKey("a"), MakeValue(200)).is_ok());
+  ASSERT_TRUE(engine.apply({{MakeKey("b"), MakeValue(300)}, {MakeKey("c"), MakeValue(400)}}).is_ok());
+  ASSERT_TRUE(engine.del(MakeKey("c")).is_ok());
+  auto top = bigkeys->top(10);
+  ASSERT_EQ(top.size(), 2);
+  EXPECT_EQ(top[0], std::make_pair(std::string("b"), std::size_t{300}));
+  EXPECT_EQ(top[1], std::make_pair(std::string("a"), std::size_t{200}));
+  EXPECT_EQ(engine.get(MakeKey("b")).unwrap().bytes().size(), 300);
+
+  // a rejected watched batch records nothing
+  const std::vector<eidos::storage::Watch> stale = {{MakeKey("a"), engine.version(MakeKey("a")) + 1}};
+  EXPECT_EQ(engine.applyIfUnchanged({{MakeKey("d"), MakeValue(500)}}, stale).err(),
+            eidos::storage::Error::kWatchConflict);
+  EXPECT_EQ(bigkeys->top(10).size(), 2);
+
+  // e.g. a Raft snapshot replaces the whole state
+  ASSERT_TRUE(engine.clear().is_ok());
+  EXPECT_TRUE(bigkeys->top(10).empty());
+  EXPECT_EQ(memory->size().unwrap(), 0);
+}
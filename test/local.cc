@@ -0,0 +1,88 @@
+// Copyright 2021 SiLeader and Cerussite.
+//
+// Licensed under the Apache License, Version 2.0 (the “License”);
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an “AS IS” BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <gtest/gtest.h>
+#include <unistd.h>
+
+#include <array>
+#include <filesystem>
+#include <fstream>
+#include <optional>
+#include <string>
+
+#include "local.hpp"
+
+namespace net = boost::asio;
+using eidos::net::local::Connection;
+
+namespace {
+
+/// unique socket path in the temporary directory
+std::string SocketPath(const char* name) {
+  return (std::filesystem::temp_directory_path() / (std::string("eidos-") + name + "-" + std::to_string(::getpid())))
+      .string();
+}
+
+}  // namespace
+
+TEST(EidosLocal, Connection_echoes_received_bytes) {
+  const auto path = SocketPath("echo");
+  net::io_context ioc;
+
+  // a socket file left by a previous process is replaced
+  {
+    net::local::stream_protocol::acceptor stale(ioc, net::local::stream_protocol::endpoint(path));
+  }
+  std::optional<Connection> connection;
+  std::array<char, 64> buffer{};
+  std::string echoed;
+  const auto result = eidos::net::local::Listen(ioc, path, 0600, [&](Connection accepted) {
+    connection.emplace(std::move(accepted));
+    connection->async_read_some(net::buffer(buffer), [&](const boost::system::error_code& ec, std::size_t size) {
+      ASSERT_FALSE(ec);
+      connection->async_write(net::buffer(buffer.data(), size),
+                              [](const boost::system::error_code& ec, std::size_t) { ASSERT_FALSE(ec); });
+    });
+  });
+  ASSERT_TRUE(result.is_ok()) << result.err().value();
+  EXPECT_EQ(std::filesystem::status(path).permissions(),
+            std::filesystem::perms::owner_read | std::filesystem::perms::owner_write);
+
+  // client
+  net::local::stream_protocol::socket client(ioc);
+  client.connect(net::local::stream_protocol::endpoint(path));
+  net::write(client, net::buffer(std::string("PING")));
+  std::array<char, 4> reply{};
+  net::async_read(client, net::buffer(reply), [&](const boost::system::error_code& ec, std::size_t size) {
+    ASSERT_FALSE(ec);
+    echoed.assign(reply.data(), size);
+    ioc.stop();
+  });
+  ioc.run_for(std::chrono::seconds(5));
+
+  EXPECT_EQ(echoed, "PING");
+  ASSERT_TRUE(connection.has_value());
+  EXPECT_EQ(connection->peer(), path + ":0");
+  std::filesystem::remove(path);
+}
+
+TEST(EidosLocal, Listen_does_not_replace_regular_files) {
+  const auto path = SocketPath("file");
+  std::ofstream(path) << "data";
+  net::io_context ioc;
+  const auto result = eidos::net::local::Listen(ioc, path, 0, [](Connection) {});
+  EXPECT_TRUE(result.is_err());
+  EXPECT_TRUE(std::filesystem::is_regular_file(path));
+  std::filesystem::remove(path);
+}
@@ -0,0 +1,63 @@
+// Copyright 2021 SiLeader and Cerussite.
+//
+// Licensed under the Apache License, Version 2.0 (the “License”);
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an “AS IS” BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <gtest/gtest.h>
+
+#include <memory>
+#include <thread>
+#include <vector>
+
+#include "per_thread.hpp"
+
+using eidos::detail::PerThread;
+
+namespace {
+
+struct Counter {
+  std::size_t index;
+  int count = 0;
+
+  explicit Counter(std::size_t index) : index(index) {}
+};
+
+}  // namespace
+
+TEST(EidosPerThread, Threads_get_own_value_in_creation_order) {
+  PerThread<Counter> counters;
+  ++counters.local().count;
+  ++counters.local().count;
+  std::thread([&counters] { counters.local().count += 10; }).join();
+
+  std::vector<std::pair<std::size_t, int>> values;
+  counters.forEach([&values](const Counter& c) { values.emplace_back(c.index, c.count); });
+  EXPECT_EQ(values, (std::vector<std::pair<std::size_t, int>>{{0, 2}, {1, 10}}));
+}
+
+TEST(EidosPerThread, Instances_used_in_turn_keep_their_values) {
+  PerThread<Counter> a;
+  PerThread<Counter> b;
+  for (int i = 0; i < 3; ++i) {
+    ++a.local().count;
+    b.local().count += 2;
+  }
+  EXPECT_EQ(a.local().count, 3);
+  EXPECT_EQ(b.local().count, 6);
+
+  // a new instance does not see the values of a destroyed one, even at the same address
+  for (int i = 0; i < 3; ++i) {
+    auto c = std::make_unique<PerThread<Counter>>();
+    EXPECT_EQ(c->local().count, 0);
+    ++c->local().count;
+  }
+}
@@ -0,0 +1,45 @@
+// Copyright 2021 SiLeader and Cerussite.
+//
+// Licensed under the Apache License, Version 2.0 (the “License”);
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an “AS IS” BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <gtest/gtest.h>
+
+#include <cstdint>
+
+#include "profile.hpp"
+
+using eidos::profile::Profiler;
+
+TEST(EidosProfile, Disabled_profiler_does_not_read_counters) {
+  Profiler profiler(false);
+  EXPECT_FALSE(profiler.enabled());
+  EXPECT_FALSE(profiler.start().has_value());
+}
+
+TEST(EidosProfile, Counters_are_recorded_per_command) {
+  Profiler profiler(true);
+  const auto start = profiler.start();
+  if (!start) {
+    GTEST_SKIP() << "perf_event is not available";
+  }
+  volatile std::uint64_t sum = 0;
+  for (std::uint64_t i = 0; i < 100000; ++i) {
+    sum = sum + i;
+  }
+  profiler.record(static_cast<std::size_t>(eidos::commands::Id::kGet), start.value());
+
+  const auto get = profiler.command(static_cast<std::size_t>(eidos::commands::Id::kGet));
+  EXPECT_EQ(get.calls, 1);
+  EXPECT_GT(get.values[1], 100000);  // instructions
+  EXPECT_EQ(profiler.command(static_cast<std::size_t>(eidos::commands::Id::kSet)).calls, 0);
+}
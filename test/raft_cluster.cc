@@ -0,0 +1,269 @@
+// Copyright 2021 SiLeader and Cerussite.
+//
+// Licensed under the Apache License, Version 2.0 (the “License”);
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an “AS IS” BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <gtest/gtest.h>
+#include <unistd.h>
+
+#include <chrono>
+#include <eidos/types.hpp>
+#include <filesystem>
+#include <functional>
+#include <memory>
+#include <optional>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "storage/memstore.hpp"
+#include "storage/raft.hpp"
+#include "transaction.hpp"
+
+using eidos::storage::RaftStorageEngine;
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+/// timeout of waiting for cluster state changes
+constexpr auto kStateTimeout = std::chrono::seconds(30);
+
+std::vector<std::byte> Bytes(const std::string& s) {
+  std::vector<std::byte> bytes(s.size());
+  std::transform(std::begin(s), std::end(s), std::begin(bytes), [](char c) { return static_cast<std::byte>(c); });
+  return bytes;
+}
+
+eidos::Key MakeKey(const std::string& key) { return eidos::Key(Bytes(key), std::hash<std::string>{}(key)); }
+
+eidos::Value MakeValue(const std::string& value) { return eidos::Value(Bytes(value)); }
+
+/// wait until the condition holds
+/// \param condition condition
+/// \return true if the condition holds before the timeout
+bool WaitFor(const std::function<bool()>& condition) {
+  const auto deadline = Clock::now() + kStateTimeout;
+  while (Clock::now() < deadline) {
+    if (condition()) {
+      return true;
+    }
+    std::this_thread::sleep_for(std::chrono::milliseconds(10));
+  }
+  return false;
+}
+
+/// local Raft cluster running in this process
+class Cluster {
+ private:
+  std::uint16_t base_port_;
+  eidos::storage::RaftOptions raft_;
+  std::filesystem::path dir_;
+  std::vector<std::unique_ptr<RaftStorageEngine>> nodes_;
+
+ public:
+  Cluster(std::uint16_t base_port, const eidos::storage::RaftOptions& raft)
+      : base_port_(base_port),
+        raft_(raft),
+        dir_(std::filesystem::temp_directory_path() /
+             ("eidos-raft-test-" + std::to_string(::getpid()) + "-" + std::to_string(base_port))),
+        nodes_() {}
+
+  ~Cluster() {
+    nodes_.clear();
+    std::filesystem::remove_all(dir_);
+  }
+
+  Cluster(const Cluster&) = delete;
+  Cluster& operator=(const Cluster&) = delete;
+
+ private:
+  [[nodiscard]] eidos::storage::RaftOptions nodeOptions(int id) const {
+    auto options = raft_;
+    options.node_id = id;
+    options.port = static_cast<std::uint16_t>(base_port_ + id - 1);
+    options.peers.clear();
+    return options;
+  }
+
+  void start(const eidos::storage::RaftOptions& options) {
+    nodes_.push_back(std::make_unique<RaftStorageEngine>(std::make_shared<eidos::storage::MemoryStorageEngine<>>(),
+                                                         options,
+                                                         dir_ / ("node-" + std::to_string(options.node_id))));
+  }
+
+ public:
+  /// start [size] members
+  /// \param size number of members
+  void start(int size) {
+    for (int i = 1; i <= size; ++i) {
+      auto options = nodeOptions(i);
+      for (int j = 1; j <= size; ++j) {
+        if (i != j) {
+          const auto peer = nodeOptions(j);
+          options.peers.push_back({peer.node_id, peer.host, peer.port, peer.priority});
+        }
+      }
+      start(options);
+    }
+  }
+
+  /// start a node that is not a member of the cluster yet
+  /// \return node index
+  std::size_t startEmpty() {
+    start(nodeOptions(static_cast<int>(nodes_.size()) + 1));
+    return nodes_.size() - 1;
+  }
+
+  /// wait until all nodes agree on the leader and it knows [members] members
+  /// \param members number of members
+  /// \return leader index
+  std::optional<std::size_t> waitLeader(std::size_t members) {
+    std::optional<std::size_t> leader;
+    WaitFor([&] {
+      leader.reset();
+      const auto leader_id = nodes_.front()->status().leader;
+      for (std::size_t i = 0; i < nodes_.size(); ++i) {
+        if (nodes_[i]->status().leader != leader_id) {
+          return false;
+        }
+        if (nodes_[i]->status().id == leader_id) {
+          leader = i;
+        }
+      }
+      return leader && nodes_[*leader]->servers().unwrap_or({}).size() == members;
+    });
+    return leader;
+  }
+
+  /// wait until all nodes have the value of the key (std::nullopt: the key does not exist)
+  /// \param key key
+  /// \param value expected value
+  /// \return true if all nodes have the value before the timeout
+  bool waitValue(const eidos::Key& key, const std::optional<eidos::Value>& value) {
+    return WaitFor([&] {
+      return std::all_of(std::begin(nodes_), std::end(nodes_), [&](const auto& node) {
+        const auto stored = node->get(key);
+        return value ? stored.is_ok() && stored.unwrap().bytes() == value->bytes() : stored.is_err();
+      });
+    });
+  }
+
+  /// Raft endpoint of the node
+  /// \param index node index
+  /// \return endpoint
+  [[nodiscard]] std::string endpoint(std::size_t index) const {
+    const auto options = nodeOptions(static_cast<int>(index) + 1);
+    return options.host + ":" + std::to_string(options.port);
+  }
+
+  RaftStorageEngine& node(std::size_t index) { return *nodes_[index]; }
+};
+
+/// fast elections for the tests
+eidos::storage::RaftOptions TestOptions() {
+  eidos::storage::RaftOptions options;
+  options.heartbeat_interval = 50;
+  options.election_timeout_lower = 200;
+  options.election_timeout_upper = 400;
+  return options;
+}
+
+}  // namespace
+
+TEST(EidosRaftCluster, Follower_forwards_writes_to_leader) {
+  Cluster cluster(17101, TestOptions());
+  cluster.start(3);
+  const auto leader = cluster.waitLeader(3);
+  ASSERT_TRUE(leader);
+  const auto follower = (*leader + 1) % 3;
+
+  ASSERT_TRUE(cluster.node(follower).set(MakeKey("a"), MakeValue("1")).is_ok());
+  EXPECT_TRUE(cluster.waitValue(MakeKey("a"), MakeValue("1")));
+
+  ASSERT_TRUE(cluster.node(follower).del(MakeKey("a")).is_ok());
+  EXPECT_TRUE(cluster.waitValue(MakeKey("a"), std::nullopt));
+}
+
+TEST(EidosRaftCluster, Lagging_follower_receives_snapshot) {
+  auto options = TestOptions();
+  options.snapshot_distance = 5;
+  options.reserved_log_items = 0;
+  Cluster cluster(17111, options);
+  cluster.start(3);
+  const auto leader = cluster.waitLeader(3);
+  ASSERT_TRUE(leader);
+
+  for (int i = 0; i < 50; ++i) {
+    ASSERT_TRUE(cluster.node(*leader).set(MakeKey("key:" + std::to_string(i)), MakeValue(std::to_string(i))).is_ok());
+  }
+  // the log is compacted, so the new node cannot catch up from the log
+  ASSERT_TRUE(WaitFor([&] { return cluster.node(*leader).status().log_start > 1; }));
+
+  const auto joined = cluster.startEmpty();
+  ASSERT_TRUE(cluster.node(*leader).addServer(4, cluster.endpoint(joined)).is_ok());
+  ASSERT_TRUE(cluster.waitLeader(4));
+  for (int i = 0; i < 50; ++i) {
+    EXPECT_TRUE(cluster.waitValue(MakeKey("key:" + std::to_string(i)), MakeValue(std::to_string(i))));
+  }
+  EXPECT_GE(cluster.node(joined).status().snapshots, 1);
+  EXPECT_EQ(cluster.node(joined).size().unwrap(), 50);
+}
+
+TEST(EidosRaftCluster, Exec_batch_is_replicated) {
+  Cluster cluster(17121, TestOptions());
+  cluster.start(3);
+  const auto leader = cluster.waitLeader(3);
+  ASSERT_TRUE(leader);
+  const auto follower = (*leader + 1) % 3;
+  ASSERT_TRUE(cluster.node(*leader).set(MakeKey("c"), MakeValue("3")).is_ok());
+
+  // EXEC applies the writes of the transaction as one log entry
+  eidos::transaction::BufferedEngine buffered(cluster.node(follower));
+  buffered.set(MakeKey("a"), MakeValue("1"));
+  buffered.set(MakeKey("b"), MakeValue("2"));
+  ASSERT_TRUE(buffered.del(MakeKey("c")).is_ok());
+  const auto last_log = cluster.node(*leader).status().last_log;
+  ASSERT_TRUE(buffered.commit().is_ok());
+  EXPECT_EQ(cluster.node(*leader).status().last_log, last_log + 1);
+
+  EXPECT_TRUE(cluster.waitValue(MakeKey("a"), MakeValue("1")));
+  EXPECT_TRUE(cluster.waitValue(MakeKey("b"), MakeValue("2")));
+  EXPECT_TRUE(cluster.waitValue(MakeKey("c"), std::nullopt));
+}
+
+TEST(EidosRaftCluster, Watched_batch_is_rejected_after_write_from_another_node) {
+  Cluster cluster(17131, TestOptions());
+  cluster.start(3);
+  const auto leader = cluster.waitLeader(3);
+  ASSERT_TRUE(leader);
+  const auto follower = (*leader + 1) % 3;
+  ASSERT_TRUE(cluster.node(*leader).set(MakeKey("a"), MakeValue("1")).is_ok());
+  ASSERT_TRUE(cluster.waitValue(MakeKey("a"), MakeValue("1")));
+
+  // WATCH on the follower, then the key is written through the leader
+  const std::vector<eidos::storage::Watch> watched = {{MakeKey("a"), cluster.node(follower).version(MakeKey("a"))}};
+  ASSERT_TRUE(cluster.node(*leader).set(MakeKey("a"), MakeValue("2")).is_ok());
+
+  eidos::transaction::BufferedEngine buffered(cluster.node(follower));
+  buffered.set(MakeKey("a"), MakeValue("3"));
+  EXPECT_EQ(buffered.commit(watched).err(), eidos::storage::Error::kWatchConflict);
+  EXPECT_TRUE(cluster.waitValue(MakeKey("a"), MakeValue("2")));
+
+  // the stamps are the same on all nodes
+  const std::vector<eidos::storage::Watch> current = {{MakeKey("a"), cluster.node(follower).version(MakeKey("a"))}};
+  EXPECT_EQ(current.front().version, cluster.node(*leader).version(MakeKey("a")));
+  eidos::transaction::BufferedEngine retry(cluster.node(follower));
+  retry.set(MakeKey("a"), MakeValue("3"));
+  EXPECT_TRUE(retry.commit(current).is_ok());
+  EXPECT_TRUE(cluster.waitValue(MakeKey("a"), MakeValue("3")));
+}
@@ -0,0 +1,226 @@
+// Copyright 2021 SiLeader and Cerussite.
+//
+// Licensed under the Apache License, Version 2.0 (the “License”);
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an “AS IS” BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <gtest/gtest.h>
+#include <unistd.h>
+
+#include <chrono>
+#include <filesystem>
+#include <future>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "keystats.hpp"
+#include "storage/memstore.hpp"
+#include "storage/raft.hpp"
+
+using eidos::storage::detail::StateMachine;
+
+namespace {
+
+std::vector<std::byte> Bytes(const std::string& s) {
+  std::vector<std::byte> bytes(s.size());
+  std::transform(std::begin(s), std::end(s), std::begin(bytes), [](char c) { return static_cast<std::byte>(c); });
+  return bytes;
+}
+
+eidos::Key MakeKey(const std::string& key) { return eidos::Key(Bytes(key), std::hash<std::string>{}(key)); }
+
+eidos::Value MakeValue(const std::string& value) { return eidos::Value(Bytes(value)); }
+
+/// snapshot directory removed with the test
+class SnapshotDir {
+ private:
+  std::filesystem::path path_;
+
+ public:
+  explicit SnapshotDir(const std::string& name)
+      : path_(std::filesystem::temp_directory_path() /
+              ("eidos-state-machine-test-" + std::to_string(::getpid()) + "-" + name)) {
+    std::filesystem::create_directories(path_);
+  }
+
+  ~SnapshotDir() { std::filesystem::remove_all(path_); }
+
+  SnapshotDir(const SnapshotDir&) = delete;
+  SnapshotDir& operator=(const SnapshotDir&) = delete;
+
+  [[nodiscard]] const std::filesystem::path& path() const { return path_; }
+};
+
+/// commit the instruction
+/// \param sm state machine
+/// \param log_idx log index
+/// \param instruction encoded instruction
+/// \return true if the instruction is applied
+bool Commit(StateMachine& sm, nuraft::ulong log_idx, const nuraft::ptr<nuraft::buffer>& instruction) {
+  const auto ret = sm.commit(log_idx, *instruction);
+  nuraft::buffer_serializer bs(*ret);
+  EXPECT_EQ(bs.get_u64(), log_idx);
+  return bs.get_u8() == 1;
+}
+
+/// create the snapshot and wait for the writer
+/// \param sm state machine
+/// \param s snapshot
+/// \return true if the snapshot is written
+bool CreateSnapshot(StateMachine& sm, nuraft::snapshot& s) {
+  std::promise<bool> written;
+  nuraft::async_result<bool>::handler_type when_done = [&written](bool& res, nuraft::ptr<std::exception>&) {
+    written.set_value(res);
+  };
+  sm.create_snapshot(s, when_done);
+  return written.get_future().get();
+}
+
+/// send the snapshot objects from [leader] to [follower] like NuRaft does
+/// \param leader state machine that has the snapshot
+/// \param follower state machine that receives the snapshot
+/// \param s snapshot
+void TransferSnapshot(StateMachine& leader, StateMachine& follower, nuraft::snapshot& s) {
+  void* ctx = nullptr;
+  nuraft::ulong obj_id = 0;
+  bool is_last_obj = false;
+  while (!is_last_obj) {
+    nuraft::ptr<nuraft::buffer> data;
+    const auto first = obj_id == 0;
+    ASSERT_EQ(leader.read_logical_snp_obj(s, ctx, obj_id, data, is_last_obj), 0);
+    follower.save_logical_snp_obj(s, obj_id, *data, first, is_last_obj);
+  }
+  leader.free_user_snp_ctx(ctx);
+}
+
+}  // namespace
+
+TEST(EidosRaftStateMachine, Watched_batch_is_rejected_after_write) {
+  SnapshotDir dir("watch");
+  auto engine = std::make_shared<eidos::storage::MemoryStorageEngine<>>();
+  StateMachine sm(engine, dir.path(), 0);
+
+  EXPECT_TRUE(Commit(sm, 1, eidos::storage::detail::EncodeSet(MakeKey("a"), MakeValue("1"))));
+  EXPECT_EQ(sm.stamp(MakeKey("a")), 1);
+
+  const std::vector<eidos::storage::Mutation> writes = {{MakeKey("a"), MakeValue("2")}};
+  const std::vector<eidos::storage::Watch> watched = {{MakeKey("a"), 1}};
+  EXPECT_TRUE(Commit(sm, 2, eidos::storage::detail::EncodeWatchedBatch(writes, watched)));
+  EXPECT_EQ(engine->get(MakeKey("a")).unwrap().bytes(), Bytes("2"));
+  EXPECT_EQ(sm.stamp(MakeKey("a")), 2);
+
+  // the stamp has moved to 2, so the same watch is stale now
+  const std::vector<eidos::storage::Mutation> stale = {{MakeKey("a"), MakeValue("3")}};
+  EXPECT_FALSE(Commit(sm, 3, eidos::storage::detail::EncodeWatchedBatch(stale, watched)));
+  EXPECT_EQ(engine->get(MakeKey("a")).unwrap().bytes(), Bytes("2"));
+  EXPECT_EQ(sm.stamp(MakeKey("a")), 2);
+  EXPECT_EQ(sm.last_commit_index(), 3);
+}
+
+TEST(EidosRaftStateMachine, Snapshot_is_transferred_with_stamps) {
+  SnapshotDir leader_dir("leader");
+  SnapshotDir follower_dir("follower");
+  auto leader_engine = std::make_shared<eidos::storage::MemoryStorageEngine<>>();
+  auto follower_engine = std::make_shared<eidos::storage::MemoryStorageEngine<>>();
+  StateMachine leader(leader_engine, leader_dir.path(), 0);
+  StateMachine follower(follower_engine, follower_dir.path(), 0);
+
+  for (nuraft::ulong i = 1; i <= 100; ++i) {
+    Commit(leader, i, eidos::storage::detail::EncodeSet(MakeKey("key:" + std::to_string(i)), MakeValue("v")));
+  }
+  Commit(leader, 101, eidos::storage::detail::EncodeDel(MakeKey("key:1")));
+  // replaced by the snapshot
+  Commit(follower, 1, eidos::storage::detail::EncodeSet(MakeKey("stale"), MakeValue("v")));
+
+  nuraft::snapshot s(101, 1, nullptr);
+  ASSERT_TRUE(CreateSnapshot(leader, s));
+  ASSERT_NE(leader.last_snapshot(), nullptr);
+  TransferSnapshot(leader, follower, s);
+  ASSERT_NE(follower.last_snapshot(), nullptr);
+  EXPECT_EQ(follower.last_snapshot()->get_last_log_idx(), 101);
+
+  ASSERT_TRUE(follower.apply_snapshot(s));
+  EXPECT_EQ(follower.last_commit_index(), 101);
+  EXPECT_EQ(follower_engine->size().unwrap(), 99);
+  EXPECT_FALSE(follower_engine->exists(MakeKey("stale")).unwrap());
+  EXPECT_FALSE(follower_engine->exists(MakeKey("key:1")).unwrap());
+  for (nuraft::ulong i = 1; i <= 100; ++i) {
+    const auto key = MakeKey("key:" + std::to_string(i));
+    ASSERT_EQ(follower.stamp(key), leader.stamp(key));
+  }
+}
+
+TEST(EidosRaftStateMachine, Corrupt_snapshot_leaves_state_untouched) {
+  SnapshotDir dir("corrupt");
+  auto engine = std::make_shared<eidos::storage::MemoryStorageEngine<>>();
+  StateMachine sm(engine, dir.path(), 0);
+  Commit(sm, 1, eidos::storage::detail::EncodeSet(MakeKey("a"), MakeValue("1")));
+
+  // a record whose length runs past the end of the file
+  auto data = nuraft::buffer::alloc(6);
+  nuraft::buffer_serializer bs(data);
+  bs.put_u32(100);
+  bs.put_u16(2);
+  nuraft::snapshot s(10, 1, nullptr);
+  nuraft::ulong obj_id = 0;
+  sm.save_logical_snp_obj(s, obj_id, *data, true, true);
+  EXPECT_EQ(obj_id, 1);
+
+  EXPECT_FALSE(sm.apply_snapshot(s));
+  EXPECT_EQ(engine->get(MakeKey("a")).unwrap().bytes(), Bytes("1"));
+  EXPECT_EQ(sm.stamp(MakeKey("a")), 1);
+  EXPECT_EQ(sm.last_commit_index(), 1);
+}
+
+TEST(EidosRaftStateMachine, Unwritable_snapshot_object_restarts_transfer) {
+  SnapshotDir dir("unwritable");
+  auto engine = std::make_shared<eidos::storage::MemoryStorageEngine<>>();
+  StateMachine sm(engine, dir.path() / "snapshots", 0);
+  // the receiving file cannot be opened without the snapshot directory
+  std::filesystem::remove_all(dir.path() / "snapshots");
+
+  auto data = nuraft::buffer::alloc(6);
+  nuraft::snapshot s(10, 1, nullptr);
+  nuraft::ulong obj_id = 3;
+  sm.save_logical_snp_obj(s, obj_id, *data, false, true);
+  EXPECT_EQ(obj_id, 0);
+  EXPECT_EQ(sm.last_snapshot(), nullptr);
+  EXPECT_FALSE(std::filesystem::exists(dir.path() / "snapshots"));
+}
+
+TEST(EidosRaftStateMachine, Big_keys_are_recorded_from_the_log_and_snapshots) {
+  SnapshotDir leader_dir("bigkeys-leader");
+  SnapshotDir follower_dir("bigkeys-follower");
+  auto bigkeys = std::make_shared<eidos::keystats::BigKeys>(4);
+  auto leader_engine = std::make_shared<eidos::storage::MemoryStorageEngine<>>();
+  StateMachine leader(leader_engine, leader_dir.path(), 0);
+  StateMachine follower(std::make_shared<eidos::keystats::BigKeysEngine>(
+                            std::make_shared<eidos::storage::MemoryStorageEngine<>>(), bigkeys),
+                        follower_dir.path(), 0);
+
+  // writes replicated from the leader, not sent by a client of this node
+  Commit(follower, 1, eidos::storage::detail::EncodeSet(MakeKey("a"), MakeValue("large")));
+  Commit(follower, 2, eidos::storage::detail::EncodeBatch({{MakeKey("b"), MakeValue("larger")}}));
+  EXPECT_EQ(bigkeys->top(10).size(), 2);
+  Commit(follower, 3, eidos::storage::detail::EncodeDel(MakeKey("b")));
+  ASSERT_EQ(bigkeys->top(10).size(), 1);
+  EXPECT_EQ(bigkeys->top(10).front().first, "a");
+
+  // the snapshot replaces the tracked keys too
+  Commit(leader, 1, eidos::storage::detail::EncodeSet(MakeKey("c"), MakeValue("largest")));
+  nuraft::snapshot s(1, 1, nullptr);
+  ASSERT_TRUE(CreateSnapshot(leader, s));
+  TransferSnapshot(leader, follower, s);
+  ASSERT_TRUE(follower.apply_snapshot(s));
+  ASSERT_EQ(bigkeys->top(10).size(), 1);
+  EXPECT_EQ(bigkeys->top(10).front().first, "c");
+}
@@ -15,6 +15,8 @@
 #include <gtest/gtest.h>
 
 #include <eidos/result.hpp>
+#include <ostream>
+#include <type_traits>
 
 TEST(EidosResult, Ok_is_ok_true) {
   const auto res = eidos::result::Result<int, std::string>::Ok(0);
@@ -77,3 +79,36 @@ TEST(EidosResult, Err_unwrap) {
   const auto res = eidos::result::Result<int, std::string>::Err("error");
   EXPECT_THROW(res.unwrap(), eidos::result::PanicError);
 }
+
+namespace {
+
+enum class ErrorCode { kNotFound };
+
+std::ostream& operator<<(std::ostream& os, ErrorCode) { return os << "not found"; }
+
+}  // namespace
+
+TEST(EidosResult, Trivially_copyable_result_has_no_variant) {
+  using Result = eidos::result::Result<std::size_t, ErrorCode>;
+  static_assert(std::is_trivially_copyable_v<Result>);
+  static_assert(sizeof(Result) <= 2 * sizeof(std::size_t));
+  static_assert(Result::Ok(3).is_ok() && Result::Ok(3).ok().value() == 3);
+  static_assert(Result::Err(ErrorCode::kNotFound).err().value() == ErrorCode::kNotFound);
+
+  const auto res = Result::Err(ErrorCode::kNotFound);
+  EXPECT_TRUE(res.is_err());
+  EXPECT_FALSE(res.ok().has_value());
+  EXPECT_EQ(res.unwrap_or(5), 5);
+  EXPECT_EQ(res.unwrap_or_else([](ErrorCode) { return std::size_t{7}; }), 7);
+}
+
+TEST(EidosResult, Error_code_is_converted_to_message_on_panic) {
+  const auto res = eidos::result::Result<bool, ErrorCode>::Err(ErrorCode::kNotFound);
+  try {
+    res.expect("eval failed");
+    FAIL();
+  } catch (const eidos::result::PanicError& e) {
+    EXPECT_STREQ(e.what(), "eval failed: not found");
+  }
+  EXPECT_EQ((eidos::result::Result<bool, ErrorCode>::Ok(true).unwrap()), true);
+}
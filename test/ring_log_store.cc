@@ -0,0 +1,173 @@
+// Copyright 2021 SiLeader and Cerussite.
+//
+// Licensed under the Apache License, Version 2.0 (the “License”);
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an “AS IS” BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <gtest/gtest.h>
+
+#include <atomic>
+#include <thread>
+#include <vector>
+
+#include "storage/ring_log_store.hpp"
+
+using eidos::storage::detail::RingBufferLogStore;
+
+namespace {
+
+/// entry whose term is its log index, so a reader can tell a misplaced entry from the dummy (term 0)
+/// \param term term
+/// \param size payload size
+/// \return entry
+nuraft::ptr<nuraft::log_entry> MakeEntry(nuraft::ulong term, std::size_t size = 8) {
+  return nuraft::cs_new<nuraft::log_entry>(term, nuraft::buffer::alloc(size));
+}
+
+void AppendUntil(RingBufferLogStore& store, nuraft::ulong last) {
+  while (store.next_slot() <= last) {
+    auto entry = MakeEntry(store.next_slot());
+    store.append(entry);
+  }
+}
+
+}  // namespace
+
+TEST(EidosRingLogStore, Ring_grows_beyond_initial_capacity) {
+  RingBufferLogStore store;
+  AppendUntil(store, 5000);
+  EXPECT_EQ(store.start_index(), 1);
+  EXPECT_EQ(store.next_slot(), 5001);
+  for (nuraft::ulong i = 1; i <= 5000; ++i) {
+    ASSERT_EQ(store.term_at(i), i);
+  }
+  EXPECT_EQ(store.last_entry()->get_term(), 5000);
+
+  // growth after compaction keeps the entries of [start, next)
+  store.compact(3000);
+  AppendUntil(store, 9000);
+  EXPECT_EQ(store.term_at(3000), 0);
+  for (nuraft::ulong i = 3001; i <= 9000; ++i) {
+    ASSERT_EQ(store.term_at(i), i);
+  }
+}
+
+TEST(EidosRingLogStore, Write_at_truncates_following_entries) {
+  RingBufferLogStore store;
+  AppendUntil(store, 10);
+
+  auto entry = MakeEntry(100);
+  store.write_at(5, entry);
+  EXPECT_EQ(store.next_slot(), 6);
+  EXPECT_EQ(store.term_at(5), 100);
+  EXPECT_EQ(store.term_at(4), 4);
+  // truncated entries read as the dummy entry
+  EXPECT_EQ(store.term_at(6), 0);
+  EXPECT_EQ(store.term_at(10), 0);
+
+  auto appended = MakeEntry(6);
+  EXPECT_EQ(store.append(appended), 6);
+  EXPECT_EQ(store.term_at(6), 6);
+}
+
+TEST(EidosRingLogStore, Compact_beyond_next_index_moves_both_ends) {
+  RingBufferLogStore store;
+  AppendUntil(store, 10);
+
+  EXPECT_TRUE(store.compact(20));
+  EXPECT_EQ(store.start_index(), 21);
+  EXPECT_EQ(store.next_slot(), 21);
+  EXPECT_EQ(store.term_at(10), 0);
+  EXPECT_EQ(store.last_entry()->get_term(), 0);
+
+  auto entry = MakeEntry(21);
+  EXPECT_EQ(store.append(entry), 21);
+  EXPECT_EQ(store.term_at(21), 21);
+}
+
+TEST(EidosRingLogStore, Pack_round_trips_through_apply_pack) {
+  RingBufferLogStore source;
+  AppendUntil(source, 2000);
+  const auto pack = source.pack(100, 1500);
+
+  RingBufferLogStore store;
+  AppendUntil(store, 10);
+  store.apply_pack(100, *pack);
+  EXPECT_EQ(store.start_index(), 100);
+  EXPECT_EQ(store.next_slot(), 1600);
+  EXPECT_EQ(store.term_at(99), 0);
+  for (nuraft::ulong i = 100; i < 1600; ++i) {
+    ASSERT_EQ(store.term_at(i), i);
+    ASSERT_EQ(store.entry_at(i)->get_buf().size(), 8);
+  }
+
+  auto entry = MakeEntry(1600);
+  EXPECT_EQ(store.append(entry), 1600);
+}
+
+TEST(EidosRingLogStore, Log_entries_ext_stops_at_size_hint) {
+  RingBufferLogStore store;
+  for (nuraft::ulong i = 1; i <= 10; ++i) {
+    auto entry = MakeEntry(i, 100);
+    store.append(entry);
+  }
+
+  // the entry that reaches the hint is included
+  EXPECT_EQ(store.log_entries_ext(1, 11, 250)->size(), 3);
+  EXPECT_EQ(store.log_entries_ext(1, 11, 300)->size(), 3);
+  EXPECT_EQ(store.log_entries_ext(1, 11, 1)->size(), 1);
+  // 0: no limit, negative: nothing
+  EXPECT_EQ(store.log_entries_ext(1, 11, 0)->size(), 10);
+  EXPECT_TRUE(store.log_entries_ext(1, 11, -1)->empty());
+  EXPECT_EQ(store.log_entries(3, 7)->size(), 4);
+}
+
+TEST(EidosRingLogStore, Readers_see_entry_or_dummy_during_append_and_compact) {
+  RingBufferLogStore store;
+  constexpr nuraft::ulong kLast = 200000;
+  std::atomic<bool> done = false;
+  std::atomic<std::size_t> misplaced = 0;
+
+  std::vector<std::thread> readers;
+  for (int r = 0; r < 2; ++r) {
+    readers.emplace_back([&] {
+      while (!done.load()) {
+        const auto start = store.start_index();
+        const auto next = store.next_slot();
+        for (auto i = start; i < next; i += 7) {
+          const auto term = store.term_at(i);
+          if (term != i && term != 0) {
+            ++misplaced;
+          }
+        }
+        if (const auto term = store.last_entry()->get_term(); term != 0 && term < next - 1) {
+          ++misplaced;
+        }
+      }
+    });
+  }
+
+  while (store.next_slot() <= kLast) {
+    auto entry = MakeEntry(store.next_slot());
+    store.append(entry);
+    // the retained part of the log grows, so the ring grows too
+    const auto retained = 500 + store.next_slot() / 50000 * 1000;
+    if (store.next_slot() % 1000 == 0 && store.next_slot() - store.start_index() > retained) {
+      store.compact(store.next_slot() - 1 - retained);
+    }
+  }
+  done = true;
+  for (auto& reader : readers) {
+    reader.join();
+  }
+  EXPECT_EQ(misplaced.load(), 0);
+  EXPECT_EQ(store.term_at(kLast), kLast);
+}
@@ -0,0 +1,88 @@
+// Copyright 2021 SiLeader and Cerussite.
+//
+// Licensed under the Apache License, Version 2.0 (the “License”);
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an “AS IS” BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <gtest/gtest.h>
+
+#include <cstddef>
+#include <string>
+#include <vector>
+
+#include "slowlog.hpp"
+
+using eidos::slowlog::SlowLog;
+
+namespace {
+
+std::vector<std::vector<std::byte>> Args(const std::vector<std::string>& args) {
+  std::vector<std::vector<std::byte>> bytes;
+  for (const auto& arg : args) {
+    bytes.emplace_back(arg.size());
+    std::transform(std::begin(arg), std::end(arg), std::begin(bytes.back()),
+                   [](char c) { return static_cast<std::byte>(c); });
+  }
+  return bytes;
+}
+
+}  // namespace
+
+TEST(EidosSlowLog, Under_threshold_is_not_recorded) {
+  SlowLog log(100, 4);
+  bool called = false;
+  log.record(
+      std::chrono::microseconds(99), Args({"GET", "a"}),
+      [&called] {
+        called = true;
+        return std::string();
+      },
+      [] { return std::string(); });
+  EXPECT_EQ(log.size(), 0);
+  EXPECT_FALSE(called);
+}
+
+TEST(EidosSlowLog, Ring_keeps_newest_entries) {
+  SlowLog log(0, 2);
+  for (int i = 0; i < 3; ++i) {
+    log.record(std::chrono::microseconds(i), Args({"SET", std::to_string(i)}), [] { return "127.0.0.1:1"; },
+               [] { return "worker"; });
+  }
+  EXPECT_EQ(log.size(), 2);
+  const auto entries = log.get(10);
+  ASSERT_EQ(entries.size(), 2);
+  EXPECT_EQ(entries[0].id, 2);
+  EXPECT_EQ(entries[0].args[1], "2");
+  EXPECT_EQ(entries[1].id, 1);
+  EXPECT_EQ(entries[1].client, "127.0.0.1:1");
+  EXPECT_EQ(entries[1].client_name, "worker");
+
+  log.reset();
+  EXPECT_EQ(log.size(), 0);
+}
+
+TEST(EidosSlowLog, Long_argument_is_truncated) {
+  SlowLog log(0, 1);
+  log.record(std::chrono::microseconds(1), Args({"SET", "k", std::string(200, 'v')}), [] { return ""; }, [] { return ""; });
+  const auto entries = log.get(1);
+  ASSERT_EQ(entries.size(), 1);
+  EXPECT_EQ(entries[0].args[2], std::string(eidos::slowlog::kMaxArgLength, 'v') + "... (72 more bytes)");
+}
+
+TEST(EidosSlowLog, Encode_includes_client_address_and_name) {
+  SlowLog log(0, 1);
+  log.record(std::chrono::microseconds(5), Args({"GET", "k"}), [] { return "127.0.0.1:1"; }, [] { return "worker"; });
+  auto entries = log.get(1);
+  ASSERT_EQ(entries.size(), 1);
+  entries[0].timestamp = 1;
+  EXPECT_EQ(eidos::slowlog::Encode(entries),
+            "*1\r\n*6\r\n:0\r\n:1\r\n:5\r\n*2\r\n$3\r\nGET\r\n$1\r\nk\r\n$11\r\n127.0.0.1:1\r\n$6\r\nworker\r\n");
+}
@@ -0,0 +1,71 @@
+// Copyright 2021 SiLeader and Cerussite.
+//
+// Licensed under the Apache License, Version 2.0 (the “License”);
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an “AS IS” BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <gtest/gtest.h>
+
+#include <thread>
+
+#include "stats.hpp"
+
+using eidos::histogram::Histogram;
+using eidos::stats::Stats;
+
+TEST(EidosStats, Merge_thread_shards) {
+  Stats stats;
+  const auto get = static_cast<std::size_t>(eidos::commands::Id::kGet);
+
+  std::vector<std::thread> threads;
+  for (int t = 0; t < 4; ++t) {
+    threads.emplace_back([&stats, get] {
+      for (int i = 0; i < 100; ++i) {
+        stats.record(get, std::chrono::microseconds(10), i % 10 == 0, 20, 10);
+      }
+    });
+  }
+  for (auto& thread : threads) {
+    thread.join();
+  }
+
+  Histogram latency;
+  EXPECT_EQ(stats.command(get, latency), 40);
+  EXPECT_EQ(latency.count(), 400);
+  EXPECT_EQ(stats.netInput(), 8000);
+  EXPECT_EQ(stats.netOutput(), 4000);
+}
+
+TEST(EidosStats, Thread_keeps_shard_of_each_instance) {
+  const auto get = static_cast<std::size_t>(eidos::commands::Id::kGet);
+  Stats a;
+  Stats b;
+  a.record(get, std::chrono::microseconds(10), false, 1, 1);
+  b.record(get, std::chrono::microseconds(10), false, 2, 2);
+  a.record(get, std::chrono::microseconds(10), false, 1, 1);
+
+  Histogram latency;
+  a.command(get, latency);
+  EXPECT_EQ(latency.count(), 2);
+  EXPECT_EQ(a.netInput(), 2);
+  EXPECT_EQ(b.netInput(), 2);
+}
+
+TEST(EidosStats, Connected_clients) {
+  Stats stats;
+  {
+    const eidos::stats::ClientGuard a(stats);
+    const eidos::stats::ClientGuard b(stats);
+    EXPECT_EQ(stats.connectedClients(), 2);
+  }
+  EXPECT_EQ(stats.connectedClients(), 0);
+  EXPECT_EQ(stats.totalConnections(), 2);
+}
@@ -0,0 +1,53 @@
+// Copyright 2021 SiLeader and Cerussite.
+//
+// Licensed under the Apache License, Version 2.0 (the “License”);
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an “AS IS” BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <gtest/gtest.h>
+
+#include <string>
+#include <thread>
+
+#include "trace.hpp"
+
+using eidos::trace::Tracer;
+
+TEST(EidosTrace, Spans_are_not_recorded_while_inactive) {
+  Tracer tracer;
+  tracer.record("span", "test", 1000, 2000);
+  const auto json = tracer.stop();
+  EXPECT_EQ(json.find(R"("name":"span")"), std::string::npos);
+}
+
+TEST(EidosTrace, Spans_of_all_threads_are_collected) {
+  Tracer tracer;
+  tracer.start();
+  tracer.record("main", "test", 1000, 3500, "GET");
+  std::thread([&tracer] { tracer.record("worker", "test", 2000, 3000); }).join();
+  const auto json = tracer.stop();
+
+  EXPECT_NE(json.find(R"({"name":"main","cat":"test","ph":"X","ts":1.000,"dur":2.500,)"), std::string::npos);
+  EXPECT_NE(json.find(R"("args":{"arg":"GET"})"), std::string::npos);
+  EXPECT_NE(json.find(R"("name":"worker")"), std::string::npos);
+}
+
+TEST(EidosTrace, Restart_discards_previous_spans) {
+  Tracer tracer;
+  tracer.start();
+  tracer.record("old", "test", 1000, 2000);
+  tracer.stop();
+  tracer.start();
+  tracer.record("new", "test", 1000, 2000);
+  const auto json = tracer.stop();
+  EXPECT_EQ(json.find(R"("name":"old")"), std::string::npos);
+  EXPECT_NE(json.find(R"("name":"new")"), std::string::npos);
+}
@@ -0,0 +1,143 @@
+// Copyright 2021 SiLeader and Cerussite.
+//
+// Licensed under the Apache License, Version 2.0 (the “License”);
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an “AS IS” BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <gtest/gtest.h>
+
+#include <string>
+#include <vector>
+
+#include "storage/memstore.hpp"
+#include "transaction.hpp"
+
+using eidos::transaction::BufferedEngine;
+using eidos::transaction::Transaction;
+
+namespace {
+
+std::vector<std::byte> Bytes(const std::string& s) {
+  std::vector<std::byte> bytes(s.size());
+  std::transform(std::begin(s), std::end(s), std::begin(bytes), [](char c) { return static_cast<std::byte>(c); });
+  return bytes;
+}
+
+eidos::Key MakeKey(const std::string& key) { return eidos::Key(Bytes(key), std::hash<std::string>{}(key)); }
+
+eidos::Value MakeValue(const std::string& value) { return eidos::Value(Bytes(value)); }
+
+}  // namespace
+
+TEST(EidosTransaction, Writes_are_buffered_until_commit) {
+  eidos::storage::MemoryStorageEngine<> engine;
+  engine.set(MakeKey("a"), MakeValue("1"));
+
+  BufferedEngine buffered(engine);
+  buffered.set(MakeKey("b"), MakeValue("2"));
+  EXPECT_TRUE(buffered.del(MakeKey("a")).is_ok());
+  EXPECT_EQ(buffered.del(MakeKey("a")).err(), eidos::storage::Error::kNotFound);
+  EXPECT_EQ(buffered.get(MakeKey("a")).err(), eidos::storage::Error::kNotFound);
+  EXPECT_EQ(buffered.get(MakeKey("b")).unwrap().bytes(), Bytes("2"));
+  EXPECT_TRUE(buffered.exists(MakeKey("b")).unwrap());
+  EXPECT_EQ(buffered.mutations().size(), 2);
+
+  // nothing is written before the commit
+  EXPECT_TRUE(engine.exists(MakeKey("a")).unwrap());
+  EXPECT_FALSE(engine.exists(MakeKey("b")).unwrap());
+
+  EXPECT_TRUE(buffered.commit().is_ok());
+  EXPECT_FALSE(engine.exists(MakeKey("a")).unwrap());
+  EXPECT_EQ(engine.get(MakeKey("b")).unwrap().bytes(), Bytes("2"));
+}
+
+TEST(EidosTransaction, Watched_key_is_changed_by_writes) {
+  eidos::storage::MemoryStorageEngine<> engine;
+  Transaction transaction;
+  transaction.watch(engine, MakeKey("a"));
+  EXPECT_FALSE(transaction.changed(engine));
+
+  engine.set(MakeKey("a"), MakeValue("1"));
+  EXPECT_TRUE(transaction.changed(engine));
+
+  transaction.unwatch();
+  transaction.watch(engine, MakeKey("a"));
+  engine.del(MakeKey("missing"));
+  EXPECT_FALSE(transaction.changed(engine));
+  engine.del(MakeKey("a"));
+  EXPECT_TRUE(transaction.changed(engine));
+
+  // EXEC and DISCARD forget watched keys
+  transaction.finish();
+  EXPECT_FALSE(transaction.changed(engine));
+}
+
+TEST(EidosTransaction, Commit_is_discarded_if_watched_key_is_written) {
+  eidos::storage::MemoryStorageEngine<> engine;
+  Transaction transaction;
+  transaction.watch(engine, MakeKey("a"));
+  const auto watched = transaction.watched();
+  engine.set(MakeKey("a"), MakeValue("1"));
+
+  BufferedEngine buffered(engine);
+  buffered.set(MakeKey("b"), MakeValue("2"));
+  EXPECT_EQ(buffered.commit(watched).err(), eidos::storage::Error::kWatchConflict);
+  EXPECT_FALSE(engine.exists(MakeKey("b")).unwrap());
+
+  transaction.unwatch();
+  transaction.watch(engine, MakeKey("a"));
+  EXPECT_TRUE(buffered.commit(transaction.watched()).is_ok());
+  EXPECT_TRUE(engine.exists(MakeKey("b")).unwrap());
+}
+
+TEST(EidosTransaction, Commands_are_queued_until_finish) {
+  Transaction transaction;
+  transaction.abort();
+  EXPECT_FALSE(transaction.aborted());
+
+  transaction.begin();
+  EXPECT_TRUE(transaction.active());
+  const std::vector<std::vector<std::byte>> args = {Bytes("key"), Bytes("value")};
+  transaction.queue(eidos::commands::Get(eidos::commands::Id::kSet), args);
+  transaction.abort();
+  EXPECT_TRUE(transaction.aborted());
+  EXPECT_EQ(transaction.queued(), 1);
+
+  const auto queued = transaction.finish();
+  ASSERT_EQ(queued.size(), 1);
+  EXPECT_EQ(queued[0].spec->id, eidos::commands::Id::kSet);
+  EXPECT_EQ(queued[0].args, args);
+  EXPECT_FALSE(transaction.active());
+  EXPECT_FALSE(transaction.aborted());
+  EXPECT_EQ(transaction.queued(), 0);
+}
+
+TEST(EidosTransaction, Clear_deletes_stored_and_buffered_keys) {
+  eidos::storage::MemoryStorageEngine<> engine;
+  engine.set(MakeKey("a"), MakeValue("1"));
+
+  BufferedEngine buffered(engine);
+  buffered.set(MakeKey("b"), MakeValue("2"));
+  EXPECT_TRUE(buffered.clear().is_ok());
+  EXPECT_FALSE(buffered.exists(MakeKey("a")).unwrap());
+  EXPECT_FALSE(buffered.exists(MakeKey("b")).unwrap());
+  EXPECT_TRUE(engine.exists(MakeKey("a")).unwrap());
+
+  const auto version = engine.version(MakeKey("a"));
+  EXPECT_TRUE(buffered.commit().is_ok());
+  EXPECT_EQ(engine.size().unwrap(), 0);
+  EXPECT_NE(engine.version(MakeKey("a")), version);
+
+  engine.set(MakeKey("c"), MakeValue("3"));
+  EXPECT_TRUE(engine.clear().is_ok());
+  EXPECT_EQ(engine.size().unwrap(), 0);
+  EXPECT_FALSE(engine.exists(MakeKey("c")).unwrap());
+}
@@ -0,0 +1,74 @@
+// Copyright 2021 SiLeader and Cerussite.
+//
+// Licensed under the Apache License, Version 2.0 (the “License”);
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an “AS IS” BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifdef EIDOS_IO_URING
+
+#include <gtest/gtest.h>
+
+#include <array>
+#include <optional>
+#include <string>
+
+#include "uring.hpp"
+
+namespace net = boost::asio;
+using eidos::net::uring::Connection;
+using eidos::net::uring::Ring;
+
+TEST(EidosUring, Connection_echoes_received_bytes) {
+  net::io_context ioc;
+  auto ring = Ring::Create(ioc);
+  if (ring.is_err()) {
+    GTEST_SKIP() << "io_uring is not available: " << ring.err().value();
+  }
+
+  // echo server on an ephemeral port
+  std::optional<Connection> connection;
+  std::array<char, 64> buffer{};
+  std::string echoed;
+  const net::ip::tcp::endpoint endpoint(net::ip::address_v4::loopback(), 0);
+  auto acceptor = net::ip::tcp::acceptor(ioc, endpoint);
+  const auto port = acceptor.local_endpoint().port();
+  acceptor.close();
+  eidos::net::uring::Listen(ring.unwrap(), net::ip::tcp::endpoint(net::ip::address_v4::loopback(), port),
+                            [&](Connection accepted) {
+                              connection.emplace(std::move(accepted));
+                              connection->async_read_some(
+                                  net::buffer(buffer), [&](const boost::system::error_code& ec, std::size_t size) {
+                                    ASSERT_FALSE(ec);
+                                    connection->async_write(net::buffer(buffer.data(), size),
+                                                            [](const boost::system::error_code& ec, std::size_t) {
+                                                              ASSERT_FALSE(ec);
+                                                            });
+                                  });
+                            });
+
+  // client
+  net::ip::tcp::socket client(ioc);
+  client.connect(net::ip::tcp::endpoint(net::ip::address_v4::loopback(), port));
+  net::write(client, net::buffer(std::string("PING")));
+  std::array<char, 4> reply{};
+  net::async_read(client, net::buffer(reply), [&](const boost::system::error_code& ec, std::size_t size) {
+    ASSERT_FALSE(ec);
+    echoed.assign(reply.data(), size);
+    ioc.stop();
+  });
+  ioc.run_for(std::chrono::seconds(5));
+
+  EXPECT_EQ(echoed, "PING");
+  ASSERT_TRUE(connection.has_value());
+  EXPECT_EQ(connection->peer(), "127.0.0.1:" + std::to_string(client.local_endpoint().port()));
+}
+
+#endif  // EIDOS_IO_URING